@@ -0,0 +1,138 @@
+#include "Corpus.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char* const WORDS[] = {
+    "value", "count", "index", "buffer", "result", "offset", "length", "entry",
+    "return", "const", "auto", "size_t", "if", "for", "while", "std::vector",
+};
+const size_t WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+struct Scratch {
+    std::string path;
+    
+    Scratch() {
+        path = (fs::temp_directory_path() / ("vv_bench_" + std::to_string(::getpid()))).string();
+        fs::remove_all(path);
+        fs::create_directories(path);
+    }
+    
+    ~Scratch() {
+        std::error_code ignored;
+        fs::remove_all(path, ignored);
+    }
+};
+
+std::string line(std::mt19937& rng) {
+    switch (rng() % 10) {
+        case 0:
+            return "";
+        case 1:
+            return "}";
+        case 2:
+            return "    if (" + std::string(WORDS[rng() % WORD_COUNT]) + ") {";
+        default: {
+            std::string result = "        ";
+            int words = 2 + rng() % 6;
+            for (int i = 0; i < words; i++) {
+                result += WORDS[rng() % WORD_COUNT];
+                result += ' ';
+            }
+            result += std::to_string(rng() % 1000) + ";";
+            return result;
+        }
+    }
+}
+
+}
+
+std::string Corpus::text(size_t bytes, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::string result;
+    result.reserve(bytes + 128);
+    while (result.size() < bytes) {
+        result += line(rng);
+        result += '\n';
+    }
+    result.resize(bytes);
+    return result;
+}
+
+std::vector<char> Corpus::binary(size_t bytes, uint32_t seed) {
+    std::mt19937_64 rng(seed);
+    std::vector<char> result(bytes);
+    for (size_t i = 0; i < bytes; i++) {
+        result[i] = static_cast<char>(rng() & 0xff);
+    }
+    if (bytes > 16) {
+        result[16] = 0;
+    }
+    return result;
+}
+
+std::string Corpus::mutateLines(const std::string& content, double rate, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    std::string result;
+    result.reserve(content.size() + content.size() / 8);
+    
+    for (std::string_view current : lines(content)) {
+        if (chance(rng) >= rate) {
+            result.append(current.data(), current.size());
+            result += '\n';
+            continue;
+        }
+        switch (rng() % 3) {
+            case 0:
+                break;
+            case 1:
+                result += line(rng);
+                result += '\n';
+                break;
+            default:
+                result.append(current.data(), current.size());
+                result += '\n';
+                result += line(rng);
+                result += '\n';
+                break;
+        }
+    }
+    return result;
+}
+
+std::vector<std::string_view> Corpus::lines(const std::string& content) {
+    std::vector<std::string_view> result;
+    size_t start = 0;
+    while (start < content.size()) {
+        size_t end = content.find('\n', start);
+        if (end == std::string::npos) {
+            end = content.size();
+        }
+        result.emplace_back(content.data() + start, end - start);
+        start = end + 1;
+    }
+    return result;
+}
+
+const std::string& Corpus::scratchDirectory() {
+    static Scratch scratch;
+    return scratch.path;
+}
+
+std::string Corpus::writeFile(const std::string& name, const char* data, size_t size) {
+    std::string path = scratchDirectory() + "/" + name;
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot create benchmark file: " + path);
+    }
+    file.write(data, size);
+    return path;
+}
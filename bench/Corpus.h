@@ -0,0 +1,33 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Synthetic inputs for the benchmarks. Every generator is seeded, so a
+// given size always produces the same bytes and runs stay comparable.
+class Corpus {
+public:
+    // Source-like text: indented statements, braces and blank lines, so it
+    // has the mix of unique and repeated lines the diff algorithms care
+    // about.
+    static std::string text(size_t bytes, uint32_t seed = 1);
+    
+    // Incompressible bytes with a NUL early on, so they classify as binary.
+    static std::vector<char> binary(size_t bytes, uint32_t seed = 1);
+    
+    // Replaces, inserts or drops about rate of the lines of content.
+    static std::string mutateLines(const std::string& content, double rate, uint32_t seed = 2);
+    
+    // Lines of content as views into it, without their '\n'.
+    static std::vector<std::string_view> lines(const std::string& content);
+    
+    // A scratch directory shared by the benchmarks of one run and removed
+    // at exit.
+    static const std::string& scratchDirectory();
+    static std::string writeFile(const std::string& name, const char* data, size_t size);
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "Corpus.h"
+#include "DiffEngine.h"
+#include "DiffFormatter.h"
+#include "StreamingDiff.h"
+#include <benchmark/benchmark.h>
+#include <memory>
+
+namespace {
+
+// The edited side changes about 2% of its lines, roughly what a commit
+// touches in a large file.
+const double EDIT_RATE = 0.02;
+
+template<typename Algorithm>
+void BM_Diff(benchmark::State& state) {
+    std::string oldText = Corpus::text(state.range(0));
+    std::string newText = Corpus::mutateLines(oldText, EDIT_RATE);
+    std::vector<std::string_view> oldLines = Corpus::lines(oldText);
+    std::vector<std::string_view> newLines = Corpus::lines(newText);
+    Algorithm algorithm;
+    
+    size_t edits = 0;
+    for (auto _ : state) {
+        std::vector<Edit> script = algorithm.computeEdits(oldLines, newLines);
+        edits = script.size();
+        benchmark::DoNotOptimize(script.data());
+    }
+    state.SetBytesProcessed(state.iterations() * (oldText.size() + newText.size()));
+    state.counters["lines"] = static_cast<double>(oldLines.size());
+    state.counters["edit_runs"] = static_cast<double>(edits);
+}
+
+// Two unrelated inputs: the worst case for Myers, and what the cost cap
+// is there for.
+void BM_DiffUnrelated(benchmark::State& state) {
+    std::string oldText = Corpus::text(state.range(0), 1);
+    std::string newText = Corpus::text(state.range(0), 2);
+    std::vector<std::string_view> oldLines = Corpus::lines(oldText);
+    std::vector<std::string_view> newLines = Corpus::lines(newText);
+    MyersDiff algorithm;
+    algorithm.setMaxCost(static_cast<int>(state.range(1)));
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(algorithm.computeEdits(oldLines, newLines).data());
+    }
+    state.SetBytesProcessed(state.iterations() * (oldText.size() + newText.size()));
+}
+
+// The unified diff of the same edit both ways: whole files in memory, and
+// streamed a window at a time. The second argument is the window in lines.
+void BM_UnifiedDiff(benchmark::State& state) {
+    std::string oldText = Corpus::text(state.range(0));
+    std::string newText = Corpus::mutateLines(oldText, EDIT_RATE);
+    std::vector<std::string_view> oldLines = Corpus::lines(oldText);
+    std::vector<std::string_view> newLines = Corpus::lines(newText);
+    AdaptiveDiff algorithm;
+    
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        StringSink sink(out);
+        UnifiedDiffFormatter().format(oldLines, newLines,
+                                      algorithm.computeEdits(oldLines, newLines), sink);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * (oldText.size() + newText.size()));
+}
+
+void BM_StreamingDiff(benchmark::State& state) {
+    std::string oldText = Corpus::text(state.range(0));
+    std::string newText = Corpus::mutateLines(oldText, EDIT_RATE);
+    AdaptiveDiff algorithm;
+    StreamingDiff streaming(algorithm, UnifiedDiffFormatter(), static_cast<size_t>(state.range(1)));
+    
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        StringSink sink(out);
+        streaming.diff(ContentView(oldText.data(), oldText.size()),
+                       ContentView(newText.data(), newText.size()), sink);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * (oldText.size() + newText.size()));
+}
+
+// Many small pairs through the engine, where the per-pair overhead of
+// dispatching to the algorithm is largest relative to the diff itself.
+// Static picks the templated entry point.
+std::vector<std::pair<TextFile, TextFile>> smallPairs(size_t count, size_t size,
+                                                      std::vector<std::string>& texts) {
+    texts.clear();
+    texts.reserve(2 * count);
+    std::vector<std::pair<TextFile, TextFile>> pairs;
+    for (size_t i = 0; i < count; i++) {
+        texts.push_back(Corpus::text(size, static_cast<uint32_t>(i)));
+        texts.push_back(Corpus::mutateLines(texts.back(), EDIT_RATE));
+        const std::string& oldText = texts[texts.size() - 2];
+        const std::string& newText = texts.back();
+        pairs.emplace_back(TextFile("old", ContentView(oldText.data(), oldText.size())),
+                           TextFile("new", ContentView(newText.data(), newText.size())));
+    }
+    return pairs;
+}
+
+template<bool Static>
+void BM_EngineEdits(benchmark::State& state) {
+    std::vector<std::string> texts;
+    std::vector<std::pair<TextFile, TextFile>> pairs =
+        smallPairs(static_cast<size_t>(state.range(0)), static_cast<size_t>(state.range(1)), texts);
+    DiffEngine engine;
+    engine.setAlgorithm(new MyersDiff());
+    
+    for (auto _ : state) {
+        for (auto& pair : pairs) {
+            std::vector<Edit> edits = Static ? engine.computeEdits<MyersDiff>(&pair.first, &pair.second)
+                                             : engine.computeEdits(&pair.first, &pair.second);
+            benchmark::DoNotOptimize(edits.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+void BM_CalculateSimilarity(benchmark::State& state) {
+    std::string oldText = Corpus::text(state.range(0));
+    std::string newText = Corpus::mutateLines(oldText, EDIT_RATE);
+    double threshold = state.range(1) / 100.0;
+    DiffEngine engine;
+    
+    double similarity = 0.0;
+    for (auto _ : state) {
+        similarity = engine.calculateSimilarity(oldText, newText, threshold);
+        benchmark::DoNotOptimize(similarity);
+    }
+    state.SetBytesProcessed(state.iterations() * (oldText.size() + newText.size()));
+    state.counters["similarity"] = similarity;
+}
+
+}
+
+BENCHMARK_TEMPLATE(BM_Diff, SimpleDiff)->RangeMultiplier(8)->Range(16 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(BM_Diff, MyersDiff)->RangeMultiplier(8)->Range(16 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(BM_Diff, PatienceDiff)->RangeMultiplier(8)->Range(16 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(BM_Diff, HistogramDiff)->RangeMultiplier(8)->Range(16 << 10, 1 << 20);
+BENCHMARK_TEMPLATE(BM_Diff, AdaptiveDiff)->RangeMultiplier(8)->Range(16 << 10, 1 << 20);
+BENCHMARK(BM_DiffUnrelated)->Args({64 << 10, 0})->Args({64 << 10, 64});
+BENCHMARK(BM_UnifiedDiff)->Arg(1 << 20)->Arg(8 << 20);
+BENCHMARK(BM_StreamingDiff)->Args({1 << 20, 4096})->Args({1 << 20, 64 << 10})
+    ->Args({8 << 20, 4096})->Args({8 << 20, 64 << 10});
+BENCHMARK_TEMPLATE(BM_EngineEdits, false)->Args({256, 512})->Args({256, 4 << 10});
+BENCHMARK_TEMPLATE(BM_EngineEdits, true)->Args({256, 512})->Args({256, 4 << 10});
+BENCHMARK(BM_CalculateSimilarity)
+    ->Args({4 << 10, 0})->Args({4 << 10, 60})
+    ->Args({64 << 10, 0})->Args({64 << 10, 60})
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,83 @@
+#include "Corpus.h"
+#include "FileObject.h"
+#include "Hasher.h"
+#include <benchmark/benchmark.h>
+
+namespace {
+
+// Hashes straight from disk: a fresh object per iteration, so nothing is
+// remembered between runs. The file stays in the page cache throughout.
+void BM_HashTextFile(benchmark::State& state) {
+    std::string content = Corpus::text(state.range(0));
+    std::string path = Corpus::writeFile("hash_text.txt", content.data(), content.size());
+    
+    for (auto _ : state) {
+        TextFile file(path);
+        benchmark::DoNotOptimize(file.getId());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void BM_HashBinaryFile(benchmark::State& state) {
+    std::vector<char> content = Corpus::binary(state.range(0));
+    std::string path = Corpus::writeFile("hash_binary.bin", content.data(), content.size());
+    
+    for (auto _ : state) {
+        BinaryFile file(path);
+        benchmark::DoNotOptimize(file.getId());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Opening through the factory also classifies the content, as a commit of
+// an unknown file does.
+void BM_HashClassified(benchmark::State& state) {
+    std::vector<char> content = Corpus::binary(state.range(0));
+    std::string path = Corpus::writeFile("hash_classified.dat", content.data(), content.size());
+    
+    for (auto _ : state) {
+        std::unique_ptr<FileObject> file = FileFactory::createFileObject(path);
+        benchmark::DoNotOptimize(file->getId());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+template<HashAlgorithm Algorithm>
+void BM_HashBuffer(benchmark::State& state) {
+    std::vector<char> content = Corpus::binary(state.range(0));
+    std::unique_ptr<Hasher> hasher = Hasher::create(Algorithm);
+    
+    for (auto _ : state) {
+        hasher->update(content.data(), content.size());
+        benchmark::DoNotOptimize(hasher->finish());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// Many small inputs at once, as when staging a tree of small files.
+template<HashAlgorithm Algorithm>
+void BM_HashMany(benchmark::State& state) {
+    size_t count = static_cast<size_t>(state.range(0));
+    size_t size = static_cast<size_t>(state.range(1));
+    std::vector<char> content = Corpus::binary(count * size);
+    std::vector<ContentView> inputs;
+    for (size_t i = 0; i < count; i++) {
+        inputs.emplace_back(content.data() + i * size, size);
+    }
+    
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Hasher::hashMany(Algorithm, inputs).data());
+    }
+    state.SetBytesProcessed(state.iterations() * count * size);
+}
+
+}
+
+BENCHMARK(BM_HashTextFile)->RangeMultiplier(16)->Range(4 << 10, 16 << 20);
+BENCHMARK(BM_HashBinaryFile)->RangeMultiplier(16)->Range(4 << 10, 16 << 20);
+BENCHMARK(BM_HashClassified)->RangeMultiplier(16)->Range(4 << 10, 16 << 20);
+BENCHMARK_TEMPLATE(BM_HashBuffer, HashAlgorithm::SHA256)->RangeMultiplier(16)->Range(4 << 10, 16 << 20);
+BENCHMARK_TEMPLATE(BM_HashBuffer, HashAlgorithm::BLAKE3)->RangeMultiplier(16)->Range(4 << 10, 16 << 20);
+BENCHMARK_TEMPLATE(BM_HashBuffer, HashAlgorithm::SHA1)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_HashMany, HashAlgorithm::SHA256)->Args({4096, 512})->Args({1024, 16 << 10});
+BENCHMARK_TEMPLATE(BM_HashMany, HashAlgorithm::BLAKE3)->Args({4096, 512})->Args({1024, 16 << 10});
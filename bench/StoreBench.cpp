@@ -0,0 +1,108 @@
+#include "Corpus.h"
+#include "ObjectStore.h"
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <map>
+
+namespace {
+
+// Objects cycled through by the cold benchmarks; well above the store's
+// 2000-entry pool, so every lookup misses it.
+const size_t COLD_OBJECTS = 4096;
+
+ObjectStore& store() {
+    static ObjectStore* instance = ObjectStore::getInstance(Corpus::scratchDirectory() + "/objects");
+    return *instance;
+}
+
+// Content that is new to the store on every call.
+ContentView uniqueContent(const std::string& base) {
+    static uint64_t counter = 0;
+    std::vector<char> data(base.begin(), base.end());
+    uint64_t stamp = ++counter;
+    std::memcpy(data.data(), &stamp, std::min(sizeof(stamp), data.size()));
+    return ContentView::fromBuffer(std::move(data));
+}
+
+// Pool hits and misses since before, which was taken ahead of the loop.
+void reportCache(benchmark::State& state, const PoolStats& before) {
+    PoolStats after = store().getCacheStats();
+    state.counters["pool_hits"] = static_cast<double>(after.hits - before.hits);
+    state.counters["pool_misses"] = static_cast<double>(after.misses - before.misses);
+}
+
+void BM_StoreObjectCold(benchmark::State& state) {
+    std::string base = Corpus::text(state.range(0));
+    std::string path = Corpus::scratchDirectory() + "/store_cold.txt";
+    
+    for (auto _ : state) {
+        state.PauseTiming();
+        TextFile file(path, uniqueContent(base));
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(store().storeObject(file));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+// The object is already stored, so this measures hashing plus the index
+// lookup that short-circuits the write.
+void BM_StoreObjectWarm(benchmark::State& state) {
+    std::string base = Corpus::text(state.range(0));
+    std::string path = Corpus::scratchDirectory() + "/store_warm.txt";
+    ContentView content(ContentView::fromBuffer(std::vector<char>(base.begin(), base.end())));
+    {
+        TextFile file(path, content);
+        store().storeObject(file);
+    }
+    
+    for (auto _ : state) {
+        TextFile file(path, content);
+        benchmark::DoNotOptimize(store().storeObject(file));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void BM_RetrieveObjectCold(benchmark::State& state) {
+    // Stored once per size; the benchmark is entered several times while
+    // the iteration count is settled. next carries over so the cycle is
+    // never restarted on objects the previous entry left in the pool.
+    static std::map<int64_t, std::vector<ObjectId>> prepared;
+    static size_t next = 0;
+    std::vector<ObjectId>& ids = prepared[state.range(0)];
+    if (ids.empty()) {
+        std::string base = Corpus::text(state.range(0));
+        for (size_t i = 0; i < COLD_OBJECTS; i++) {
+            TextFile file(Corpus::scratchDirectory() + "/retrieve_cold.txt", uniqueContent(base));
+            ids.push_back(store().storeObject(file));
+        }
+    }
+    
+    PoolStats before = store().getCacheStats();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(store().retrieveObject(ids[next]));
+        next = (next + 1) % ids.size();
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+    reportCache(state, before);
+}
+
+void BM_RetrieveObjectWarm(benchmark::State& state) {
+    std::string base = Corpus::text(state.range(0));
+    TextFile file(Corpus::scratchDirectory() + "/retrieve_warm.txt", uniqueContent(base));
+    ObjectId id = store().storeObject(file);
+    store().retrieveObject(id);
+    
+    PoolStats before = store().getCacheStats();
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(store().retrieveObject(id));
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+    reportCache(state, before);
+}
+
+}
+
+BENCHMARK(BM_StoreObjectCold)->RangeMultiplier(16)->Range(4 << 10, 1 << 20);
+BENCHMARK(BM_StoreObjectWarm)->RangeMultiplier(16)->Range(4 << 10, 1 << 20);
+BENCHMARK(BM_RetrieveObjectCold)->RangeMultiplier(16)->Range(4 << 10, 64 << 10);
+BENCHMARK(BM_RetrieveObjectWarm)->RangeMultiplier(16)->Range(4 << 10, 1 << 20);
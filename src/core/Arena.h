@@ -0,0 +1,54 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+
+// Bump allocation for the short-lived objects of one operation, such as a
+// commit or a diff run. Allocations are never freed one by one; the whole
+// arena is returned at once when it is released or goes out of scope.
+// Containers allocate from it through resource(), and objects created by
+// make() are destroyed by their Ptr without their memory being freed.
+//
+// An arena is not thread-safe; give each task its own.
+class Arena {
+private:
+    std::pmr::monotonic_buffer_resource memory;
+    
+public:
+    struct Destroy {
+        template<typename T>
+        void operator()(T* object) const { object->~T(); }
+    };
+    
+    template<typename T>
+    using Ptr = std::unique_ptr<T, Destroy>;
+    
+    static const size_t INITIAL_SIZE = 64 * 1024;
+    
+    explicit Arena(size_t initialSize = INITIAL_SIZE,
+                   std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+        : memory(initialSize, upstream) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    
+    std::pmr::memory_resource* resource() { return &memory; }
+    
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+        return memory.allocate(bytes, alignment);
+    }
+    
+    template<typename T, typename... Args>
+    Ptr<T> make(Args&&... args) {
+        void* place = memory.allocate(sizeof(T), alignof(T));
+        return Ptr<T>(new (place) T(std::forward<Args>(args)...));
+    }
+    
+    // Every Ptr and container using the arena must be gone by then.
+    void release() { memory.release(); }
+};
+
+#endif
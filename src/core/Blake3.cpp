@@ -0,0 +1,359 @@
+#include "Hasher.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const uint32_t IV[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+    0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+};
+
+// The message word order of each of the seven rounds: the permutation
+// applied between rounds, composed.
+const uint8_t SCHEDULE[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13}
+};
+
+const uint32_t CHUNK_START = 1 << 0;
+const uint32_t CHUNK_END = 1 << 1;
+const uint32_t PARENT = 1 << 2;
+const uint32_t ROOT = 1 << 3;
+
+// Chunks handed to one call of the SIMD kernel.
+const size_t LANES = 4;
+
+inline uint32_t load32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+inline void g(uint32_t* v, int a, int b, int c, int d, uint32_t x, uint32_t y) {
+    v[a] = v[a] + v[b] + x;
+    v[d] = rotr(v[d] ^ v[a], 16);
+    v[c] = v[c] + v[d];
+    v[b] = rotr(v[b] ^ v[c], 12);
+    v[a] = v[a] + v[b] + y;
+    v[d] = rotr(v[d] ^ v[a], 8);
+    v[c] = v[c] + v[d];
+    v[b] = rotr(v[b] ^ v[c], 7);
+}
+
+// The compression function; out gets all 16 words, of which the first 8
+// are the chaining value.
+void compress(const uint32_t cv[8], const uint8_t block[64], uint32_t blockLen,
+              uint64_t counter, uint32_t flags, uint32_t out[16]) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = load32(block + 4 * i);
+    }
+    
+    uint32_t v[16] = {
+        cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+        IV[0], IV[1], IV[2], IV[3],
+        static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), blockLen, flags
+    };
+    for (const uint8_t* s : SCHEDULE) {
+        g(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+        g(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+        g(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+        g(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+        g(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+        g(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+        g(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+        g(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+    }
+    
+    for (int i = 0; i < 8; i++) {
+        out[i] = v[i] ^ v[i + 8];
+        out[i + 8] = v[i + 8] ^ cv[i];
+    }
+}
+
+void compressInPlace(uint32_t cv[8], const uint8_t block[64], uint32_t blockLen,
+                     uint64_t counter, uint32_t flags) {
+    uint32_t out[16];
+    compress(cv, block, blockLen, counter, flags, out);
+    std::memcpy(cv, out, 8 * sizeof(uint32_t));
+}
+
+void parentCv(const uint32_t key[8], const uint32_t left[8], const uint32_t right[8],
+              uint32_t out[8]) {
+    uint8_t block[64];
+    for (int i = 0; i < 8; i++) {
+        for (int k = 0; k < 4; k++) {
+            block[4 * i + k] = static_cast<uint8_t>(left[i] >> (8 * k));
+            block[32 + 4 * i + k] = static_cast<uint8_t>(right[i] >> (8 * k));
+        }
+    }
+    std::memcpy(out, key, 8 * sizeof(uint32_t));
+    compressInPlace(out, block, 64, 0, PARENT);
+}
+
+void hashChunk(const uint32_t key[8], const uint8_t* chunk, uint64_t counter, uint32_t out[8]) {
+    std::memcpy(out, key, 8 * sizeof(uint32_t));
+    size_t blocks = Blake3Hasher::CHUNK_LEN / Blake3Hasher::BLOCK_LEN;
+    for (size_t b = 0; b < blocks; b++) {
+        uint32_t flags = (b == 0 ? CHUNK_START : 0) | (b + 1 == blocks ? CHUNK_END : 0);
+        compressInPlace(out, chunk + b * Blake3Hasher::BLOCK_LEN, Blake3Hasher::BLOCK_LEN,
+                        counter, flags);
+    }
+}
+
+#if defined(__SSE2__)
+
+inline __m128i rot16(__m128i x) {
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xB1), 0xB1);
+}
+
+inline __m128i rot12(__m128i x) {
+    return _mm_or_si128(_mm_srli_epi32(x, 12), _mm_slli_epi32(x, 20));
+}
+
+inline __m128i rot8(__m128i x) {
+    return _mm_or_si128(_mm_srli_epi32(x, 8), _mm_slli_epi32(x, 24));
+}
+
+inline __m128i rot7(__m128i x) {
+    return _mm_or_si128(_mm_srli_epi32(x, 7), _mm_slli_epi32(x, 25));
+}
+
+inline void g4(__m128i* v, int a, int b, int c, int d, __m128i x, __m128i y) {
+    v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), x);
+    v[d] = rot16(_mm_xor_si128(v[d], v[a]));
+    v[c] = _mm_add_epi32(v[c], v[d]);
+    v[b] = rot12(_mm_xor_si128(v[b], v[c]));
+    v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), y);
+    v[d] = rot8(_mm_xor_si128(v[d], v[a]));
+    v[c] = _mm_add_epi32(v[c], v[d]);
+    v[b] = rot7(_mm_xor_si128(v[b], v[c]));
+}
+
+inline void transpose(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3) {
+    __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+    __m128i t1 = _mm_unpackhi_epi32(r0, r1);
+    __m128i t2 = _mm_unpacklo_epi32(r2, r3);
+    __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+    r0 = _mm_unpacklo_epi64(t0, t2);
+    r1 = _mm_unpackhi_epi64(t0, t2);
+    r2 = _mm_unpacklo_epi64(t1, t3);
+    r3 = _mm_unpackhi_epi64(t1, t3);
+}
+
+// Four consecutive whole chunks, one per lane: word i of every lane's
+// state sits in one register, so each instruction advances all four.
+void hashChunks4(const uint32_t key[8], const uint8_t* chunks, uint64_t counter,
+                 uint32_t out[LANES][8]) {
+    __m128i h[8];
+    for (int i = 0; i < 8; i++) {
+        h[i] = _mm_set1_epi32(static_cast<int>(key[i]));
+    }
+    __m128i counterLow = _mm_set_epi32(static_cast<int>(counter + 3), static_cast<int>(counter + 2),
+                                       static_cast<int>(counter + 1), static_cast<int>(counter));
+    __m128i counterHigh = _mm_set_epi32(static_cast<int>((counter + 3) >> 32),
+                                        static_cast<int>((counter + 2) >> 32),
+                                        static_cast<int>((counter + 1) >> 32),
+                                        static_cast<int>(counter >> 32));
+    
+    size_t blocks = Blake3Hasher::CHUNK_LEN / Blake3Hasher::BLOCK_LEN;
+    for (size_t b = 0; b < blocks; b++) {
+        __m128i m[16];
+        for (int q = 0; q < 4; q++) {
+            const uint8_t* at = chunks + b * Blake3Hasher::BLOCK_LEN + 16 * q;
+            for (size_t lane = 0; lane < LANES; lane++) {
+                m[4 * q + lane] = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(at + lane * Blake3Hasher::CHUNK_LEN));
+            }
+            transpose(m[4 * q], m[4 * q + 1], m[4 * q + 2], m[4 * q + 3]);
+        }
+        
+        uint32_t flags = (b == 0 ? CHUNK_START : 0) | (b + 1 == blocks ? CHUNK_END : 0);
+        __m128i v[16] = {
+            h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7],
+            _mm_set1_epi32(static_cast<int>(IV[0])), _mm_set1_epi32(static_cast<int>(IV[1])),
+            _mm_set1_epi32(static_cast<int>(IV[2])), _mm_set1_epi32(static_cast<int>(IV[3])),
+            counterLow, counterHigh,
+            _mm_set1_epi32(static_cast<int>(Blake3Hasher::BLOCK_LEN)),
+            _mm_set1_epi32(static_cast<int>(flags))
+        };
+        for (const uint8_t* s : SCHEDULE) {
+            g4(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+            g4(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+            g4(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+            g4(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+            g4(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+            g4(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+            g4(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+            g4(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+        }
+        for (int i = 0; i < 8; i++) {
+            h[i] = _mm_xor_si128(v[i], v[i + 8]);
+        }
+    }
+    
+    transpose(h[0], h[1], h[2], h[3]);
+    transpose(h[4], h[5], h[6], h[7]);
+    for (size_t lane = 0; lane < LANES; lane++) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out[lane]), h[lane]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out[lane] + 4), h[lane + 4]);
+    }
+}
+
+#endif
+
+}
+
+Blake3Hasher::Blake3Hasher() {
+    std::memcpy(key, IV, sizeof(key));
+    reset();
+}
+
+void Blake3Hasher::reset() {
+    chunkCounter = 0;
+    stackSize = 0;
+    resetChunk();
+}
+
+void Blake3Hasher::resetChunk() {
+    std::memcpy(chunkCv, key, sizeof(chunkCv));
+    blockLen = 0;
+    blocksCompressed = 0;
+}
+
+// A full block is only compressed once more input arrives, as the last
+// block of the chunk needs CHUNK_END and possibly ROOT.
+void Blake3Hasher::updateChunk(const uint8_t* data, size_t length) {
+    while (length > 0) {
+        if (blockLen == BLOCK_LEN) {
+            compressInPlace(chunkCv, block, BLOCK_LEN, chunkCounter,
+                            blocksCompressed == 0 ? CHUNK_START : 0);
+            blocksCompressed++;
+            blockLen = 0;
+        }
+        size_t take = std::min(BLOCK_LEN - blockLen, length);
+        std::memcpy(block + blockLen, data, take);
+        blockLen += take;
+        data += take;
+        length -= take;
+    }
+}
+
+// Merges completed subtrees: two of the same size become their parent,
+// which the number of chunks so far tells apart by its trailing zeros.
+void Blake3Hasher::addChunkCv(const uint32_t cv[8], uint64_t totalChunks) {
+    uint32_t merged[8];
+    std::memcpy(merged, cv, sizeof(merged));
+    while ((totalChunks & 1) == 0) {
+        stackSize--;
+        parentCv(key, stack[stackSize], merged, merged);
+        totalChunks >>= 1;
+    }
+    std::memcpy(stack[stackSize], merged, sizeof(merged));
+    stackSize++;
+}
+
+void Blake3Hasher::compressChunks(const uint8_t* data, size_t count) {
+    uint32_t cvs[LANES][8];
+    size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + LANES <= count; i += LANES) {
+        hashChunks4(key, data + i * CHUNK_LEN, chunkCounter, cvs);
+        for (size_t lane = 0; lane < LANES; lane++) {
+            chunkCounter++;
+            addChunkCv(cvs[lane], chunkCounter);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        hashChunk(key, data + i * CHUNK_LEN, chunkCounter, cvs[0]);
+        chunkCounter++;
+        addChunkCv(cvs[0], chunkCounter);
+    }
+}
+
+void Blake3Hasher::update(const void* data, size_t length) {
+    VV_COUNT(BYTES_HASHED, length);
+    const uint8_t* input = static_cast<const uint8_t*>(data);
+    
+    while (length > 0) {
+        if (chunkLength() == CHUNK_LEN) {
+            uint32_t cv[8];
+            std::memcpy(cv, chunkCv, sizeof(cv));
+            compressInPlace(cv, block, BLOCK_LEN, chunkCounter, CHUNK_END);
+            chunkCounter++;
+            addChunkCv(cv, chunkCounter);
+            resetChunk();
+        }
+        
+        // Whole chunks go straight to the kernel, keeping back at least
+        // one byte so the final chunk is always finished by finish().
+        if (chunkLength() == 0 && length > CHUNK_LEN) {
+            size_t count = (length - 1) / CHUNK_LEN;
+            compressChunks(input, count);
+            input += count * CHUNK_LEN;
+            length -= count * CHUNK_LEN;
+            continue;
+        }
+        
+        size_t take = std::min(CHUNK_LEN - chunkLength(), length);
+        updateChunk(input, take);
+        input += take;
+        length -= take;
+    }
+}
+
+ObjectId Blake3Hasher::finish() {
+    // The output node: the current chunk's last block, or each parent up
+    // the stack in turn, with ROOT set on whichever ends up on top.
+    uint32_t cv[8];
+    uint8_t last[BLOCK_LEN];
+    std::memcpy(cv, chunkCv, sizeof(cv));
+    std::memset(last, 0, sizeof(last));
+    std::memcpy(last, block, blockLen);
+    uint32_t lastLen = static_cast<uint32_t>(blockLen);
+    uint64_t counter = chunkCounter;
+    uint32_t flags = CHUNK_END | (blocksCompressed == 0 ? CHUNK_START : 0);
+    
+    for (size_t i = stackSize; i > 0; i--) {
+        uint32_t right[8];
+        std::memcpy(right, cv, sizeof(right));
+        compressInPlace(right, last, lastLen, counter, flags);
+        for (int w = 0; w < 8; w++) {
+            for (int k = 0; k < 4; k++) {
+                last[4 * w + k] = static_cast<uint8_t>(stack[i - 1][w] >> (8 * k));
+                last[32 + 4 * w + k] = static_cast<uint8_t>(right[w] >> (8 * k));
+            }
+        }
+        std::memcpy(cv, key, sizeof(cv));
+        lastLen = BLOCK_LEN;
+        counter = 0;
+        flags = PARENT;
+    }
+    
+    uint32_t out[16];
+    compress(cv, last, lastLen, 0, flags | ROOT, out);
+    
+    ObjectId result;
+    uint8_t* digest = result.data();
+    for (int w = 0; w < 8; w++) {
+        for (int k = 0; k < 4; k++) {
+            digest[4 * w + k] = static_cast<uint8_t>(out[w] >> (8 * k));
+        }
+    }
+    reset();
+    return result;
+}
@@ -0,0 +1,115 @@
+#include "Chunker.h"
+#include <algorithm>
+
+namespace {
+
+struct GearTable {
+    uint64_t plain[256];
+    uint64_t shifted[256];
+    
+    GearTable() {
+        uint64_t state = 0x56455253494f4e56ULL;
+        for (int i = 0; i < 256; i++) {
+            state += 0x9e3779b97f4a7c15ULL;
+            uint64_t x = state;
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+            plain[i] = x ^ (x >> 31);
+            shifted[i] = plain[i] << 1;
+        }
+    }
+};
+
+const GearTable& gear() {
+    static const GearTable table;
+    return table;
+}
+
+// Bit k of a Gear hash depends on the last k + 1 bytes, so the mask sits
+// in the high bits. Bit 63 is left out so the mask can be shifted for the
+// two-bytes-per-step loop.
+uint64_t highMask(int bits) {
+    return ((1ULL << bits) - 1) << (63 - bits);
+}
+
+}
+
+Chunker::Chunker(size_t average) {
+    int bits = 8;
+    while ((static_cast<size_t>(1) << bits) < average && bits < 30) {
+        bits++;
+    }
+    
+    averageSize = static_cast<size_t>(1) << bits;
+    minSize = averageSize / 4;
+    maxSize = averageSize * 4;
+    maskSmall = highMask(bits + 2);
+    maskLarge = highMask(bits - 2);
+}
+
+size_t Chunker::nextBoundary(const char* data, size_t length) const {
+    if (length <= minSize) {
+        return length;
+    }
+    
+    const GearTable& table = gear();
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    size_t limit = std::min(length, maxSize);
+    size_t normal = std::min(limit, averageSize);
+    uint64_t hash = 0;
+    size_t i = minSize;
+    
+    // FastCDC's rolled form: shifting by two and adding the pre-shifted
+    // entry is the same as two single steps, with the first step checked
+    // against the mask shifted to match.
+    uint64_t shiftedMask = maskSmall << 1;
+    for (; i + 1 < normal; i += 2) {
+        hash = (hash << 2) + table.shifted[bytes[i]];
+        if ((hash & shiftedMask) == 0) {
+            return i + 1;
+        }
+        hash += table.plain[bytes[i + 1]];
+        if ((hash & maskSmall) == 0) {
+            return i + 2;
+        }
+    }
+    for (; i < normal; i++) {
+        hash = (hash << 1) + table.plain[bytes[i]];
+        if ((hash & maskSmall) == 0) {
+            return i + 1;
+        }
+    }
+    
+    shiftedMask = maskLarge << 1;
+    for (; i + 1 < limit; i += 2) {
+        hash = (hash << 2) + table.shifted[bytes[i]];
+        if ((hash & shiftedMask) == 0) {
+            return i + 1;
+        }
+        hash += table.plain[bytes[i + 1]];
+        if ((hash & maskLarge) == 0) {
+            return i + 2;
+        }
+    }
+    for (; i < limit; i++) {
+        hash = (hash << 1) + table.plain[bytes[i]];
+        if ((hash & maskLarge) == 0) {
+            return i + 1;
+        }
+    }
+    
+    return limit;
+}
+
+std::vector<std::pair<size_t, size_t>> Chunker::split(const ContentView& content) const {
+    std::vector<std::pair<size_t, size_t>> chunks;
+    chunks.reserve(content.size() / averageSize + 1);
+    
+    size_t offset = 0;
+    while (offset < content.size()) {
+        size_t length = nextBoundary(content.data() + offset, content.size() - offset);
+        chunks.push_back({offset, length});
+        offset += length;
+    }
+    return chunks;
+}
@@ -0,0 +1,39 @@
+#ifndef CHUNKER_H
+#define CHUNKER_H
+
+#include "ContentView.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Content-defined chunking after FastCDC: a Gear rolling hash picks cut
+// points from the bytes themselves, so an edit only moves the boundaries
+// next to it and every other chunk keeps its id. Normalised chunking uses
+// a stricter mask before the average size and a looser one after it to
+// keep chunk sizes close to the target.
+class Chunker {
+private:
+    size_t minSize;
+    size_t averageSize;
+    size_t maxSize;
+    uint64_t maskSmall;
+    uint64_t maskLarge;
+    
+public:
+    static const size_t DEFAULT_AVERAGE = 64 * 1024;
+    
+    explicit Chunker(size_t average = DEFAULT_AVERAGE);
+    
+    // Length of the chunk starting at data; at most maxSize and never
+    // less than minSize unless the input is shorter.
+    size_t nextBoundary(const char* data, size_t length) const;
+    
+    // Offset and length of each chunk covering content, in order.
+    std::vector<std::pair<size_t, size_t>> split(const ContentView& content) const;
+    
+    size_t getMinSize() const { return minSize; }
+    size_t getAverageSize() const { return averageSize; }
+    size_t getMaxSize() const { return maxSize; }
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "ContentView.h"
+#include "Metrics.h"
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ContentView ContentView::fromBuffer(std::vector<char> buffer) {
+    auto shared = std::make_shared<std::vector<char>>(std::move(buffer));
+    return ContentView(shared->data(), shared->size(), shared);
+}
+
+ContentView ContentView::mapFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file: " + path);
+    }
+    VV_COUNT(FILE_OPENS, 1);
+    
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Cannot stat file: " + path);
+    }
+    
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size == 0) {
+        ::close(fd);
+        return ContentView();
+    }
+    
+    // Small files are cheaper to read than to map, and would otherwise
+    // cost a whole page and a VMA each.
+    if (size < MAP_THRESHOLD) {
+        std::vector<char> buffer(size);
+        size_t total = 0;
+        while (total < size) {
+            ssize_t n = ::read(fd, buffer.data() + total, size - total);
+            if (n < 0) {
+                ::close(fd);
+                throw std::runtime_error("Cannot read file: " + path);
+            }
+            if (n == 0) {
+                break;
+            }
+            total += n;
+        }
+        ::close(fd);
+        buffer.resize(total);
+        VV_COUNT(BYTES_READ, total);
+        return fromBuffer(std::move(buffer));
+    }
+    
+    void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::runtime_error("Cannot map file: " + path);
+    }
+    ::madvise(addr, size, MADV_SEQUENTIAL);
+    VV_COUNT(FILE_MAPS, 1);
+    VV_COUNT(BYTES_READ, size);
+    
+    std::shared_ptr<const void> mapping(addr, [size](const void* p) {
+        ::munmap(const_cast<void*>(p), size);
+    });
+    return ContentView(static_cast<const char*>(addr), size, mapping, true);
+}
+
+ContentView ContentView::retain() const {
+    if (isOwned()) {
+        return *this;
+    }
+    return fromBuffer(toVector());
+}
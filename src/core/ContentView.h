@@ -0,0 +1,46 @@
+#ifndef CONTENTVIEW_H
+#define CONTENTVIEW_H
+
+#include <string>
+#include <vector>
+#include <memory>
+
+class ContentView {
+private:
+    const char* ptr;
+    size_t length;
+    std::shared_ptr<const void> owner;
+    bool mapped;
+    
+public:
+    static const size_t MAP_THRESHOLD = 64 * 1024;
+    
+    ContentView() : ptr(nullptr), length(0), mapped(false) {}
+    ContentView(const char* data, size_t size, std::shared_ptr<const void> keepAlive = nullptr,
+                bool isMapping = false)
+        : ptr(data), length(size), owner(std::move(keepAlive)), mapped(isMapping) {}
+    explicit ContentView(const std::vector<char>& buffer)
+        : ptr(buffer.data()), length(buffer.size()), mapped(false) {}
+    
+    static ContentView fromBuffer(std::vector<char> buffer);
+    static ContentView mapFile(const std::string& path);
+    
+    const char* data() const { return ptr; }
+    size_t size() const { return length; }
+    bool empty() const { return length == 0; }
+    const char* begin() const { return ptr; }
+    const char* end() const { return ptr + length; }
+    char operator[](size_t i) const { return ptr[i]; }
+    
+    bool isMapped() const { return mapped; }
+    bool isOwned() const { return owner != nullptr || length == 0; }
+    
+    ContentView retain() const;
+    // A view of part of this one, sharing its owner.
+    ContentView slice(size_t offset, size_t size) const {
+        return ContentView(ptr + offset, size, owner, mapped);
+    }
+    std::vector<char> toVector() const { return std::vector<char>(begin(), end()); }
+};
+
+#endif
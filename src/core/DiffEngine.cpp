@@ -1,9 +1,219 @@
 #include "DiffEngine.h"
+#include "Arena.h"
+#include "DiffFormatter.h"
+#include "DiffInternal.h"
+#include "Metrics.h"
+#include "StreamingDiff.h"
 #include <algorithm>
 #include <cmath>
 
+namespace {
+
+// Bytes of interner table per input line: a hash node plus its bucket.
+const size_t INTERNER_BYTES_PER_LINE = 64;
+
+// Lines are built in place, so a pmr listing hands each one its own
+// allocator and std::string listings just grow as usual.
+template<typename Listing>
+void appendPrefixed(Listing& listing, char marker, std::string_view line) {
+    listing.emplace_back();
+    auto& text = listing.back();
+    text.reserve(line.size() + 1);
+    text += marker;
+    text.append(line.data(), line.size());
+}
+
+template<typename Listing>
+void writeListing(Listing& listing, const std::vector<std::string_view>& oldLines,
+                  const std::vector<std::string_view>& newLines, const std::vector<Edit>& edits) {
+    listing.reserve(oldLines.size() + newLines.size() + 2);
+    listing.emplace_back("--- old");
+    listing.emplace_back("+++ new");
+    
+    for (const Edit& edit : edits) {
+        for (int k = 0; k < edit.length; k++) {
+            switch (edit.type) {
+                case EditType::EQUAL:
+                    appendPrefixed(listing, ' ', oldLines[edit.oldStart + k]);
+                    break;
+                case EditType::DELETE:
+                    appendPrefixed(listing, '-', oldLines[edit.oldStart + k]);
+                    break;
+                case EditType::INSERT:
+                    appendPrefixed(listing, '+', newLines[edit.newStart + k]);
+                    break;
+            }
+        }
+    }
+}
+
+typedef uint64_t Word;
+const int WORD_BITS = 64;
+
+// Match masks for the shorter string, one bit per character, split into
+// 64-row blocks. Only symbols that occur in the pattern get a row; every
+// other byte shares the all-zero row 0.
+struct BitPattern {
+    int length;
+    int blocks;
+    unsigned char symbolRow[256];
+    std::vector<Word> peq;
+    
+    explicit BitPattern(std::string_view pattern)
+        : length(static_cast<int>(pattern.size())),
+          blocks((static_cast<int>(pattern.size()) + WORD_BITS - 1) / WORD_BITS) {
+        std::fill(std::begin(symbolRow), std::end(symbolRow), 0);
+        int rows = 1;
+        for (unsigned char c : pattern) {
+            if (symbolRow[c] == 0) {
+                symbolRow[c] = static_cast<unsigned char>(rows++);
+            }
+        }
+        
+        peq.assign(static_cast<size_t>(rows) * blocks, 0);
+        for (int i = 0; i < length; i++) {
+            unsigned char c = static_cast<unsigned char>(pattern[i]);
+            peq[symbolRow[c] * static_cast<size_t>(blocks) + i / WORD_BITS] |=
+                Word(1) << (i % WORD_BITS);
+        }
+    }
+    
+    const Word* row(unsigned char c) const {
+        return peq.data() + symbolRow[c] * static_cast<size_t>(blocks);
+    }
+    
+    int blockEnd(int block) const {
+        return std::min((block + 1) * WORD_BITS, length);
+    }
+};
+
+// One column step of Hyyro's block formulation of Myers' bit-vector
+// algorithm. pv/mv hold the vertical +1/-1 deltas of the block, hin is the
+// horizontal delta entering at its top row; returns the delta leaving at the
+// row selected by highBit.
+inline int advanceBlock(Word& pv, Word& mv, Word eq, int hin, Word highBit) {
+    Word hinNeg = hin < 0 ? 1 : 0;
+    Word hinPos = hin > 0 ? 1 : 0;
+    
+    Word xv = eq | mv;
+    eq |= hinNeg;
+    Word xh = (((eq & pv) + pv) ^ pv) | eq;
+    Word ph = mv | ~(xh | pv);
+    Word mh = pv & xh;
+    
+    int hout = 0;
+    if (ph & highBit) {
+        hout = 1;
+    } else if (mh & highBit) {
+        hout = -1;
+    }
+    
+    ph = (ph << 1) | hinPos;
+    mh = (mh << 1) | hinNeg;
+    pv = mh | ~(xv | ph);
+    mv = ph & xv;
+    
+    return hout;
+}
+
+// Levenshtein distance in O(min(m, n) / 64) words of state. Only blocks that
+// intersect the diagonal band |i - j| <= maxDistance are advanced, and the
+// scan stops as soon as no cell in the current column can stay within the
+// bound. Returns maxDistance + 1 when the distance exceeds the bound.
+int boundedLevenshtein(std::string_view a, std::string_view b, int maxDistance) {
+    if (a.size() > b.size()) {
+        std::swap(a, b);
+    }
+    
+    int m = static_cast<int>(a.size());
+    int n = static_cast<int>(b.size());
+    
+    if (n - m > maxDistance) {
+        return maxDistance + 1;
+    }
+    if (m == 0) {
+        return n;
+    }
+    
+    BitPattern pattern(a);
+    int blocks = pattern.blocks;
+    Word lastBit = Word(1) << ((m - 1) % WORD_BITS);
+    Word highBit = Word(1) << (WORD_BITS - 1);
+    bool bounded = maxDistance < n;
+    
+    std::vector<Word> pv(blocks, ~Word(0));
+    std::vector<Word> mv(blocks, 0);
+    std::vector<int> score(blocks, 0);
+    
+    int firstBlock = 0;
+    int lastBlock = std::min(blocks - 1, maxDistance / WORD_BITS);
+    for (int blk = 0; blk <= lastBlock; blk++) {
+        score[blk] = pattern.blockEnd(blk);
+    }
+    
+    for (int j = 0; j < n; j++) {
+        int column = j + 1;
+        
+        int bandEnd = std::min(blocks - 1, (column + maxDistance - 1) / WORD_BITS);
+        while (lastBlock < bandEnd) {
+            lastBlock++;
+            pv[lastBlock] = ~Word(0);
+            mv[lastBlock] = 0;
+            score[lastBlock] = score[lastBlock - 1] +
+                pattern.blockEnd(lastBlock) - pattern.blockEnd(lastBlock - 1);
+        }
+        while (firstBlock < lastBlock && pattern.blockEnd(firstBlock) < column - maxDistance) {
+            firstBlock++;
+        }
+        
+        const Word* eq = pattern.row(static_cast<unsigned char>(b[j]));
+        int hin = 1;
+        for (int blk = firstBlock; blk <= lastBlock; blk++) {
+            hin = advanceBlock(pv[blk], mv[blk], eq[blk], hin,
+                               blk == blocks - 1 ? lastBit : highBit);
+            score[blk] += hin;
+        }
+        
+        if (bounded) {
+            // A cell (r, column) can still reach (m, n) for no less than its own
+            // value plus the distance from its diagonal to the final one.
+            int target = column + m - n;
+            bool reachable = firstBlock == 0 && column + std::abs(target) <= maxDistance;
+            for (int blk = firstBlock; blk <= lastBlock && !reachable; blk++) {
+                int top = blk * WORD_BITS + 1;
+                int bottom = pattern.blockEnd(blk);
+                int gap = target < top ? top - target : (target > bottom ? target - bottom : 0);
+                reachable = score[blk] - (bottom - top) + gap <= maxDistance;
+            }
+            if (!reachable) {
+                return maxDistance + 1;
+            }
+        }
+    }
+    
+    return std::min(score[blocks - 1], maxDistance + 1);
+}
+
+// The largest distance at which a pair whose longer side is longest bytes
+// still scores at least threshold. The floor of the product can land one
+// below the true bound (10.999... for 11), so it is corrected with the
+// same arithmetic the similarity itself is computed with.
+int similarityBound(double threshold, int longest) {
+    int bound = static_cast<int>(std::floor((1.0 - threshold) * longest));
+    bound = std::max(0, std::min(bound, longest));
+    while (bound < longest && 1.0 - static_cast<double>(bound + 1) / longest >= threshold) {
+        bound++;
+    }
+    while (bound > 0 && 1.0 - static_cast<double>(bound) / longest < threshold) {
+        bound--;
+    }
+    return bound;
+}
+
+}
+
 DiffEngine::DiffEngine() 
-    : algorithm(new SimpleDiff()), showContext(true), contextLines(3) {
+    : algorithm(new AdaptiveDiff()), showContext(true), contextLines(3), maxEditCost(0) {
 }
 
 DiffEngine::~DiffEngine() {
@@ -15,6 +225,14 @@ void DiffEngine::setAlgorithm(DiffAlgorithm* algo) {
         delete algorithm;
     }
     algorithm = algo;
+    if (algorithm && maxEditCost > 0) {
+        algorithm->setMaxCost(maxEditCost);
+    }
+}
+
+void DiffEngine::setMaxEditCost(int cost) {
+    maxEditCost = std::max(cost, 0);
+    algorithm->setMaxCost(maxEditCost);
 }
 
 Change DiffEngine::compareFiles(FileObject* oldFile, FileObject* newFile) {
@@ -23,15 +241,15 @@ Change DiffEngine::compareFiles(FileObject* oldFile, FileObject* newFile) {
     }
     
     if (oldFile == nullptr) {
-        return Change(ChangeType::ADDED, newFile->getPath(), "", newFile->getHash());
+        return Change(ChangeType::ADDED, newFile->getPath(), ObjectId(), newFile->getId());
     }
     
     if (newFile == nullptr) {
-        return Change(ChangeType::REMOVED, oldFile->getPath(), oldFile->getHash(), "");
+        return Change(ChangeType::REMOVED, oldFile->getPath(), oldFile->getId(), ObjectId());
     }
     
-    std::string oldHash = oldFile->getHash();
-    std::string newHash = newFile->getHash();
+    const ObjectId& oldHash = oldFile->getId();
+    const ObjectId& newHash = newFile->getId();
     
     if (oldHash == newHash) {
         return Change(ChangeType::UNCHANGED, oldFile->getPath(), oldHash, newHash);
@@ -40,96 +258,480 @@ Change DiffEngine::compareFiles(FileObject* oldFile, FileObject* newFile) {
     return Change(ChangeType::MODIFIED, oldFile->getPath(), oldHash, newHash);
 }
 
-std::vector<std::string> DiffEngine::generateUnifiedDiff(TextFile* oldFile, TextFile* newFile) {
+std::vector<Edit> DiffEngine::computeEdits(TextFile* oldFile, TextFile* newFile) {
     if (!oldFile || !newFile) {
         return {};
     }
     
-    auto oldLines = oldFile->getLines();
-    auto newLines = newFile->getLines();
+    return algorithm->computeEdits(oldFile->getLineViews(), newFile->getLineViews());
+}
+
+std::vector<Hunk> DiffEngine::computeHunks(TextFile* oldFile, TextFile* newFile) {
+    return hunksOf(computeEdits(oldFile, newFile));
+}
+
+std::vector<Hunk> DiffEngine::hunksOf(const std::vector<Edit>& edits) const {
+    return UnifiedDiffFormatter::buildHunks(edits, getContextLines());
+}
+
+void DiffEngine::writeUnifiedDiff(TextFile* oldFile, TextFile* newFile, DiffSink& sink) {
+    if (!oldFile || !newFile) {
+        return;
+    }
     
-    return algorithm->computeDiff(oldLines, newLines);
+    std::vector<std::string_view> oldLines = oldFile->getLineViews();
+    std::vector<std::string_view> newLines = newFile->getLineViews();
+    formatEdits(oldLines, newLines, algorithm->computeEdits(oldLines, newLines), sink);
+}
+
+void DiffEngine::formatEdits(const std::vector<std::string_view>& oldLines,
+                             const std::vector<std::string_view>& newLines,
+                             const std::vector<Edit>& edits, DiffSink& sink) const {
+    UnifiedDiffFormatter(getContextLines()).format(oldLines, newLines, edits, sink);
 }
 
-double DiffEngine::calculateSimilarity(const std::string& text1, const std::string& text2) {
+bool DiffEngine::writeStreamingDiff(const std::string& oldPath, const std::string& newPath,
+                                    DiffSink& sink) {
+    StreamingDiff streaming(*algorithm, UnifiedDiffFormatter(getContextLines()));
+    return streaming.diffFiles(oldPath, newPath, sink);
+}
+
+std::vector<std::string> DiffEngine::generateUnifiedDiff(TextFile* oldFile, TextFile* newFile) {
+    std::string text;
+    StringSink sink(text);
+    writeUnifiedDiff(oldFile, newFile, sink);
+    
+    std::vector<std::string> result;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        result.emplace_back(text, start, end - start);
+        start = end + 1;
+    }
+    return result;
+}
+
+int DiffEngine::editDistance(std::string_view text1, std::string_view text2, int maxDistance) {
+    int longest = static_cast<int>(std::max(text1.size(), text2.size()));
+    if (maxDistance < 0 || maxDistance > longest) {
+        maxDistance = longest;
+    }
+    
+    // Start with a narrow band and widen it until the distance fits, so the
+    // cost tracks the actual distance rather than the requested bound.
+    int lengthGap = static_cast<int>(text1.size() > text2.size() ?
+        text1.size() - text2.size() : text2.size() - text1.size());
+    int band = std::min(maxDistance, std::max(WORD_BITS, 2 * lengthGap));
+    
+    while (true) {
+        int distance = boundedLevenshtein(text1, text2, band);
+        if (distance <= band || band == maxDistance) {
+            return distance;
+        }
+        band = std::min(maxDistance, band * 2);
+    }
+}
+
+double DiffEngine::calculateSimilarity(std::string_view text1, std::string_view text2,
+                                       double threshold) {
     int m = text1.length();
     int n = text2.length();
     
     if (m == 0 && n == 0) return 1.0;
     if (m == 0 || n == 0) return 0.0;
     
-    std::vector<std::vector<int>> dp(m + 1, std::vector<int>(n + 1, 0));
-    
-    for (int i = 0; i <= m; i++) dp[i][0] = i;
-    for (int j = 0; j <= n; j++) dp[0][j] = j;
-    
-    for (int i = 1; i <= m; i++) {
-        for (int j = 1; j <= n; j++) {
-            if (text1[i-1] == text2[j-1]) {
-                dp[i][j] = dp[i-1][j-1];
-            } else {
-                dp[i][j] = 1 + std::min({dp[i-1][j], dp[i][j-1], dp[i-1][j-1]});
-            }
-        }
+    int maxLen = std::max(m, n);
+    int maxDistance = maxLen;
+    if (threshold > 0.0) {
+        maxDistance = similarityBound(threshold, maxLen);
     }
     
-    int distance = dp[m][n];
-    int maxLen = std::max(m, n);
+    int distance = editDistance(text1, text2, maxDistance);
+    if (distance > maxDistance) {
+        // Only known to be past the bound: report what the bound proves,
+        // kept strictly under the threshold.
+        return std::min(1.0 - static_cast<double>(maxDistance + 1) / maxLen,
+                        std::nextafter(threshold, 0.0));
+    }
     
     return 1.0 - (static_cast<double>(distance) / maxLen);
 }
 
 bool DiffEngine::areFilesSimilar(TextFile* file1, TextFile* file2, double threshold) {
-    auto lines1 = file1->getLines();
-    auto lines2 = file2->getLines();
-    
-    std::string text1, text2;
-    for (const auto& line : lines1) text1 += line + "\n";
-    for (const auto& line : lines2) text2 += line + "\n";
-    
-    return calculateSimilarity(text1, text2) >= threshold;
+    return calculateSimilarity(file1->getText(), file2->getText(), threshold) >= threshold;
+}
+
+uint32_t LineInterner::intern(std::string_view line) {
+    auto result = ids.emplace(line, static_cast<uint32_t>(ids.size()));
+    return result.first->second;
 }
 
-std::vector<std::string> SimpleDiff::computeDiff(
+std::vector<uint32_t> LineInterner::intern(const std::vector<std::string>& lines) {
+    std::vector<uint32_t> result;
+    result.reserve(lines.size());
+    for (const auto& line : lines) {
+        result.push_back(intern(line));
+    }
+    return result;
+}
+
+std::vector<uint32_t> LineInterner::intern(const std::vector<std::string_view>& lines) {
+    std::vector<uint32_t> result;
+    result.reserve(lines.size());
+    for (std::string_view line : lines) {
+        result.push_back(intern(line));
+    }
+    return result;
+}
+
+std::vector<std::string> DiffAlgorithm::computeDiff(
     const std::vector<std::string>& oldLines,
     const std::vector<std::string>& newLines) {
     
+    return computeDiff(std::vector<std::string_view>(oldLines.begin(), oldLines.end()),
+                       std::vector<std::string_view>(newLines.begin(), newLines.end()));
+}
+
+void DiffAlgorithm::appendEdit(std::vector<Edit>& edits, EditType type,
+                               int oldStart, int newStart, int length) {
+    if (length <= 0) {
+        return;
+    }
+    if (!edits.empty() && edits.back().type == type) {
+        edits.back().length += length;
+        return;
+    }
+    edits.push_back({type, oldStart, newStart, length});
+}
+
+std::vector<Edit> DiffAlgorithm::computeEdits(
+    const std::vector<std::string_view>& oldLines,
+    const std::vector<std::string_view>& newLines) {
+    
+    VV_TIME(DIFF);
+    
+    std::vector<uint32_t> oldIds;
+    std::vector<uint32_t> newIds;
+    internLines(oldLines, newLines, oldIds, newIds);
+    
+    return editScript(oldLines, newLines, oldIds, newIds);
+}
+
+void DiffAlgorithm::internLines(const std::vector<std::string_view>& oldLines,
+                                const std::vector<std::string_view>& newLines,
+                                std::vector<uint32_t>& oldIds, std::vector<uint32_t>& newIds) {
+    // Both sides share one table so equal lines map to equal IDs and the
+    // algorithms only ever compare integers. The table holds views into the
+    // input lines, so it must not outlive this call, and its nodes come
+    // from a scratch arena rather than one allocation per distinct line.
+    Arena scratch(std::max<size_t>(1024, (oldLines.size() + newLines.size()) * INTERNER_BYTES_PER_LINE));
+    LineInterner interner(scratch.resource());
+    interner.reserve(oldLines.size() + newLines.size());
+    
+    oldIds = interner.intern(oldLines);
+    newIds = interner.intern(newLines);
+}
+
+std::vector<std::string> DiffAlgorithm::computeDiff(
+    const std::vector<std::string_view>& oldLines,
+    const std::vector<std::string_view>& newLines) {
+    
     std::vector<std::string> result;
+    writeListing(result, oldLines, newLines, computeEdits(oldLines, newLines));
+    return result;
+}
+
+std::pmr::vector<std::pmr::string> DiffAlgorithm::computeDiff(
+    const std::vector<std::string_view>& oldLines,
+    const std::vector<std::string_view>& newLines,
+    std::pmr::memory_resource* memory) {
     
-    result.push_back("--- old");
-    result.push_back("+++ new");
+    std::pmr::vector<std::pmr::string> result(memory);
+    writeListing(result, oldLines, newLines, computeEdits(oldLines, newLines));
+    return result;
+}
+
+std::vector<Edit> SimpleDiff::editScript(
+    const std::vector<std::string_view>& oldLines,
+    const std::vector<std::string_view>& newLines,
+    const std::vector<uint32_t>& oldIds,
+    const std::vector<uint32_t>& newIds) {
     
-    size_t i = 0, j = 0;
+    VV_TIME(DIFF_SIMPLE);
+    VV_COUNT(LINES_DIFFED, oldLines.size() + newLines.size());
+    std::vector<Edit> edits;
+    int i = 0, j = 0;
+    int oldSize = static_cast<int>(oldLines.size());
+    int newSize = static_cast<int>(newLines.size());
     
-    while (i < oldLines.size() || j < newLines.size()) {
-        if (i < oldLines.size() && j < newLines.size() && oldLines[i] == newLines[j]) {
-            result.push_back(" " + oldLines[i]);
+    while (i < oldSize || j < newSize) {
+        if (i < oldSize && j < newSize && oldIds[i] == newIds[j]) {
+            appendEdit(edits, EditType::EQUAL, i, j, 1);
             i++;
             j++;
-        } else if (j >= newLines.size() || (i < oldLines.size() && oldLines[i] < newLines[j])) {
-            result.push_back("-" + oldLines[i]);
+        } else if (j >= newSize || (i < oldSize && oldLines[i] < newLines[j])) {
+            appendEdit(edits, EditType::DELETE, i, j, 1);
             i++;
         } else {
-            result.push_back("+" + newLines[j]);
+            appendEdit(edits, EditType::INSERT, i, j, 1);
             j++;
         }
     }
     
-    return result;
+    return edits;
 }
 
-std::vector<MyersDiff::Snake> MyersDiff::findSnakes(
-    const std::vector<std::string>& a,
-    const std::vector<std::string>& b) {
+bool MyersDiff::split(
+    const uint32_t* a, int aLo, int aHi,
+    const uint32_t* b, int bLo, int bHi,
+    std::vector<int>& forward, std::vector<int>& backward,
+    int& splitX, int& splitY) {
+    
+    int n = aHi - aLo;
+    int m = bHi - bLo;
+    
+    // Search forward from the top-left and backward from the bottom-right
+    // until the two D-paths overlap; the overlap splits the edit graph into
+    // two independent halves, which keeps memory linear in n + m.
+    // The searches never leave the diagonals within limit of their start,
+    // so a capped search only clears that much of each array.
+    int maxD = (n + m + 1) / 2;
+    int limit = maxCost > 0 ? std::min(maxD, maxCost) : maxD;
+    int offset = limit + 1;
+    int vLength = 2 * limit + 3;
+    
+    if (static_cast<int>(forward.size()) < vLength) {
+        forward.resize(vLength);
+        backward.resize(vLength);
+    }
+    std::fill(forward.begin(), forward.begin() + vLength, -1);
+    std::fill(backward.begin(), backward.begin() + vLength, -1);
+    forward[offset + 1] = 0;
+    backward[offset + 1] = 0;
+    
+    int delta = n - m;
+    bool front = (delta % 2 != 0);
+    int k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+    splitX = -1;
+    splitY = -1;
+    
+    for (int d = 0; d <= limit && splitX < 0; d++) {
+        for (int k1 = -d + k1start; k1 <= d - k1end; k1 += 2) {
+            int k1Offset = offset + k1;
+            int x1;
+            if (k1 == -d || (k1 != d && forward[k1Offset - 1] < forward[k1Offset + 1])) {
+                x1 = forward[k1Offset + 1];
+            } else {
+                x1 = forward[k1Offset - 1] + 1;
+            }
+            int y1 = x1 - k1;
+            while (x1 < n && y1 < m && a[aLo + x1] == b[bLo + y1]) {
+                x1++;
+                y1++;
+            }
+            forward[k1Offset] = x1;
+            
+            if (x1 > n) {
+                k1end += 2;
+            } else if (y1 > m) {
+                k1start += 2;
+            } else if (front) {
+                int k2Offset = offset + delta - k1;
+                if (k2Offset >= 0 && k2Offset < vLength && backward[k2Offset] != -1) {
+                    if (x1 >= n - backward[k2Offset]) {
+                        splitX = x1;
+                        splitY = y1;
+                        break;
+                    }
+                }
+            }
+        }
+        if (splitX >= 0) {
+            break;
+        }
+        
+        for (int k2 = -d + k2start; k2 <= d - k2end; k2 += 2) {
+            int k2Offset = offset + k2;
+            int x2;
+            if (k2 == -d || (k2 != d && backward[k2Offset - 1] < backward[k2Offset + 1])) {
+                x2 = backward[k2Offset + 1];
+            } else {
+                x2 = backward[k2Offset - 1] + 1;
+            }
+            int y2 = x2 - k2;
+            while (x2 < n && y2 < m && a[aHi - x2 - 1] == b[bHi - y2 - 1]) {
+                x2++;
+                y2++;
+            }
+            backward[k2Offset] = x2;
+            
+            if (x2 > n) {
+                k2end += 2;
+            } else if (y2 > m) {
+                k2start += 2;
+            } else if (!front) {
+                int k1Offset = offset + delta - k2;
+                if (k1Offset >= 0 && k1Offset < vLength && forward[k1Offset] != -1) {
+                    int x1 = forward[k1Offset];
+                    int y1 = x1 - (k1Offset - offset);
+                    if (x1 >= n - x2) {
+                        splitX = x1;
+                        splitY = y1;
+                        break;
+                    }
+                }
+            }
+        }
+    }
     
+    if (splitX < 0) {
+        // Over the cost cap: split at the furthest point the forward
+        // search reached, as xdiff does, and give up on minimality.
+        int best = 0;
+        for (int k = -limit; k <= limit; k++) {
+            int x = forward[offset + k];
+            int y = x - k;
+            if (x >= 0 && x <= n && y >= 0 && y <= m && x + y < n + m && x + y > best) {
+                best = x + y;
+                splitX = x;
+                splitY = y;
+            }
+        }
+    }
+    
+    return splitX >= 0;
+}
+
+void MyersDiff::appendEdits(const uint32_t* a, int aLo, int aHi,
+                            const uint32_t* b, int bLo, int bHi,
+                            std::vector<Edit>& edits) {
+    // Only the matching runs are collected; the lines between two runs are
+    // emitted as one delete and one insert, however the region was split.
     std::vector<Snake> snakes;
-    return snakes;
+    std::vector<int> forward;
+    std::vector<int> backward;
+    std::vector<DiffRegion> pending;
+    pending.push_back({aLo, aHi, bLo, bHi, false});
+    
+    while (!pending.empty()) {
+        DiffRegion region = pending.back();
+        pending.pop_back();
+        if (region.equal) {
+            snakes.push_back({region.aLo, region.bLo, region.aHi - region.aLo});
+            continue;
+        }
+        
+        int lo = region.aLo, hi = region.aHi;
+        int newLo = region.bLo, newHi = region.bHi;
+        
+        int prefix = 0;
+        while (lo + prefix < hi && newLo + prefix < newHi && a[lo + prefix] == b[newLo + prefix]) {
+            prefix++;
+        }
+        if (prefix > 0) {
+            snakes.push_back({lo, newLo, prefix});
+            lo += prefix;
+            newLo += prefix;
+        }
+        
+        int suffix = 0;
+        while (hi - suffix > lo && newHi - suffix > newLo &&
+               a[hi - suffix - 1] == b[newHi - suffix - 1]) {
+            suffix++;
+        }
+        hi -= suffix;
+        newHi -= suffix;
+        if (suffix > 0) {
+            pending.push_back({hi, hi + suffix, newHi, newHi + suffix, true});
+        }
+        
+        int splitX, splitY;
+        if (lo < hi && newLo < newHi &&
+            split(a, lo, hi, b, newLo, newHi, forward, backward, splitX, splitY)) {
+            pending.push_back({lo + splitX, hi, newLo + splitY, newHi, false});
+            pending.push_back({lo, lo + splitX, newLo, newLo + splitY, false});
+        }
+    }
+    
+    int i = aLo, j = bLo;
+    for (const auto& snake : snakes) {
+        appendEdit(edits, EditType::DELETE, i, j, snake.x - i);
+        i = snake.x;
+        appendEdit(edits, EditType::INSERT, i, j, snake.y - j);
+        j = snake.y;
+        appendEdit(edits, EditType::EQUAL, i, j, snake.length);
+        i += snake.length;
+        j += snake.length;
+    }
+    
+    appendEdit(edits, EditType::DELETE, i, j, aHi - i);
+    appendEdit(edits, EditType::INSERT, aHi, j, bHi - j);
 }
 
-std::vector<std::string> MyersDiff::computeDiff(
-    const std::vector<std::string>& oldLines,
-    const std::vector<std::string>& newLines) {
+std::vector<Edit> MyersDiff::editScript(
+    const std::vector<std::string_view>& oldLines,
+    const std::vector<std::string_view>& newLines,
+    const std::vector<uint32_t>& oldIds,
+    const std::vector<uint32_t>& newIds) {
+    
+    VV_TIME(DIFF_MYERS);
+    VV_COUNT(LINES_DIFFED, oldLines.size() + newLines.size());
+    std::vector<Edit> edits;
+    appendEdits(oldIds.data(), 0, static_cast<int>(oldLines.size()),
+                newIds.data(), 0, static_cast<int>(newLines.size()), edits);
+    return edits;
+}
+
+AdaptiveDiff::Choice AdaptiveDiff::choose(const std::vector<uint32_t>& oldIds,
+                                          const std::vector<uint32_t>& newIds,
+                                          uint32_t universe) {
+    if (oldIds.size() + newIds.size() <= SMALL_INPUT || oldIds.empty() || newIds.empty()) {
+        return Choice::MYERS;
+    }
+    
+    // Saturating per-side counts; only "once" versus "more" matters.
+    std::vector<uint8_t> oldCount(universe, 0);
+    std::vector<uint8_t> newCount(universe, 0);
+    for (uint32_t id : oldIds) {
+        oldCount[id] = static_cast<uint8_t>(std::min(oldCount[id] + 1, 2));
+    }
+    for (uint32_t id : newIds) {
+        newCount[id] = static_cast<uint8_t>(std::min(newCount[id] + 1, 2));
+    }
+    
+    size_t unique = 0;
+    for (uint32_t id : oldIds) {
+        if (oldCount[id] == 1 && newCount[id] == 1) {
+            unique++;
+        }
+    }
     
-    SimpleDiff simpleDiff;
-    return simpleDiff.computeDiff(oldLines, newLines);
+    if (2 * unique >= std::min(oldIds.size(), newIds.size())) {
+        return Choice::PATIENCE;
+    }
+    return Choice::HISTOGRAM;
+}
+
+void AdaptiveDiff::setMaxCost(int cost) {
+    DiffAlgorithm::setMaxCost(cost);
+    myers.setMaxCost(cost);
+    patience.setMaxCost(cost);
+    histogram.setMaxCost(cost);
+}
+
+std::vector<Edit> AdaptiveDiff::editScript(
+    const std::vector<std::string_view>& oldLines,
+    const std::vector<std::string_view>& newLines,
+    const std::vector<uint32_t>& oldIds,
+    const std::vector<uint32_t>& newIds) {
+    
+    uint32_t universe = idUniverse(oldIds, newIds);
+    switch (choose(oldIds, newIds, universe)) {
+        case Choice::PATIENCE:
+            return patience.editScript(oldLines, newLines, oldIds, newIds, universe);
+        case Choice::HISTOGRAM:
+            return histogram.editScript(oldLines, newLines, oldIds, newIds, universe);
+        default:
+            return myers.editScript(oldLines, newLines, oldIds, newIds);
+    }
 }
@@ -2,62 +2,275 @@
 #define DIFFENGINE_H
 
 #include "FileObject.h"
+#include "Metrics.h"
 #include <vector>
 #include <string>
+#include <string_view>
+#include <memory_resource>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
 
 enum class ChangeType {
     ADDED,
     REMOVED,
     MODIFIED,
-    UNCHANGED
+    UNCHANGED,
+    RENAMED,
+    COPIED
 };
 
 struct Change {
     ChangeType type;
     std::string path;
-    std::string oldHash;
-    std::string newHash;
+    std::string oldPath;
+    ObjectId oldHash;
+    ObjectId newHash;
+    double similarity;
     
     Change(ChangeType t, const std::string& p) 
-        : type(t), path(p) {}
+        : type(t), path(p), similarity(0.0) {}
     
-    Change(ChangeType t, const std::string& p, const std::string& oh, const std::string& nh)
-        : type(t), path(p), oldHash(oh), newHash(nh) {}
+    Change(ChangeType t, const std::string& p, const ObjectId& oh, const ObjectId& nh)
+        : type(t), path(p), oldHash(oh), newHash(nh), similarity(0.0) {}
+    
+    Change(ChangeType t, const std::string& op, const std::string& p,
+           const ObjectId& oh, const ObjectId& nh, double s)
+        : type(t), path(p), oldPath(op), oldHash(oh), newHash(nh), similarity(s) {}
+};
+
+enum class EditType {
+    EQUAL,
+    DELETE,
+    INSERT
+};
+
+// One run of an edit script: length lines at oldStart in the old file and
+// newStart in the new one (both 0-based). DELETE runs only cover old lines
+// and INSERT runs only new ones.
+struct Edit {
+    EditType type;
+    int oldStart;
+    int newStart;
+    int length;
+};
+
+struct Hunk {
+    int oldStart;
+    int oldCount;
+    int newStart;
+    int newCount;
+    std::vector<Edit> edits;
+};
+
+class DiffSink;
+
+class LineInterner {
+private:
+    std::pmr::unordered_map<std::string_view, uint32_t> ids;
+    
+public:
+    explicit LineInterner(std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : ids(memory) {}
+    
+    uint32_t intern(std::string_view line);
+    std::vector<uint32_t> intern(const std::vector<std::string>& lines);
+    std::vector<uint32_t> intern(const std::vector<std::string_view>& lines);
+    
+    void reserve(size_t count) { ids.reserve(count); }
+    void clear() { ids.clear(); }
+    size_t size() const { return ids.size(); }
 };
 
 class DiffAlgorithm {
+protected:
+    int maxCost;
+    
+    // Extends the last run when it has the same type, so scripts built a
+    // line or a range at a time stay in canonical form.
+    static void appendEdit(std::vector<Edit>& edits, EditType type,
+                           int oldStart, int newStart, int length);
+    
+    // The algorithms below are final and make their override public, so
+    // callers that know the type can call it without going through the
+    // vtable (see DiffEngine's templated entry points).
+    virtual std::vector<Edit> editScript(
+        const std::vector<std::string_view>& oldLines,
+        const std::vector<std::string_view>& newLines,
+        const std::vector<uint32_t>& oldIds,
+        const std::vector<uint32_t>& newIds
+    ) = 0;
+    
 public:
+    DiffAlgorithm() : maxCost(0) {}
     virtual ~DiffAlgorithm() = default;
-    virtual std::vector<std::string> computeDiff(
+    
+    // Caps the number of edits searched for in each region before settling
+    // for a non-minimal script, bounding the cost on inputs with little in
+    // common. Zero searches without limit.
+    virtual void setMaxCost(int cost) { maxCost = std::max(cost, 0); }
+    int getMaxCost() const { return maxCost; }
+    
+    // Adjacent runs never share a type, and each side's runs cover its
+    // lines in order.
+    std::vector<Edit> computeEdits(
+        const std::vector<std::string_view>& oldLines,
+        const std::vector<std::string_view>& newLines
+    );
+    
+    // Interns both sides with one table, as computeEdits() does before
+    // running the algorithm, so equal lines get equal ids.
+    static void internLines(const std::vector<std::string_view>& oldLines,
+                            const std::vector<std::string_view>& newLines,
+                            std::vector<uint32_t>& oldIds, std::vector<uint32_t>& newIds);
+    
+    // For callers that interned both sides with one LineInterner.
+    std::vector<Edit> computeEdits(
+        const std::vector<std::string_view>& oldLines,
+        const std::vector<std::string_view>& newLines,
+        const std::vector<uint32_t>& oldIds,
+        const std::vector<uint32_t>& newIds
+    ) {
+        return editScript(oldLines, newLines, oldIds, newIds);
+    }
+    
+    // Every line of both files, prefixed with ' ', '-' or '+'.
+    std::vector<std::string> computeDiff(
+        const std::vector<std::string_view>& oldLines,
+        const std::vector<std::string_view>& newLines
+    );
+    std::vector<std::string> computeDiff(
         const std::vector<std::string>& oldLines,
         const std::vector<std::string>& newLines
-    ) = 0;
+    );
+    // The same listing with the vector and every line allocated from
+    // memory, typically an Arena scoped to the caller's operation.
+    std::pmr::vector<std::pmr::string> computeDiff(
+        const std::vector<std::string_view>& oldLines,
+        const std::vector<std::string_view>& newLines,
+        std::pmr::memory_resource* memory
+    );
 };
 
-class MyersDiff : public DiffAlgorithm {
+class MyersDiff final : public DiffAlgorithm {
 private:
     struct Snake {
         int x, y, length;
     };
     
-    std::vector<Snake> findSnakes(
-        const std::vector<std::string>& a,
-        const std::vector<std::string>& b
+    // Finds where to split a[aLo, aHi) against b[bLo, bHi), two non-empty
+    // ranges with no common prefix or suffix: the middle of a minimal script
+    // or, over the cost cap, the furthest point the forward search reached.
+    // The split is relative to aLo and bLo.
+    bool split(
+        const uint32_t* a, int aLo, int aHi,
+        const uint32_t* b, int bLo, int bHi,
+        std::vector<int>& forward, std::vector<int>& backward,
+        int& splitX, int& splitY
     );
     
 public:
-    std::vector<std::string> computeDiff(
-        const std::vector<std::string>& oldLines,
-        const std::vector<std::string>& newLines
+    std::vector<Edit> editScript(
+        const std::vector<std::string_view>& oldLines,
+        const std::vector<std::string_view>& newLines,
+        const std::vector<uint32_t>& oldIds,
+        const std::vector<uint32_t>& newIds
     ) override;
+    
+    // Appends the edits turning a[aLo, aHi) into b[bLo, bHi).
+    void appendEdits(const uint32_t* a, int aLo, int aHi,
+                     const uint32_t* b, int bLo, int bHi,
+                     std::vector<Edit>& edits);
 };
 
-class SimpleDiff : public DiffAlgorithm {
+class SimpleDiff final : public DiffAlgorithm {
 public:
-    std::vector<std::string> computeDiff(
-        const std::vector<std::string>& oldLines,
-        const std::vector<std::string>& newLines
+    std::vector<Edit> editScript(
+        const std::vector<std::string_view>& oldLines,
+        const std::vector<std::string_view>& newLines,
+        const std::vector<uint32_t>& oldIds,
+        const std::vector<uint32_t>& newIds
+    ) override;
+};
+
+// Matches the lines that occur exactly once on both sides, keeps the
+// longest run of them that appears in the same order and diffs the gaps
+// between them the same way, using Myers where no unique lines are left.
+class PatienceDiff final : public DiffAlgorithm {
+public:
+    std::vector<Edit> editScript(
+        const std::vector<std::string_view>& oldLines,
+        const std::vector<std::string_view>& newLines,
+        const std::vector<uint32_t>& oldIds,
+        const std::vector<uint32_t>& newIds
+    ) override;
+    
+    // For callers that already know idUniverse() of the two sides.
+    std::vector<Edit> editScript(
+        const std::vector<std::string_view>& oldLines,
+        const std::vector<std::string_view>& newLines,
+        const std::vector<uint32_t>& oldIds,
+        const std::vector<uint32_t>& newIds,
+        uint32_t universe
+    );
+};
+
+// JGit's extension of patience diff: splits each region at the longest
+// common run whose rarest line occurs least often in the old side, so
+// repeated lines can still anchor a match. Regions where every common line
+// occurs more than MAX_CHAIN times fall back to Myers.
+class HistogramDiff final : public DiffAlgorithm {
+public:
+    std::vector<Edit> editScript(
+        const std::vector<std::string_view>& oldLines,
+        const std::vector<std::string_view>& newLines,
+        const std::vector<uint32_t>& oldIds,
+        const std::vector<uint32_t>& newIds
+    ) override;
+    
+    // For callers that already know idUniverse() of the two sides.
+    std::vector<Edit> editScript(
+        const std::vector<std::string_view>& oldLines,
+        const std::vector<std::string_view>& newLines,
+        const std::vector<uint32_t>& oldIds,
+        const std::vector<uint32_t>& newIds,
+        uint32_t universe
+    );
+    
+    static const int MAX_CHAIN = 64;
+};
+
+// Picks an algorithm per input: Myers for small inputs, where its minimal
+// script is cheap, patience when most lines are unique and histogram when
+// repeated lines such as braces and blank lines dominate.
+class AdaptiveDiff final : public DiffAlgorithm {
+private:
+    MyersDiff myers;
+    PatienceDiff patience;
+    HistogramDiff histogram;
+    
+public:
+    std::vector<Edit> editScript(
+        const std::vector<std::string_view>& oldLines,
+        const std::vector<std::string_view>& newLines,
+        const std::vector<uint32_t>& oldIds,
+        const std::vector<uint32_t>& newIds
     ) override;
+    
+    static const size_t SMALL_INPUT = 256;
+    
+    enum class Choice {
+        MYERS,
+        PATIENCE,
+        HISTOGRAM
+    };
+    
+    // universe is idUniverse() of the two sides.
+    static Choice choose(const std::vector<uint32_t>& oldIds, const std::vector<uint32_t>& newIds,
+                         uint32_t universe);
+    
+    void setMaxCost(int cost) override;
 };
 
 class DiffEngine {
@@ -65,19 +278,94 @@ private:
     DiffAlgorithm* algorithm;
     bool showContext;
     int contextLines;
+    int maxEditCost;
     
+    template<typename Algo>
+    std::vector<Edit> editsWith(const std::vector<std::string_view>& oldLines,
+                                const std::vector<std::string_view>& newLines) const;
+    std::vector<Hunk> hunksOf(const std::vector<Edit>& edits) const;
+    void formatEdits(const std::vector<std::string_view>& oldLines,
+                     const std::vector<std::string_view>& newLines,
+                     const std::vector<Edit>& edits, DiffSink& sink) const;
+                     
 public:
     DiffEngine();
     ~DiffEngine();
     
     void setAlgorithm(DiffAlgorithm* algo);
     void setContextLines(int lines) { contextLines = lines; }
+    void setShowContext(bool show) { showContext = show; }
+    void setMaxEditCost(int cost);
+    int getContextLines() const { return showContext ? std::max(contextLines, 0) : 0; }
     
     Change compareFiles(FileObject* oldFile, FileObject* newFile);
+    
+    std::vector<Edit> computeEdits(TextFile* oldFile, TextFile* newFile);
+    std::vector<Hunk> computeHunks(TextFile* oldFile, TextFile* newFile);
+    void writeUnifiedDiff(TextFile* oldFile, TextFile* newFile, DiffSink& sink);
+    // The same diff of two files on disk in bounded memory, for files too
+    // large to load (see StreamingDiff). False when they have no changes.
+    bool writeStreamingDiff(const std::string& oldPath, const std::string& newPath, DiffSink& sink);
     std::vector<std::string> generateUnifiedDiff(TextFile* oldFile, TextFile* newFile);
     
-    double calculateSimilarity(const std::string& text1, const std::string& text2);
+    // The same with the algorithm fixed at compile time, for pipelines that
+    // diff many pairs with one algorithm: Algo is one of the final
+    // algorithms above, made per call with this engine's edit cost, and its
+    // script is called directly rather than through the vtable.
+    template<typename Algo>
+    std::vector<Edit> computeEdits(TextFile* oldFile, TextFile* newFile) const;
+    template<typename Algo>
+    std::vector<Hunk> computeHunks(TextFile* oldFile, TextFile* newFile) const;
+    template<typename Algo>
+    void writeUnifiedDiff(TextFile* oldFile, TextFile* newFile, DiffSink& sink) const;
+    
+    int editDistance(std::string_view text1, std::string_view text2, int maxDistance = -1);
+    // 1 - distance / longer length. A positive threshold bounds the work:
+    // pairs that cannot reach it score somewhere strictly below it.
+    double calculateSimilarity(std::string_view text1, std::string_view text2,
+                               double threshold = 0.0);
     bool areFilesSimilar(TextFile* file1, TextFile* file2, double threshold = 0.6);
 };
 
+template<typename Algo>
+std::vector<Edit> DiffEngine::editsWith(const std::vector<std::string_view>& oldLines,
+                                        const std::vector<std::string_view>& newLines) const {
+    static_assert(std::is_base_of<DiffAlgorithm, Algo>::value && std::is_final<Algo>::value,
+                  "Algo must be a final DiffAlgorithm");
+    VV_TIME(DIFF);
+    
+    std::vector<uint32_t> oldIds;
+    std::vector<uint32_t> newIds;
+    DiffAlgorithm::internLines(oldLines, newLines, oldIds, newIds);
+    
+    Algo algo;
+    algo.setMaxCost(maxEditCost);
+    return algo.editScript(oldLines, newLines, oldIds, newIds);
+}
+
+template<typename Algo>
+std::vector<Edit> DiffEngine::computeEdits(TextFile* oldFile, TextFile* newFile) const {
+    if (!oldFile || !newFile) {
+        return {};
+    }
+    
+    return editsWith<Algo>(oldFile->getLineViews(), newFile->getLineViews());
+}
+
+template<typename Algo>
+std::vector<Hunk> DiffEngine::computeHunks(TextFile* oldFile, TextFile* newFile) const {
+    return hunksOf(computeEdits<Algo>(oldFile, newFile));
+}
+
+template<typename Algo>
+void DiffEngine::writeUnifiedDiff(TextFile* oldFile, TextFile* newFile, DiffSink& sink) const {
+    if (!oldFile || !newFile) {
+        return;
+    }
+    
+    std::vector<std::string_view> oldLines = oldFile->getLineViews();
+    std::vector<std::string_view> newLines = newFile->getLineViews();
+    formatEdits(oldLines, newLines, editsWith<Algo>(oldLines, newLines), sink);
+}
+
 #endif
@@ -0,0 +1,132 @@
+#include "DiffFormatter.h"
+#include <algorithm>
+
+namespace {
+
+void writeLines(DiffSink& sink, char marker, const std::vector<std::string_view>& lines,
+                int start, int length) {
+    for (int k = 0; k < length; k++) {
+        std::string_view line = lines[start + k];
+        sink.write(&marker, 1);
+        sink.write(line);
+        sink.write("\n", 1);
+    }
+}
+
+void writeRange(DiffSink& sink, int64_t start, int64_t count) {
+    std::string range = std::to_string(count == 0 ? start : start + 1);
+    if (count != 1) {
+        range += ',';
+        range += std::to_string(count);
+    }
+    sink.write(range);
+}
+
+}
+
+UnifiedDiffFormatter::UnifiedDiffFormatter(int contextLines, const std::string& oldName,
+                                           const std::string& newName)
+    : context(std::max(contextLines, 0)), oldLabel(oldName), newLabel(newName) {
+}
+
+void UnifiedDiffFormatter::forEachHunk(const std::vector<Edit>& edits, int context,
+                                       const std::function<void(const Hunk&)>& visit) {
+    size_t n = edits.size();
+    size_t i = 0;
+    
+    while (i < n) {
+        if (edits[i].type == EditType::EQUAL) {
+            i++;
+            continue;
+        }
+        
+        Hunk hunk;
+        if (i > 0 && edits[i - 1].type == EditType::EQUAL) {
+            const Edit& before = edits[i - 1];
+            int lead = std::min(context, before.length);
+            if (lead > 0) {
+                hunk.edits.push_back({EditType::EQUAL, before.oldStart + before.length - lead,
+                                      before.newStart + before.length - lead, lead});
+            }
+        }
+        
+        // An unchanged run short enough that the context on both sides would
+        // touch joins the two changes into one hunk.
+        for (; i < n; i++) {
+            const Edit& edit = edits[i];
+            if (edit.type != EditType::EQUAL || (i + 1 < n && edit.length <= 2 * context)) {
+                hunk.edits.push_back(edit);
+                continue;
+            }
+            int trail = std::min(context, edit.length);
+            if (trail > 0) {
+                hunk.edits.push_back({EditType::EQUAL, edit.oldStart, edit.newStart, trail});
+            }
+            break;
+        }
+        
+        hunk.oldStart = hunk.edits.front().oldStart;
+        hunk.newStart = hunk.edits.front().newStart;
+        hunk.oldCount = 0;
+        hunk.newCount = 0;
+        for (const Edit& edit : hunk.edits) {
+            if (edit.type != EditType::INSERT) {
+                hunk.oldCount += edit.length;
+            }
+            if (edit.type != EditType::DELETE) {
+                hunk.newCount += edit.length;
+            }
+        }
+        visit(hunk);
+    }
+}
+
+std::vector<Hunk> UnifiedDiffFormatter::buildHunks(const std::vector<Edit>& edits, int context) {
+    std::vector<Hunk> hunks;
+    forEachHunk(edits, std::max(context, 0), [&hunks](const Hunk& hunk) {
+        hunks.push_back(hunk);
+    });
+    return hunks;
+}
+
+void UnifiedDiffFormatter::writeHeader(DiffSink& sink) const {
+    sink.write("--- " + oldLabel + "\n+++ " + newLabel + "\n");
+}
+
+void UnifiedDiffFormatter::writeHunkHeader(DiffSink& sink, int64_t oldStart, int64_t oldCount,
+                                           int64_t newStart, int64_t newCount) {
+    sink.write("@@ -");
+    writeRange(sink, oldStart, oldCount);
+    sink.write(" +");
+    writeRange(sink, newStart, newCount);
+    sink.write(" @@\n");
+}
+
+void UnifiedDiffFormatter::format(const std::vector<std::string_view>& oldLines,
+                                  const std::vector<std::string_view>& newLines,
+                                  const std::vector<Edit>& edits, DiffSink& sink) const {
+    bool started = false;
+    
+    forEachHunk(edits, context, [&](const Hunk& hunk) {
+        if (!started) {
+            writeHeader(sink);
+            started = true;
+        }
+        
+        writeHunkHeader(sink, hunk.oldStart, hunk.oldCount, hunk.newStart, hunk.newCount);
+        
+        for (const Edit& edit : hunk.edits) {
+            switch (edit.type) {
+                case EditType::EQUAL:
+                    writeLines(sink, ' ', oldLines, edit.oldStart, edit.length);
+                    break;
+                case EditType::DELETE:
+                    writeLines(sink, '-', oldLines, edit.oldStart, edit.length);
+                    break;
+                case EditType::INSERT:
+                    writeLines(sink, '+', newLines, edit.newStart, edit.length);
+                    break;
+            }
+        }
+    });
+}
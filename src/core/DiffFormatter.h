@@ -0,0 +1,75 @@
+#ifndef DIFFFORMATTER_H
+#define DIFFFORMATTER_H
+
+#include "DiffEngine.h"
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class DiffSink {
+public:
+    virtual ~DiffSink() = default;
+    virtual void write(const char* data, size_t size) = 0;
+    
+    void write(std::string_view text) { write(text.data(), text.size()); }
+};
+
+class StreamSink : public DiffSink {
+private:
+    std::ostream& out;
+    
+public:
+    explicit StreamSink(std::ostream& stream) : out(stream) {}
+    void write(const char* data, size_t size) override { out.write(data, size); }
+    using DiffSink::write;
+};
+
+class StringSink : public DiffSink {
+private:
+    std::string& out;
+    
+public:
+    explicit StringSink(std::string& target) : out(target) {}
+    void write(const char* data, size_t size) override { out.append(data, size); }
+    using DiffSink::write;
+};
+
+// Writes an edit script as a unified diff, one hunk at a time, so the
+// memory used beyond the input lines is bounded by the largest hunk.
+// Headers follow GNU diff: line numbers are 1-based, a count of one is
+// omitted and an empty range names the line before it.
+class UnifiedDiffFormatter {
+private:
+    int context;
+    std::string oldLabel;
+    std::string newLabel;
+    
+public:
+    explicit UnifiedDiffFormatter(int contextLines = 3,
+                                  const std::string& oldName = "old",
+                                  const std::string& newName = "new");
+    
+    int getContext() const { return context; }
+    
+    // The pieces of format(), for writers that find their hunks some other
+    // way. The header goes out once, before the first hunk.
+    void writeHeader(DiffSink& sink) const;
+    static void writeHunkHeader(DiffSink& sink, int64_t oldStart, int64_t oldCount,
+                                int64_t newStart, int64_t newCount);
+    
+    // Writes nothing when the script has no changes.
+    void format(const std::vector<std::string_view>& oldLines,
+                const std::vector<std::string_view>& newLines,
+                const std::vector<Edit>& edits, DiffSink& sink) const;
+    
+    // Groups changes whose context would overlap into hunks, visiting each
+    // as soon as it is complete.
+    static void forEachHunk(const std::vector<Edit>& edits, int context,
+                            const std::function<void(const Hunk&)>& visit);
+    static std::vector<Hunk> buildHunks(const std::vector<Edit>& edits, int context);
+};
+
+#endif
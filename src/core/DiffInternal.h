@@ -0,0 +1,31 @@
+#ifndef DIFFINTERNAL_H
+#define DIFFINTERNAL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Pieces shared by the diff algorithms; not part of vv_core's interface.
+
+// A region still to be diffed or, when equal is set, a run of matching
+// lines to emit. Regions are kept on a stack in reverse output order, so
+// deep recursion on long files cannot overflow the call stack.
+struct DiffRegion {
+    int aLo, aHi, bLo, bHi;
+    bool equal;
+};
+
+// One past the largest interned id on either side, the size of the
+// per-line tables the algorithms index by id.
+inline uint32_t idUniverse(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+    uint32_t universe = 0;
+    for (uint32_t id : a) {
+        universe = std::max(universe, id + 1);
+    }
+    for (uint32_t id : b) {
+        universe = std::max(universe, id + 1);
+    }
+    return universe;
+}
+
+#endif
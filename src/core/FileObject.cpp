@@ -1,24 +1,233 @@
 #include "FileObject.h"
-#include <openssl/sha.h>
+#include "Metrics.h"
+#include "StatCache.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
 #include <sstream>
-#include <iomanip>
 #include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+std::atomic<StatCache*> activeStatCache(nullptr);
+std::atomic<HashAlgorithm> activeAlgorithm(HashAlgorithm::SHA256);
+
+// Ids in a stat cache are only good for the algorithm they were made with.
+StatCache* statCacheFor(HashAlgorithm algorithm) {
+    StatCache* cache = activeStatCache.load(std::memory_order_acquire);
+    return cache != nullptr && cache->getAlgorithm() == algorithm ? cache : nullptr;
+}
+
+const char* const BINARY_EXTENSIONS[] = {
+    "png", "jpg", "jpeg", "gif", "bmp", "ico", "webp", "tif", "tiff", "psd",
+    "zip", "gz", "tgz", "bz2", "xz", "zst", "7z", "rar", "jar", "war",
+    "pdf", "exe", "dll", "so", "dylib", "o", "a", "lib", "class", "pyc",
+    "mp3", "mp4", "mov", "avi", "mkv", "wav", "flac", "ogg", "ttf", "otf", "woff", "woff2"
+};
+
+const char* const TEXT_EXTENSIONS[] = {
+    "txt", "md", "c", "h", "cc", "cpp", "hpp", "java", "py", "js", "ts", "json",
+    "xml", "html", "css", "sh", "yml", "yaml", "ini", "cfg", "csv", "sql", "tex"
+};
+
+// Where FileFactory puts the objects it creates.
+struct HeapObjects {
+    template<typename T, typename... Args>
+    std::unique_ptr<FileObject> make(Args&&... args) {
+        return std::make_unique<T>(std::forward<Args>(args)...);
+    }
+};
+
+struct ArenaObjects {
+    Arena& arena;
+    
+    template<typename T, typename... Args>
+    Arena::Ptr<FileObject> make(Args&&... args) {
+        return arena.make<T>(std::forward<Args>(args)...);
+    }
+};
+
+struct ValueObjects {
+    template<typename T, typename... Args>
+    FileValue make(Args&&... args) {
+        return FileValue(std::in_place_type<T>, std::forward<Args>(args)...);
+    }
+};
+
+std::string extensionOf(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return "";
+    }
+    
+    std::string extension = path.substr(dot + 1);
+    for (char& c : extension) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return extension;
+}
+
+}
 
 FileObject::FileObject(const std::string& path) 
-    : filepath(path), fileSize(0), isModified(false) {
+    : filepath(path), hasId(false), fileSize(0), isModified(false), readStarted(0),
+      hasReadStat(false), classified(false) {
+}
+
+void FileObject::statBeforeReading() {
+    hasReadStat = statCacheFor(getHashAlgorithm()) != nullptr && FileStat::read(filepath, readStat);
+    readStarted = hasReadStat ? FileStat::now() : 0;
+}
+
+// Only for objects that have not read the file yet: anything they hash
+// is read after this stat.
+bool FileObject::lookupCachedId(StatCache* cache) {
+    statBeforeReading();
+    ObjectType type;
+    if (!hasReadStat || !cache->lookup(filepath, readStat, id, type)) {
+        return false;
+    }
+    
+    fileSize = static_cast<long>(readStat.size);
+    hasId = true;
+    isModified = false;
+    return true;
+}
+
+void FileObject::cacheId(StatCache* cache) {
+    if (hasReadStat && !hasInMemoryEdits()) {
+        cache->update(filepath, readStat, id, classified ? getType() : ObjectType::UNKNOWN,
+                      readStarted);
+    }
+}
+
+const ObjectId& FileObject::getId() {
+    if (hasId && !isModified) {
+        return id;
+    }
+    
+    StatCache* cache = statCacheFor(getHashAlgorithm());
+    bool cacheable = cache != nullptr && !hasInMemoryEdits();
+    if (cacheable && !holdsContent() && lookupCachedId(cache)) {
+        return id;
+    }
+    
+    {
+        VV_TIME(HASH_FILE);
+        id = computeHash();
+    }
+    if (cacheable) {
+        cacheId(cache);
+    }
+    
+    hasId = true;
+    isModified = false;
+    return id;
+}
+
+void FileObject::setStatCache(StatCache* cache) {
+    activeStatCache.store(cache, std::memory_order_release);
+}
+
+StatCache* FileObject::getStatCache() {
+    return activeStatCache.load(std::memory_order_acquire);
+}
+
+void FileObject::setHashAlgorithm(HashAlgorithm algorithm) {
+    activeAlgorithm.store(algorithm, std::memory_order_release);
 }
 
-std::string FileObject::getHash() {
-    if (hash.empty() || isModified) {
-        hash = computeHash();
-        isModified = false;
+HashAlgorithm FileObject::getHashAlgorithm() {
+    return activeAlgorithm.load(std::memory_order_acquire);
+}
+
+// Objects whose content cannot be read are left for getId(), which
+// handles them as it always has.
+// File is FileObject for mixed batches, or one of the final types, in which
+// case viewContent() is called directly rather than through the vtable.
+template<typename File>
+void FileObject::computeIdsOf(const std::vector<File*>& objects) {
+    HashAlgorithm algorithm = getHashAlgorithm();
+    StatCache* cache = statCacheFor(algorithm);
+    
+    std::vector<File*> hashing;
+    std::vector<ContentView> contents;
+    for (File* obj : objects) {
+        if (obj->hasId && !obj->isModified) {
+            continue;
+        }
+        
+        FileObject* file = obj;
+        if (cache != nullptr && !file->hasInMemoryEdits() && !file->holdsContent() &&
+            file->lookupCachedId(cache)) {
+            continue;
+        }
+        
+        try {
+            contents.push_back(obj->viewContent());
+        } catch (const std::runtime_error&) {
+            continue;
+        }
+        hashing.push_back(obj);
+    }
+    
+    VV_TIME(HASH_FILE);
+    std::vector<ObjectId> ids = Hasher::hashMany(algorithm, contents);
+    for (size_t i = 0; i < hashing.size(); i++) {
+        File* obj = hashing[i];
+        obj->id = ids[i];
+        obj->hasId = true;
+        obj->isModified = false;
+        if (cache != nullptr) {
+            static_cast<FileObject*>(obj)->cacheId(cache);
+        }
     }
-    return hash;
+}
+
+void FileObject::computeIds(const std::vector<FileObject*>& objects) {
+    computeIdsOf(objects);
+}
+
+void FileObject::computeIds(std::vector<TextFile>& files) {
+    std::vector<TextFile*> objects;
+    objects.reserve(files.size());
+    for (TextFile& file : files) {
+        objects.push_back(&file);
+    }
+    computeIdsOf(objects);
+}
+
+void FileObject::computeIds(std::vector<BinaryFile>& files) {
+    std::vector<BinaryFile*> objects;
+    objects.reserve(files.size());
+    for (BinaryFile& file : files) {
+        objects.push_back(&file);
+    }
+    computeIdsOf(objects);
+}
+
+void FileObject::computeIds(std::vector<FileValue>& files) {
+    std::vector<TextFile*> texts;
+    std::vector<BinaryFile*> binaries;
+    for (FileValue& file : files) {
+        if (TextFile* text = std::get_if<TextFile>(&file)) {
+            texts.push_back(text);
+        } else {
+            binaries.push_back(&std::get<BinaryFile>(file));
+        }
+    }
+    computeIdsOf(texts);
+    computeIdsOf(binaries);
 }
 
 bool FileObject::operator==(const FileObject& other) const {
-    return const_cast<FileObject*>(this)->getHash() == 
-           const_cast<FileObject&>(other).getHash();
+    return const_cast<FileObject*>(this)->getId() == 
+           const_cast<FileObject&>(other).getId();
 }
 
 bool FileObject::operator!=(const FileObject& other) const {
@@ -26,71 +235,162 @@ bool FileObject::operator!=(const FileObject& other) const {
 }
 
 TextFile::TextFile(const std::string& path) 
-    : FileObject(path), encoding("UTF-8") {
+    : FileObject(path), loaded(false), indexed(false), encoding("UTF-8"), edited(false) {
+}
+
+TextFile::TextFile(const std::string& path, const ContentView& content) 
+    : FileObject(path), buffer(content), loaded(true), indexed(false), encoding("UTF-8"),
+      edited(false) {
+    fileSize = static_cast<long>(content.size());
 }
 
-std::string TextFile::computeHash() {
-    std::stringstream ss;
-    for (const auto& line : lines) {
-        ss << line << "\n";
+void TextFile::load() {
+    if (!loaded) {
+        statBeforeReading();
+        buffer = ContentView::mapFile(filepath);
+        fileSize = static_cast<long>(buffer.size());
+        loaded = true;
+        indexed = false;
     }
+}
+
+// Records where every line starts, plus a sentinel one past the last
+// line's newline (real or implied), so line i spans
+// [starts[i], starts[i + 1] - 1).
+void TextFile::buildIndex() {
+    load();
+    lineStarts.clear();
+    lineStarts.push_back(0);
     
-    std::string content = ss.str();
-    unsigned char digest[SHA256_DIGEST_LENGTH];
-    SHA256(reinterpret_cast<const unsigned char*>(content.c_str()), 
-           content.length(), digest);
-    
-    std::stringstream hashStream;
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        hashStream << std::hex << std::setw(2) << std::setfill('0') 
-                   << static_cast<int>(digest[i]);
+    const char* data = buffer.data();
+    size_t size = buffer.size();
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; i + 16 <= size; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+        while (mask != 0) {
+            lineStarts.push_back(i + __builtin_ctz(mask) + 1);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    while (i < size) {
+        const char* found = static_cast<const char*>(std::memchr(data + i, '\n', size - i));
+        if (found == nullptr) {
+            break;
+        }
+        i = found - data + 1;
+        lineStarts.push_back(i);
     }
     
-    return hashStream.str();
+    if (size > 0 && data[size - 1] != '\n') {
+        lineStarts.push_back(size + 1);
+    }
+    indexed = true;
 }
 
-std::vector<char> TextFile::readContent() {
-    std::ifstream file(filepath);
-    if (!file.is_open()) {
-        throw std::runtime_error("Cannot open file: " + filepath);
-    }
+ObjectId TextFile::computeHash() {
+    std::unique_ptr<Hasher> hasher = Hasher::create(getHashAlgorithm());
     
-    lines.clear();
-    std::string line;
-    while (std::getline(file, line)) {
-        lines.push_back(line);
+    if (loaded) {
+        hasher->update(buffer);
+        return hasher->finish();
     }
-    file.close();
     
-    std::stringstream ss;
-    for (const auto& l : lines) {
-        ss << l << "\n";
+    // Nothing loaded yet: stream the file instead of materialising it.
+    long bytesRead = hasher->updateFromFile(filepath);
+    if (bytesRead > 0) {
+        fileSize = bytesRead;
     }
     
-    std::string content = ss.str();
-    return std::vector<char>(content.begin(), content.end());
+    return hasher->finish();
+}
+
+std::vector<char> TextFile::readContent() {
+    load();
+    return buffer.toVector();
+}
+
+ContentView TextFile::viewContent() {
+    load();
+    return buffer;
 }
 
 void TextFile::writeContent(const std::vector<char>& data) {
-    std::ofstream file(filepath);
+    writeContent(ContentView(data));
+}
+
+void TextFile::writeContent(const ContentView& content) {
+    // Our own mapping must not be read while the file is truncated.
+    ContentView next = content.data() == buffer.data() && content.isMapped() ?
+        ContentView::fromBuffer(content.toVector()) : content.retain();
+    
+    std::ofstream file(filepath, std::ios::binary);
     if (!file.is_open()) {
         throw std::runtime_error("Cannot write to file: " + filepath);
     }
     
-    file.write(data.data(), data.size());
+    file.write(next.data(), next.size());
     file.close();
+    buffer = next;
+    fileSize = static_cast<long>(buffer.size());
+    loaded = true;
+    indexed = false;
+    edited = false;
+    hasReadStat = false;
     isModified = true;
 }
 
-std::vector<std::string> TextFile::getLines() {
-    if (lines.empty()) {
-        readContent();
+std::string_view TextFile::getText() {
+    load();
+    return std::string_view(buffer.data(), buffer.size());
+}
+
+int TextFile::getLineCount() {
+    if (!indexed) {
+        buildIndex();
+    }
+    return static_cast<int>(lineStarts.size() - 1);
+}
+
+std::string_view TextFile::getLine(size_t i) {
+    if (!indexed) {
+        buildIndex();
+    }
+    return std::string_view(buffer.data() + lineStarts[i], lineStarts[i + 1] - lineStarts[i] - 1);
+}
+
+std::vector<std::string_view> TextFile::getLineViews() {
+    if (!indexed) {
+        buildIndex();
+    }
+    
+    std::vector<std::string_view> views;
+    views.reserve(lineStarts.size() - 1);
+    for (size_t i = 0; i + 1 < lineStarts.size(); i++) {
+        views.emplace_back(buffer.data() + lineStarts[i], lineStarts[i + 1] - lineStarts[i] - 1);
     }
-    return lines;
+    return views;
+}
+
+std::vector<std::string> TextFile::getLines() {
+    std::vector<std::string_view> views = getLineViews();
+    return std::vector<std::string>(views.begin(), views.end());
 }
 
 void TextFile::setLines(const std::vector<std::string>& newLines) {
-    lines = newLines;
+    std::vector<char> joined;
+    for (const auto& line : newLines) {
+        joined.insert(joined.end(), line.begin(), line.end());
+        joined.push_back('\n');
+    }
+    
+    buffer = ContentView::fromBuffer(std::move(joined));
+    loaded = true;
+    indexed = false;
+    edited = true;
     isModified = true;
 }
 
@@ -98,21 +398,34 @@ BinaryFile::BinaryFile(const std::string& path)
     : FileObject(path) {
 }
 
-std::string BinaryFile::computeHash() {
-    unsigned char digest[SHA256_DIGEST_LENGTH];
-    SHA256(reinterpret_cast<const unsigned char*>(data.data()), 
-           data.size(), digest);
+BinaryFile::BinaryFile(const std::string& path, const ContentView& content) 
+    : FileObject(path), view(content) {
+    fileSize = static_cast<long>(content.size());
+}
+
+ObjectId BinaryFile::computeHash() {
+    std::unique_ptr<Hasher> hasher = Hasher::create(getHashAlgorithm());
     
-    std::stringstream hashStream;
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        hashStream << std::hex << std::setw(2) << std::setfill('0') 
-                   << static_cast<int>(digest[i]);
+    if (!data.empty()) {
+        hasher->update(data.data(), data.size());
+        return hasher->finish();
     }
     
-    return hashStream.str();
+    if (!view.empty()) {
+        hasher->update(view);
+        return hasher->finish();
+    }
+    
+    long bytesRead = hasher->updateFromFile(filepath);
+    if (bytesRead > 0) {
+        fileSize = bytesRead;
+    }
+    
+    return hasher->finish();
 }
 
 std::vector<char> BinaryFile::readContent() {
+    statBeforeReading();
     std::ifstream file(filepath, std::ios::binary | std::ios::ate);
     if (!file.is_open()) {
         throw std::runtime_error("Cannot open file: " + filepath);
@@ -121,6 +434,7 @@ std::vector<char> BinaryFile::readContent() {
     fileSize = file.tellg();
     file.seekg(0, std::ios::beg);
     
+    view = ContentView();
     data.resize(fileSize);
     file.read(data.data(), fileSize);
     file.close();
@@ -128,6 +442,19 @@ std::vector<char> BinaryFile::readContent() {
     return data;
 }
 
+ContentView BinaryFile::viewContent() {
+    if (!data.empty()) {
+        return ContentView(data);
+    }
+    
+    if (view.empty()) {
+        statBeforeReading();
+        view = ContentView::mapFile(filepath);
+        fileSize = view.size();
+    }
+    return view;
+}
+
 void BinaryFile::writeContent(const std::vector<char>& content) {
     std::ofstream file(filepath, std::ios::binary);
     if (!file.is_open()) {
@@ -137,14 +464,231 @@ void BinaryFile::writeContent(const std::vector<char>& content) {
     file.write(content.data(), content.size());
     file.close();
     data = content;
+    view = ContentView();
+    hasReadStat = false;
+    isModified = true;
+}
+
+void BinaryFile::writeContent(const ContentView& content) {
+    ContentView next = content.data() == view.data() && content.isMapped() ?
+        ContentView::fromBuffer(content.toVector()) : content.retain();
+    
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot write to file: " + filepath);
+    }
+    
+    file.write(next.data(), next.size());
+    file.close();
+    data.clear();
+    view = next;
+    fileSize = view.size();
+    hasReadStat = false;
     isModified = true;
 }
 
+const std::vector<char>& BinaryFile::getData() const {
+    if (data.empty() && !view.empty()) {
+        data = view.toVector();
+    }
+    return data;
+}
+
+template<typename Objects>
+auto FileFactory::open(const std::string& path, Objects objects) {
+    // The stat comes first, so whatever is read below is no older than it.
+    StatCache* cache = statCacheFor(FileObject::getHashAlgorithm());
+    FileStat stat;
+    bool statted = cache != nullptr && FileStat::read(path, stat);
+    int64_t started = statted ? FileStat::now() : 0;
+    
+    ObjectId id;
+    ObjectType type;
+    if (statted && cache->lookup(path, stat, id, type) && type != ObjectType::UNKNOWN) {
+        auto known = [&](FileObject& file) {
+            file.id = id;
+            file.hasId = true;
+            file.fileSize = static_cast<long>(stat.size);
+            file.classified = true;
+        };
+        if (type == ObjectType::BINARY) {
+            BinaryFile file(path);
+            known(file);
+            return objects.template make<BinaryFile>(std::move(file));
+        }
+        TextFile file(path);
+        known(file);
+        return objects.template make<TextFile>(std::move(file));
+    }
+    
+    ContentView content;
+    try {
+        content = ContentView::mapFile(path);
+    } catch (const std::runtime_error&) {
+        // Missing or unreadable files stay lazy text objects, as before.
+        return objects.template make<TextFile>(path);
+    }
+    
+    auto opened = [&](FileObject& file) {
+        file.readStat = stat;
+        file.readStarted = started;
+        file.hasReadStat = statted;
+        file.classified = true;
+    };
+    if (classify(path, content) == ObjectType::BINARY) {
+        BinaryFile file(path, content);
+        opened(file);
+        return objects.template make<BinaryFile>(std::move(file));
+    }
+    TextFile file(path, content);
+    opened(file);
+    return objects.template make<TextFile>(std::move(file));
+}
+
+template<typename Objects>
+auto FileFactory::open(const std::string& path, ObjectType type, Objects objects) {
+    switch (type) {
+        case ObjectType::TEXT:
+            return objects.template make<TextFile>(path);
+        case ObjectType::BINARY:
+        case ObjectType::CHUNK:
+        case ObjectType::MANIFEST:
+            return objects.template make<BinaryFile>(path);
+        default:
+            return open(path, objects);
+    }
+}
+
 std::unique_ptr<FileObject> FileFactory::createFileObject(const std::string& path) {
-    if (detectBinary(path)) {
-        return std::make_unique<BinaryFile>(path);
+    return open(path, HeapObjects());
+}
+
+std::unique_ptr<FileObject> FileFactory::createFileObject(const std::string& path, ObjectType type) {
+    return open(path, type, HeapObjects());
+}
+
+Arena::Ptr<FileObject> FileFactory::createFileObject(const std::string& path, Arena& arena) {
+    return open(path, ArenaObjects{arena});
+}
+
+Arena::Ptr<FileObject> FileFactory::createFileObject(const std::string& path, ObjectType type,
+                                                     Arena& arena) {
+    return open(path, type, ArenaObjects{arena});
+}
+
+FileValue FileFactory::createFileValue(const std::string& path) {
+    return open(path, ValueObjects());
+}
+
+FileValue FileFactory::createFileValue(const std::string& path, ObjectType type) {
+    return open(path, type, ValueObjects());
+}
+
+ObjectType FileFactory::classify(const std::string& path, const ContentView& content) {
+    VV_COUNT(FILES_CLASSIFIED, 1);
+    std::string extension = extensionOf(path);
+    if (!extension.empty()) {
+        for (const char* known : BINARY_EXTENSIONS) {
+            if (extension == known) {
+                return ObjectType::BINARY;
+            }
+        }
     }
-    return std::make_unique<TextFile>(path);
+    
+    size_t sample = std::min(content.size(), SAMPLE_SIZE);
+    if (!isBinaryContent(content.data(), sample)) {
+        return ObjectType::TEXT;
+    }
+    
+    // Sources in a legacy 8-bit encoding are not valid UTF-8, but are
+    // still text as long as they contain no NUL bytes.
+    if (!extension.empty() && std::memchr(content.data(), 0, sample) == nullptr) {
+        for (const char* known : TEXT_EXTENSIONS) {
+            if (extension == known) {
+                return ObjectType::TEXT;
+            }
+        }
+    }
+    return ObjectType::BINARY;
+}
+
+// Content is binary if it holds a NUL byte or is not valid UTF-8. Both
+// are checked in the same pass, a 16-byte block at a time while the input
+// is plain ASCII; a multi-byte sequence cut off by the end of the sample
+// is not held against it.
+bool FileFactory::isBinaryContent(const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+    
+    while (i < size) {
+#if defined(__SSE2__)
+        if (i + 16 <= size) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+            int zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_setzero_si128()));
+            int high = _mm_movemask_epi8(block);
+            if (zeros != 0) {
+                return true;
+            }
+            if (high == 0) {
+                i += 16;
+                continue;
+            }
+            i += __builtin_ctz(high);
+        }
+#else
+        if (i + 8 <= size) {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(word));
+            uint64_t zeros = (word - 0x0101010101010101ULL) & ~word & 0x8080808080808080ULL;
+            if (zeros != 0) {
+                return true;
+            }
+            if ((word & 0x8080808080808080ULL) == 0) {
+                i += 8;
+                continue;
+            }
+        }
+#endif
+
+        unsigned char lead = bytes[i];
+        if (lead == 0) {
+            return true;
+        }
+        if (lead < 0x80) {
+            i++;
+            continue;
+        }
+        
+        size_t length;
+        unsigned char low = 0x80;
+        unsigned char high = 0xbf;
+        if (lead >= 0xc2 && lead <= 0xdf) {
+            length = 2;
+        } else if (lead >= 0xe0 && lead <= 0xef) {
+            length = 3;
+            low = lead == 0xe0 ? 0xa0 : 0x80;
+            high = lead == 0xed ? 0x9f : 0xbf;
+        } else if (lead >= 0xf0 && lead <= 0xf4) {
+            length = 4;
+            low = lead == 0xf0 ? 0x90 : 0x80;
+            high = lead == 0xf4 ? 0x8f : 0xbf;
+        } else {
+            return true;
+        }
+        
+        for (size_t k = 1; k < length; k++) {
+            if (i + k >= size) {
+                return false;
+            }
+            unsigned char next = bytes[i + k];
+            if (next < (k == 1 ? low : 0x80) || next > (k == 1 ? high : 0xbf)) {
+                return true;
+            }
+        }
+        i += length;
+    }
+    
+    return false;
 }
 
 bool FileFactory::detectBinary(const std::string& path) {
@@ -153,16 +697,10 @@ bool FileFactory::detectBinary(const std::string& path) {
         return false;
     }
     
-    char buffer[512];
-    file.read(buffer, sizeof(buffer));
+    std::vector<char> buffer(SAMPLE_SIZE);
+    file.read(buffer.data(), buffer.size());
     std::streamsize bytesRead = file.gcount();
     file.close();
     
-    for (std::streamsize i = 0; i < bytesRead; i++) {
-        if (buffer[i] == 0) {
-            return true;
-        }
-    }
-    
-    return false;
+    return isBinaryContent(buffer.data(), static_cast<size_t>(bytesRead));
 }
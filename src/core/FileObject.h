@@ -2,76 +2,213 @@
 #define FILEOBJECT_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include <variant>
 #include <fstream>
+#include <cstdint>
+#include "Arena.h"
+#include "ContentView.h"
+#include "Hasher.h"
+#include "ObjectId.h"
+#include "StatCache.h"
+
+class TextFile;
+class BinaryFile;
+
+// A file object by value, for batches that would rather not allocate and
+// dispatch per file; see FileFactory::createFileValue.
+using FileValue = std::variant<TextFile, BinaryFile>;
+
+enum class ObjectType : uint8_t {
+    UNKNOWN = 0,
+    TEXT = 1,
+    BINARY = 2,
+    CHUNK = 3,
+    MANIFEST = 4
+};
 
 class FileObject {
 protected:
     std::string filepath;
-    std::string hash;
+    ObjectId id;
+    bool hasId;
     long fileSize;
     bool isModified;
     
-    virtual std::string computeHash() = 0;
+    // The file's stat data and the time, both taken just before the content
+    // the object holds (or is about to hash) was read from it. The stat
+    // cache only ever records the id under these; a stat taken after the
+    // read could describe a newer file than the content.
+    FileStat readStat;
+    int64_t readStarted;
+    bool hasReadStat;
+    // Set when FileFactory picked the type from the content, the only type
+    // worth recording in the stat cache.
+    bool classified;
+    
+    virtual ObjectId computeHash() = 0;
+    
+    // True while the object holds content that may differ from the file
+    // on disk, which rules out answering getId() from the stat cache.
+    virtual bool hasInMemoryEdits() const { return false; }
+    // False while the content would still have to be read from the file.
+    virtual bool holdsContent() const = 0;
+    
+    // Call right before reading the file; a no-op without a stat cache.
+    void statBeforeReading();
+    bool lookupCachedId(StatCache* cache);
+    void cacheId(StatCache* cache);
+    
+    // Copied and moved only as the concrete types, which FileValue holds.
+    FileObject(const FileObject&) = default;
+    FileObject(FileObject&&) = default;
+    FileObject& operator=(const FileObject&) = default;
+    FileObject& operator=(FileObject&&) = default;
+    
+    template<typename File>
+    static void computeIdsOf(const std::vector<File*>& objects);
     
 public:
     FileObject(const std::string& path);
     virtual ~FileObject() = default;
     
     virtual bool isBinary() const = 0;
+    ObjectType getType() const { return isBinary() ? ObjectType::BINARY : ObjectType::TEXT; }
     virtual std::vector<char> readContent() = 0;
+    virtual ContentView viewContent() = 0;
     virtual void writeContent(const std::vector<char>& data) = 0;
+    virtual void writeContent(const ContentView& content) = 0;
     
-    std::string getHash();
+    const ObjectId& getId();
+    std::string getHash() { return getId().toHex(); }
     std::string getPath() const { return filepath; }
     long getSize() const { return fileSize; }
     
     bool operator==(const FileObject& other) const;
     bool operator!=(const FileObject& other) const;
     
+    // Ids of files hashed straight from disk are looked up in and recorded
+    // to this cache; pass nullptr to always hash. The cache is not owned.
+    static void setStatCache(StatCache* cache);
+    static StatCache* getStatCache();
+    
+    // The algorithm every id is computed with, normally the object format
+    // of the store in use (see ObjectStore). SHA-256 by default.
+    static void setHashAlgorithm(HashAlgorithm algorithm);
+    static HashAlgorithm getHashAlgorithm();
+    
+    // getId() for a batch: ids the stat cache cannot answer are computed
+    // together through Hasher::hashMany.
+    static void computeIds(const std::vector<FileObject*>& objects);
+    // The same over values: files of one type are hashed with calls the
+    // compiler can resolve, and a FileValue batch is split by type once
+    // instead of dispatching per file.
+    static void computeIds(std::vector<TextFile>& files);
+    static void computeIds(std::vector<BinaryFile>& files);
+    static void computeIds(std::vector<FileValue>& files);
+    
+    friend class FileFactory;
     friend class ObjectStore;
 };
 
-class TextFile : public FileObject {
+class TextFile final : public FileObject {
 private:
-    std::vector<std::string> lines;
+    ContentView buffer;
+    std::vector<size_t> lineStarts;
+    bool loaded;
+    bool indexed;
     std::string encoding;
+    bool edited;
+    
+    ObjectId computeHash() override;
+    bool hasInMemoryEdits() const override { return edited; }
+    bool holdsContent() const override { return loaded; }
     
-    std::string computeHash() override;
+    void load();
+    void buildIndex();
     
 public:
     TextFile(const std::string& path);
+    TextFile(const std::string& path, const ContentView& content);
     
     bool isBinary() const override { return false; }
     std::vector<char> readContent() override;
+    ContentView viewContent() override;
     void writeContent(const std::vector<char>& data) override;
+    void writeContent(const ContentView& content) override;
     
+    // The content is kept as one buffer with its original line endings;
+    // lines are views into it without their '\n' and stay valid until the
+    // content is next replaced.
+    std::string_view getText();
+    std::string_view getLine(size_t i);
+    std::vector<std::string_view> getLineViews();
     std::vector<std::string> getLines();
     void setLines(const std::vector<std::string>& newLines);
-    int getLineCount() const { return lines.size(); }
+    int getLineCount();
 };
 
-class BinaryFile : public FileObject {
+class BinaryFile final : public FileObject {
 private:
-    std::vector<char> data;
+    mutable std::vector<char> data;
+    ContentView view;
     
-    std::string computeHash() override;
+    ObjectId computeHash() override;
+    bool holdsContent() const override { return !data.empty() || !view.empty(); }
     
 public:
     BinaryFile(const std::string& path);
+    BinaryFile(const std::string& path, const ContentView& content);
     
     bool isBinary() const override { return true; }
     std::vector<char> readContent() override;
+    ContentView viewContent() override;
     void writeContent(const std::vector<char>& content) override;
+    void writeContent(const ContentView& content) override;
     
-    const std::vector<char>& getData() const { return data; }
+    const std::vector<char>& getData() const;
 };
 
+// The virtual interface of whichever file a value holds.
+inline FileObject& asFileObject(FileValue& value) {
+    return std::visit([](FileObject& file) -> FileObject& { return file; }, value);
+}
+
 class FileFactory {
 public:
+    // Bytes inspected when classifying content, as in git.
+    static constexpr size_t SAMPLE_SIZE = 8000;
+    
+    // Opens and reads the file once; the returned object keeps that
+    // content instead of reading the file again. A file the stat cache
+    // knows is not read at all: its object comes back with the id set and
+    // reads the content only when asked for it.
     static std::unique_ptr<FileObject> createFileObject(const std::string& path);
+    static std::unique_ptr<FileObject> createFileObject(const std::string& path, ObjectType type);
+    
+    // The same, with the object itself allocated from arena, for callers
+    // that open many files within one operation.
+    static Arena::Ptr<FileObject> createFileObject(const std::string& path, Arena& arena);
+    static Arena::Ptr<FileObject> createFileObject(const std::string& path, ObjectType type,
+                                                   Arena& arena);
+    
+    // The same classification as createFileObject, returning the file by
+    // value rather than behind a heap allocation.
+    static FileValue createFileValue(const std::string& path);
+    static FileValue createFileValue(const std::string& path, ObjectType type);
+    
+    static ObjectType classify(const std::string& path, const ContentView& content);
+    static bool isBinaryContent(const char* data, size_t size);
     static bool detectBinary(const std::string& path);
+    
+private:
+    // Objects decides where the object lives; see FileObject.cpp.
+    template<typename Objects>
+    static auto open(const std::string& path, Objects objects);
+    template<typename Objects>
+    static auto open(const std::string& path, ObjectType type, Objects objects);
 };
 
 #endif
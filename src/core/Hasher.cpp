@@ -0,0 +1,149 @@
+#include "Hasher.h"
+#include "Metrics.h"
+#include "ThreadPool.h"
+#include <openssl/evp.h>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+// Inputs are grouped into tasks of about this many bytes for hashMany().
+const size_t HASH_TASK_BYTES = 256 * 1024;
+
+}
+
+long Hasher::updateFromFile(const std::string& path, char* lastByte) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return -1;
+    }
+    VV_COUNT(FILE_OPENS, 1);
+    
+    std::vector<char> buffer(BUFFER_SIZE);
+    long total = 0;
+    
+    while (file) {
+        file.read(buffer.data(), buffer.size());
+        std::streamsize bytesRead = file.gcount();
+        if (bytesRead <= 0) {
+            break;
+        }
+        update(buffer.data(), bytesRead);
+        if (lastByte) {
+            *lastByte = buffer[bytesRead - 1];
+        }
+        total += bytesRead;
+    }
+    VV_COUNT(BYTES_READ, total);
+    
+    return total;
+}
+
+std::unique_ptr<Hasher> Hasher::create(HashAlgorithm algorithm) {
+    switch (algorithm) {
+        case HashAlgorithm::BLAKE3:
+            return std::make_unique<Blake3Hasher>();
+        case HashAlgorithm::SHA1:
+            return std::make_unique<Sha1Hasher>();
+        default:
+            return std::make_unique<Sha256Hasher>();
+    }
+}
+
+size_t Hasher::digestSize(HashAlgorithm algorithm) {
+    return algorithm == HashAlgorithm::SHA1 ? 20 : ObjectId::SIZE;
+}
+
+const char* Hasher::name(HashAlgorithm algorithm) {
+    switch (algorithm) {
+        case HashAlgorithm::BLAKE3:
+            return "blake3";
+        case HashAlgorithm::SHA1:
+            return "sha1";
+        default:
+            return "sha256";
+    }
+}
+
+bool Hasher::parseName(std::string_view name, HashAlgorithm& algorithm) {
+    for (HashAlgorithm candidate : {HashAlgorithm::SHA256, HashAlgorithm::BLAKE3, HashAlgorithm::SHA1}) {
+        if (name == Hasher::name(candidate)) {
+            algorithm = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string Hasher::toHex(const ObjectId& id, HashAlgorithm algorithm) {
+    return id.toHex().substr(0, 2 * digestSize(algorithm));
+}
+
+std::vector<ObjectId> Hasher::hashMany(HashAlgorithm algorithm,
+                                       const std::vector<ContentView>& inputs) {
+    std::vector<ObjectId> ids(inputs.size());
+    
+    std::vector<size_t> starts;
+    size_t bytes = HASH_TASK_BYTES;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (bytes >= HASH_TASK_BYTES) {
+            starts.push_back(i);
+            bytes = 0;
+        }
+        bytes += inputs[i].size();
+    }
+    starts.push_back(inputs.size());
+    
+    ThreadPool::shared().parallelFor(starts.size() - 1, [&](size_t task) {
+        std::unique_ptr<Hasher> hasher = create(algorithm);
+        for (size_t i = starts[task]; i < starts[task + 1]; i++) {
+            hasher->update(inputs[i]);
+            ids[i] = hasher->finish();
+        }
+    });
+    return ids;
+}
+
+EvpHasher::EvpHasher(const evp_md_st* digest)
+    : ctx(EVP_MD_CTX_new()), md(digest) {
+    if (ctx == nullptr) {
+        throw std::runtime_error("Cannot allocate digest context");
+    }
+    reset();
+}
+
+EvpHasher::~EvpHasher() {
+    EVP_MD_CTX_free(ctx);
+}
+
+void EvpHasher::reset() {
+    if (EVP_DigestInit_ex(ctx, md, nullptr) != 1) {
+        throw std::runtime_error("Cannot initialise digest");
+    }
+}
+
+void EvpHasher::update(const void* data, size_t length) {
+    VV_COUNT(BYTES_HASHED, length);
+    if (length > 0 && EVP_DigestUpdate(ctx, data, length) != 1) {
+        throw std::runtime_error("Digest update failed");
+    }
+}
+
+ObjectId EvpHasher::finish() {
+    ObjectId result;
+    unsigned int length = 0;
+    if (EVP_DigestFinal_ex(ctx, result.data(), &length) != 1 ||
+        length != static_cast<unsigned int>(EVP_MD_size(md))) {
+        throw std::runtime_error("Digest finalisation failed");
+    }
+    reset();
+    return result;
+}
+
+Sha256Hasher::Sha256Hasher()
+    : EvpHasher(EVP_sha256()) {
+}
+
+Sha1Hasher::Sha1Hasher()
+    : EvpHasher(EVP_sha1()) {
+}
@@ -0,0 +1,121 @@
+#ifndef HASHER_H
+#define HASHER_H
+
+#include "ContentView.h"
+#include "ObjectId.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct evp_md_ctx_st;
+struct evp_md_st;
+
+// How object ids are computed. SHA-256 is the default object format and
+// BLAKE3 an opt-in faster one; a store keeps whichever it was created
+// with. SHA-1 is only there to name objects the way stores written by
+// older versions of the Java client did, and is never a store format.
+enum class HashAlgorithm : uint8_t {
+    SHA256 = 0,
+    BLAKE3 = 1,
+    SHA1 = 2
+};
+
+class Hasher {
+public:
+    static const size_t BUFFER_SIZE = 64 * 1024;
+    
+    virtual ~Hasher() = default;
+    
+    virtual void reset() = 0;
+    virtual void update(const void* data, size_t length) = 0;
+    void update(const ContentView& content) { update(content.data(), content.size()); }
+    // Digests shorter than an ObjectId (SHA-1) fill its first bytes and
+    // leave the rest zero. The hasher is ready for the next input after.
+    virtual ObjectId finish() = 0;
+    
+    long updateFromFile(const std::string& path, char* lastByte = nullptr);
+    
+    static std::unique_ptr<Hasher> create(HashAlgorithm algorithm);
+    static size_t digestSize(HashAlgorithm algorithm);
+    static const char* name(HashAlgorithm algorithm);
+    static bool parseName(std::string_view name, HashAlgorithm& algorithm);
+    // The digest's own length in hex, so SHA-1 ids come out as 40 digits.
+    static std::string toHex(const ObjectId& id, HashAlgorithm algorithm);
+    
+    // The id of every input, hashed across the shared pool. Small inputs
+    // are grouped so each task hashes a run of them with one hasher rather
+    // than setting one up per input.
+    static std::vector<ObjectId> hashMany(HashAlgorithm algorithm,
+                                          const std::vector<ContentView>& inputs);
+};
+
+// OpenSSL digests, which use the SHA extensions or the widest vector unit
+// the CPU has on their own.
+class EvpHasher : public Hasher {
+private:
+    evp_md_ctx_st* ctx;
+    const evp_md_st* md;
+    
+protected:
+    explicit EvpHasher(const evp_md_st* digest);
+    
+public:
+    ~EvpHasher() override;
+    EvpHasher(const EvpHasher&) = delete;
+    EvpHasher& operator=(const EvpHasher&) = delete;
+    
+    void reset() override;
+    void update(const void* data, size_t length) override;
+    using Hasher::update;
+    ObjectId finish() override;
+};
+
+class Sha256Hasher : public EvpHasher {
+public:
+    Sha256Hasher();
+};
+
+class Sha1Hasher : public EvpHasher {
+public:
+    Sha1Hasher();
+};
+
+// BLAKE3 with a 32-byte output. Whole chunks are compressed four at a
+// time with SSE2 where available, each lane taking one chunk.
+class Blake3Hasher : public Hasher {
+public:
+    static const size_t BLOCK_LEN = 64;
+    static const size_t CHUNK_LEN = 1024;
+    
+private:
+    // One chaining value per completed subtree, at most one per level.
+    static const size_t MAX_DEPTH = 54;
+    
+    uint32_t key[8];
+    uint32_t chunkCv[8];
+    uint64_t chunkCounter;
+    uint8_t block[BLOCK_LEN];
+    size_t blockLen;
+    size_t blocksCompressed;
+    uint32_t stack[MAX_DEPTH][8];
+    size_t stackSize;
+    
+    size_t chunkLength() const { return blocksCompressed * BLOCK_LEN + blockLen; }
+    void resetChunk();
+    void updateChunk(const uint8_t* data, size_t length);
+    void addChunkCv(const uint32_t cv[8], uint64_t totalChunks);
+    void compressChunks(const uint8_t* data, size_t count);
+    
+public:
+    Blake3Hasher();
+    
+    void reset() override;
+    void update(const void* data, size_t length) override;
+    using Hasher::update;
+    ObjectId finish() override;
+};
+
+#endif
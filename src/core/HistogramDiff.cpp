@@ -0,0 +1,134 @@
+#include "DiffEngine.h"
+#include "DiffInternal.h"
+#include "Metrics.h"
+#include <algorithm>
+
+std::vector<Edit> HistogramDiff::editScript(
+    const std::vector<std::string_view>& oldLines,
+    const std::vector<std::string_view>& newLines,
+    const std::vector<uint32_t>& oldIds,
+    const std::vector<uint32_t>& newIds) {
+    
+    return editScript(oldLines, newLines, oldIds, newIds, idUniverse(oldIds, newIds));
+}
+
+std::vector<Edit> HistogramDiff::editScript(
+    const std::vector<std::string_view>& oldLines,
+    const std::vector<std::string_view>& newLines,
+    const std::vector<uint32_t>& oldIds,
+    const std::vector<uint32_t>& newIds,
+    uint32_t universe) {
+    
+    VV_TIME(DIFF_HISTOGRAM);
+    VV_COUNT(LINES_DIFFED, oldLines.size() + newLines.size());
+    const uint32_t* a = oldIds.data();
+    const uint32_t* b = newIds.data();
+    
+    // Occurrences of each line in the old side of the current region, and
+    // the positions holding it as a chain in ascending order.
+    std::vector<int> count(universe, 0);
+    std::vector<int> head(universe, -1);
+    std::vector<int> next(oldLines.size(), -1);
+    
+    MyersDiff fallback;
+    fallback.setMaxCost(maxCost);
+    
+    std::vector<Edit> edits;
+    std::vector<DiffRegion> pending;
+    pending.push_back({0, static_cast<int>(oldLines.size()), 0, static_cast<int>(newLines.size()), false});
+    
+    while (!pending.empty()) {
+        DiffRegion region = pending.back();
+        pending.pop_back();
+        if (region.equal) {
+            appendEdit(edits, EditType::EQUAL, region.aLo, region.bLo, region.aHi - region.aLo);
+            continue;
+        }
+        
+        int aLo = region.aLo, aHi = region.aHi;
+        int bLo = region.bLo, bHi = region.bHi;
+        
+        int prefix = 0;
+        while (aLo + prefix < aHi && bLo + prefix < bHi && a[aLo + prefix] == b[bLo + prefix]) {
+            prefix++;
+        }
+        appendEdit(edits, EditType::EQUAL, aLo, bLo, prefix);
+        aLo += prefix;
+        bLo += prefix;
+        
+        int suffix = 0;
+        while (aHi - suffix > aLo && bHi - suffix > bLo &&
+               a[aHi - suffix - 1] == b[bHi - suffix - 1]) {
+            suffix++;
+        }
+        aHi -= suffix;
+        bHi -= suffix;
+        if (suffix > 0) {
+            pending.push_back({aHi, aHi + suffix, bHi, bHi + suffix, true});
+        }
+        
+        if (aLo == aHi || bLo == bHi) {
+            appendEdit(edits, EditType::DELETE, aLo, bLo, aHi - aLo);
+            appendEdit(edits, EditType::INSERT, aHi, bLo, bHi - bLo);
+            continue;
+        }
+        
+        for (int i = aHi - 1; i >= aLo; i--) {
+            next[i] = head[a[i]];
+            head[a[i]] = i;
+            count[a[i]]++;
+        }
+        
+        // Try every match of each new line that is rare in the old side,
+        // extend it in both directions, and keep the run whose rarest line
+        // is rarest, then longest. Lines inside a run already found are not
+        // tried again.
+        int lowCount = MAX_CHAIN + 1;
+        int bestA = 0, bestB = 0, bestLength = 0;
+        for (int j = bLo; j < bHi;) {
+            uint32_t id = b[j];
+            int nextJ = j + 1;
+            if (count[id] > 0 && count[id] <= lowCount && count[id] <= MAX_CHAIN) {
+                for (int i = head[id]; i >= 0; i = next[i]) {
+                    int as = i, bs = j, ae = i + 1, be = j + 1;
+                    int rarest = count[id];
+                    while (as > aLo && bs > bLo && a[as - 1] == b[bs - 1]) {
+                        as--;
+                        bs--;
+                        rarest = std::min(rarest, count[a[as]]);
+                    }
+                    while (ae < aHi && be < bHi && a[ae] == b[be]) {
+                        rarest = std::min(rarest, count[a[ae]]);
+                        ae++;
+                        be++;
+                    }
+                    nextJ = std::max(nextJ, be);
+                    
+                    if (rarest < lowCount || (rarest == lowCount && ae - as > bestLength)) {
+                        lowCount = rarest;
+                        bestA = as;
+                        bestB = bs;
+                        bestLength = ae - as;
+                    }
+                }
+            }
+            j = nextJ;
+        }
+        
+        for (int i = aLo; i < aHi; i++) {
+            count[a[i]] = 0;
+            head[a[i]] = -1;
+        }
+        
+        if (bestLength == 0) {
+            fallback.appendEdits(a, aLo, aHi, b, bLo, bHi, edits);
+            continue;
+        }
+        
+        pending.push_back({bestA + bestLength, aHi, bestB + bestLength, bHi, false});
+        pending.push_back({bestA, bestA + bestLength, bestB, bestB + bestLength, true});
+        pending.push_back({aLo, bestA, bLo, bestB, false});
+    }
+    
+    return edits;
+}
@@ -0,0 +1,334 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+const char* const COUNTER_NAMES[] = {
+    "pool_hits", "pool_misses", "objects_stored", "objects_deduplicated", "objects_retrieved",
+    "bytes_read", "bytes_written", "file_opens", "file_maps", "file_renames",
+    "directory_creates", "files_classified", "bytes_hashed", "lines_diffed"
+};
+
+const char* const TIMER_NAMES[] = {
+    "store_object", "retrieve_object", "hash_file", "diff",
+    "diff_simple", "diff_myers", "diff_patience", "diff_histogram"
+};
+
+static_assert(sizeof(COUNTER_NAMES) / sizeof(COUNTER_NAMES[0]) == static_cast<size_t>(Counter::COUNT),
+              "every counter needs a name");
+static_assert(sizeof(TIMER_NAMES) / sizeof(TIMER_NAMES[0]) == static_cast<size_t>(Timer::COUNT),
+              "every timer needs a name");
+
+const size_t COUNTERS = static_cast<size_t>(Counter::COUNT);
+const size_t TIMERS = static_cast<size_t>(Timer::COUNT);
+
+struct TraceEvent {
+    Timer timer;
+    uint64_t start;
+    uint64_t nanos;
+};
+
+// A thread's shard plus the trace events it has buffered. The buffer is
+// only touched while tracing, and its lock is only contended by
+// stopTrace().
+struct ThreadState {
+    Metrics::Shard shard;
+    std::mutex traceMtx;
+    std::vector<TraceEvent> events;
+    uint64_t threadId;
+    
+    ThreadState() : shard(), threadId(0) {}
+};
+
+// Shards of live threads, and the totals of threads that have exited.
+// Never destroyed, since threads may still exit during static teardown.
+struct Registry {
+    std::mutex mtx;
+    std::vector<ThreadState*> threads;
+    MetricsSnapshot retired;
+    std::vector<std::pair<uint64_t, TraceEvent>> retiredEvents;
+    uint64_t nextThreadId = 1;
+    
+    Registry() : retired() {}
+};
+
+Registry& registry() {
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+std::atomic<size_t> traceBudget(0);
+
+// Counts made by thread_local destructors that run after a thread's own
+// state was retired; they are dropped.
+Metrics::Shard discarded;
+thread_local bool exited = false;
+
+int bucketOf(uint64_t nanos) {
+    if (nanos == 0) {
+        return 0;
+    }
+    int bucket = 64 - __builtin_clzll(nanos);
+    return std::min(bucket, HistogramSnapshot::BUCKETS - 1);
+}
+
+void accumulate(MetricsSnapshot& into, const Metrics::Shard& shard) {
+    for (size_t i = 0; i < COUNTERS; i++) {
+        into.counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+    }
+    for (size_t t = 0; t < TIMERS; t++) {
+        HistogramSnapshot& histogram = into.timers[t];
+        histogram.count += shard.timerCounts[t].load(std::memory_order_relaxed);
+        histogram.total += shard.timerTotals[t].load(std::memory_order_relaxed);
+        histogram.max = std::max(histogram.max, shard.timerMax[t].load(std::memory_order_relaxed));
+        for (int b = 0; b < HistogramSnapshot::BUCKETS; b++) {
+            histogram.buckets[b] += shard.buckets[t][b].load(std::memory_order_relaxed);
+        }
+    }
+}
+
+
+void appendNumber(std::string& out, uint64_t value) {
+    out += std::to_string(value);
+}
+
+void appendMicros(std::string& out, uint64_t nanos) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%llu.%03llu",
+                  static_cast<unsigned long long>(nanos / 1000),
+                  static_cast<unsigned long long>(nanos % 1000));
+    out += text;
+}
+
+void appendTraceEvent(std::string& out, uint64_t threadId, const TraceEvent& event, bool first) {
+    out += first ? "\n" : ",\n";
+    out += "{\"name\":\"";
+    out += Metrics::nameOf(event.timer);
+    out += "\",\"cat\":\"vv\",\"ph\":\"X\",\"ts\":";
+    appendMicros(out, event.start);
+    out += ",\"dur\":";
+    appendMicros(out, event.nanos);
+    out += ",\"pid\":";
+    appendNumber(out, static_cast<uint64_t>(::getpid()));
+    out += ",\"tid\":";
+    appendNumber(out, threadId);
+    out += "}";
+}
+
+}
+
+// The calling thread's state, which is folded into the registry's totals
+// when the thread exits.
+struct MetricsThread {
+    ThreadState* state = nullptr;
+    
+    ~MetricsThread() {
+        if (!state) {
+            return;
+        }
+        
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mtx);
+        accumulate(reg.retired, state->shard);
+        {
+            std::lock_guard<std::mutex> traceLock(state->traceMtx);
+            for (const TraceEvent& event : state->events) {
+                reg.retiredEvents.emplace_back(state->threadId, event);
+            }
+        }
+        reg.threads.erase(std::remove(reg.threads.begin(), reg.threads.end(), state),
+                          reg.threads.end());
+        delete state;
+        state = nullptr;
+        Metrics::current = nullptr;
+        exited = true;
+    }
+};
+
+namespace {
+
+thread_local MetricsThread thisThread;
+
+}
+
+thread_local Metrics::Shard* Metrics::current = nullptr;
+std::atomic<bool> Metrics::tracing(false);
+
+uint64_t HistogramSnapshot::percentile(double fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+    
+    uint64_t rank = static_cast<uint64_t>(fraction * count);
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen > rank) {
+            uint64_t upper = b == 0 ? 0 : (uint64_t(1) << b) - 1;
+            return std::min(upper, max);
+        }
+    }
+    return max;
+}
+
+MetricsSnapshot MetricsSnapshot::since(const MetricsSnapshot& earlier) const {
+    MetricsSnapshot delta = *this;
+    for (size_t i = 0; i < COUNTERS; i++) {
+        delta.counters[i] -= earlier.counters[i];
+    }
+    for (size_t t = 0; t < TIMERS; t++) {
+        delta.timers[t].count -= earlier.timers[t].count;
+        delta.timers[t].total -= earlier.timers[t].total;
+        for (int b = 0; b < HistogramSnapshot::BUCKETS; b++) {
+            delta.timers[t].buckets[b] -= earlier.timers[t].buckets[b];
+        }
+    }
+    return delta;
+}
+
+std::string MetricsSnapshot::toJson() const {
+    std::string out = "{\"counters\":{";
+    for (size_t i = 0; i < COUNTERS; i++) {
+        out += i ? ",\"" : "\"";
+        out += COUNTER_NAMES[i];
+        out += "\":";
+        appendNumber(out, counters[i]);
+    }
+    
+    out += "},\"timers\":{";
+    for (size_t t = 0; t < TIMERS; t++) {
+        const HistogramSnapshot& histogram = timers[t];
+        out += t ? ",\"" : "\"";
+        out += TIMER_NAMES[t];
+        out += "\":{\"count\":";
+        appendNumber(out, histogram.count);
+        out += ",\"total_ns\":";
+        appendNumber(out, histogram.total);
+        out += ",\"mean_ns\":";
+        appendNumber(out, static_cast<uint64_t>(histogram.mean()));
+        out += ",\"p50_ns\":";
+        appendNumber(out, histogram.percentile(0.5));
+        out += ",\"p99_ns\":";
+        appendNumber(out, histogram.percentile(0.99));
+        out += ",\"max_ns\":";
+        appendNumber(out, histogram.max);
+        
+        // Trailing empty buckets are left out.
+        int last = HistogramSnapshot::BUCKETS;
+        while (last > 0 && histogram.buckets[last - 1] == 0) {
+            last--;
+        }
+        out += ",\"buckets\":[";
+        for (int b = 0; b < last; b++) {
+            if (b) {
+                out += ",";
+            }
+            appendNumber(out, histogram.buckets[b]);
+        }
+        out += "]}";
+    }
+    out += "}}";
+    return out;
+}
+
+Metrics::Shard* Metrics::attach() {
+    if (exited) {
+        return &discarded;
+    }
+    
+    ThreadState* state = new ThreadState();
+    {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mtx);
+        state->threadId = reg.nextThreadId++;
+        reg.threads.push_back(state);
+    }
+    
+    thisThread.state = state;
+    current = &state->shard;
+    return current;
+}
+
+void Metrics::record(Timer timer, uint64_t start, uint64_t nanos) {
+    Shard& shard = local();
+    size_t t = static_cast<size_t>(timer);
+    bump(shard.timerCounts[t], 1);
+    bump(shard.timerTotals[t], nanos);
+    bump(shard.buckets[t][bucketOf(nanos)], 1);
+    if (nanos > shard.timerMax[t].load(std::memory_order_relaxed)) {
+        shard.timerMax[t].store(nanos, std::memory_order_relaxed);
+    }
+    
+    if (tracing.load(std::memory_order_relaxed)) {
+        traceEvent(timer, start, nanos);
+    }
+}
+
+void Metrics::traceEvent(Timer timer, uint64_t start, uint64_t nanos) {
+    size_t budget = traceBudget.load(std::memory_order_relaxed);
+    while (budget > 0 && !traceBudget.compare_exchange_weak(budget, budget - 1,
+                                                            std::memory_order_relaxed)) {
+    }
+    if (budget == 0 || exited) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(thisThread.state->traceMtx);
+    thisThread.state->events.push_back({timer, start, nanos});
+}
+
+MetricsSnapshot Metrics::snapshot() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    MetricsSnapshot result = reg.retired;
+    for (const ThreadState* state : reg.threads) {
+        accumulate(result, state->shard);
+    }
+    return result;
+}
+
+const char* Metrics::nameOf(Counter counter) {
+    return COUNTER_NAMES[static_cast<size_t>(counter)];
+}
+
+const char* Metrics::nameOf(Timer timer) {
+    return TIMER_NAMES[static_cast<size_t>(timer)];
+}
+
+void Metrics::startTrace(size_t maxEvents) {
+    traceBudget.store(maxEvents, std::memory_order_relaxed);
+    tracing.store(true, std::memory_order_release);
+}
+
+std::string Metrics::stopTrace() {
+    tracing.store(false, std::memory_order_release);
+    traceBudget.store(0, std::memory_order_relaxed);
+    
+    std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mtx);
+    for (const auto& retired : reg.retiredEvents) {
+        appendTraceEvent(out, retired.first, retired.second, first);
+        first = false;
+    }
+    reg.retiredEvents.clear();
+    
+    for (ThreadState* state : reg.threads) {
+        std::lock_guard<std::mutex> traceLock(state->traceMtx);
+        for (const TraceEvent& event : state->events) {
+            appendTraceEvent(out, state->threadId, event, first);
+            first = false;
+        }
+        state->events.clear();
+    }
+    
+    out += "\n]}";
+    return out;
+}
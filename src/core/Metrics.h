@@ -0,0 +1,165 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Instrumentation for the hot paths of vv_core, built when VV_METRICS is
+// defined (cmake -DVV_METRICS=ON). Each thread counts into a shard of its
+// own, so recording is a plain load and store with no contention; the
+// shards are only summed when a snapshot is taken. Without VV_METRICS the
+// VV_COUNT and VV_TIME macros expand to nothing and snapshots are empty.
+
+enum class Counter : uint8_t {
+    POOL_HITS,
+    POOL_MISSES,
+    OBJECTS_STORED,
+    OBJECTS_DEDUPLICATED,
+    OBJECTS_RETRIEVED,
+    BYTES_READ,
+    BYTES_WRITTEN,
+    FILE_OPENS,
+    FILE_MAPS,
+    FILE_RENAMES,
+    DIRECTORY_CREATES,
+    FILES_CLASSIFIED,
+    BYTES_HASHED,
+    LINES_DIFFED,
+    COUNT
+};
+
+enum class Timer : uint8_t {
+    STORE_OBJECT,
+    RETRIEVE_OBJECT,
+    HASH_FILE,
+    DIFF,
+    DIFF_SIMPLE,
+    DIFF_MYERS,
+    DIFF_PATIENCE,
+    DIFF_HISTOGRAM,
+    COUNT
+};
+
+// Latencies in nanoseconds, bucketed by powers of two: bucket i holds the
+// samples in [2^(i-1), 2^i), bucket 0 the zero ones.
+struct HistogramSnapshot {
+    static const int BUCKETS = 48;
+    
+    uint64_t count;
+    uint64_t total;
+    uint64_t max;
+    uint64_t buckets[BUCKETS];
+    
+    double mean() const { return count ? static_cast<double>(total) / count : 0.0; }
+    
+    // The upper bound of the bucket holding the given fraction of samples.
+    uint64_t percentile(double fraction) const;
+};
+
+struct MetricsSnapshot {
+    uint64_t counters[static_cast<size_t>(Counter::COUNT)];
+    HistogramSnapshot timers[static_cast<size_t>(Timer::COUNT)];
+    
+    uint64_t get(Counter counter) const { return counters[static_cast<size_t>(counter)]; }
+    const HistogramSnapshot& get(Timer timer) const { return timers[static_cast<size_t>(timer)]; }
+    
+    // The change from an earlier snapshot; max is kept as is.
+    MetricsSnapshot since(const MetricsSnapshot& earlier) const;
+    
+    // {"counters": {name: value, ...}, "timers": {name: {count, total_ns,
+    // mean_ns, p50_ns, p99_ns, max_ns, buckets}, ...}}
+    std::string toJson() const;
+};
+
+class Metrics {
+public:
+    // One thread's counts. Only the owning thread writes, so relaxed
+    // atomics are enough for snapshots to read them while it runs.
+    struct Shard {
+        std::atomic<uint64_t> counters[static_cast<size_t>(Counter::COUNT)];
+        std::atomic<uint64_t> timerCounts[static_cast<size_t>(Timer::COUNT)];
+        std::atomic<uint64_t> timerTotals[static_cast<size_t>(Timer::COUNT)];
+        std::atomic<uint64_t> timerMax[static_cast<size_t>(Timer::COUNT)];
+        std::atomic<uint64_t> buckets[static_cast<size_t>(Timer::COUNT)][HistogramSnapshot::BUCKETS];
+    };
+    
+private:
+    friend struct MetricsThread;
+    
+    static thread_local Shard* current;
+    static std::atomic<bool> tracing;
+    
+    static Shard* attach();
+    static void traceEvent(Timer timer, uint64_t start, uint64_t nanos);
+    
+    static void bump(std::atomic<uint64_t>& value, uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+    
+    static Shard& local() {
+        Shard* shard = current;
+        return shard ? *shard : *attach();
+    }
+    
+public:
+    static constexpr bool enabled() {
+#ifdef VV_METRICS
+        return true;
+#else
+        return false;
+#endif
+    }
+    
+    static void add(Counter counter, uint64_t amount = 1) {
+        bump(local().counters[static_cast<size_t>(counter)], amount);
+    }
+    
+    static void record(Timer timer, uint64_t start, uint64_t nanos);
+    
+    // Nanoseconds on a monotonic clock, the time base of record().
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    static MetricsSnapshot snapshot();
+    
+    static const char* nameOf(Counter counter);
+    static const char* nameOf(Timer timer);
+    
+    // Records every timed scope as a trace event until stopTrace(), which
+    // returns them in the Chrome trace event format (chrome://tracing,
+    // Perfetto). Events past maxEvents are dropped.
+    static void startTrace(size_t maxEvents = 1 << 20);
+    static std::string stopTrace();
+};
+
+#ifdef VV_METRICS
+
+class ScopedTimer {
+private:
+    Timer timer;
+    uint64_t start;
+    
+public:
+    explicit ScopedTimer(Timer t) : timer(t), start(Metrics::now()) {}
+    ~ScopedTimer() { Metrics::record(timer, start, Metrics::now() - start); }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+#define VV_METRICS_CONCAT_(a, b) a##b
+#define VV_METRICS_CONCAT(a, b) VV_METRICS_CONCAT_(a, b)
+#define VV_COUNT(counter, amount) Metrics::add(Counter::counter, (amount))
+#define VV_TIME(timer) ScopedTimer VV_METRICS_CONCAT(vvTimer, __LINE__)(Timer::timer)
+
+#else
+
+#define VV_COUNT(counter, amount) ((void)0)
+#define VV_TIME(timer) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,343 @@
+#include "ObjectCache.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char SEGMENT_MAGIC[8] = {'V', 'V', 'C', 'A', 'C', 'H', 'E', '1'};
+const size_t MIN_SEGMENT_SIZE = 1024 * 1024;
+// One slot per this many bytes of segment, about the size of an average
+// object.
+const size_t BYTES_PER_SLOT = 16 * 1024;
+const size_t MIN_SLOTS = 64;
+
+// Compressed copies that do not save at least an eighth of the object are
+// not worth the space, nor the time to inflate them.
+bool worthCompressing(size_t original, size_t compressed) {
+    return compressed <= original - original / 8;
+}
+
+// FNV-1a, which unlike std::hash is the same in every build of the
+// library, so all processes derive the same segment name.
+uint64_t stableHash(const std::string& text) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::string defaultSegmentPath(const std::string& storePath) {
+    std::error_code ec;
+    std::string canonical = fs::weakly_canonical(storePath, ec).string();
+    if (ec) {
+        canonical = storePath;
+    }
+    
+    char name[32];
+    std::snprintf(name, sizeof(name), "versionvault-%016llx",
+                  static_cast<unsigned long long>(stableHash(canonical)));
+    if (fs::is_directory("/dev/shm", ec)) {
+        return std::string("/dev/shm/") + name;
+    }
+    return storePath + "/cache.shm";
+}
+
+}
+
+struct SharedCache::Header {
+    char magic[8];
+    uint64_t slotCount;
+    uint64_t capacity;
+    // Logical end of the ring; data lives at offset % capacity.
+    std::atomic<uint64_t> head;
+    char padding[32];
+};
+
+struct SharedCache::Slot {
+    // Odd while a writer owns the slot.
+    std::atomic<uint32_t> sequence;
+    uint32_t reserved;
+    std::atomic<uint64_t> id[ObjectId::SIZE / 8];
+    std::atomic<uint64_t> offset;
+    std::atomic<uint64_t> size;
+    uint64_t padding;
+};
+
+// The layout follows from the file size alone, so processes configured
+// with different budgets still agree on an existing segment.
+SharedCache::SharedCache(const std::string& path, size_t bytes)
+    : base(nullptr), mappedSize(0), hits(0), misses(0) {
+    static_assert(sizeof(Header) == 64 && sizeof(Slot) == 64, "segment layout changed");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared slots need lock-free atomics");
+    
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open cache segment: " + path);
+    }
+    
+    ::flock(fd, LOCK_EX);
+    struct stat st;
+    bool ok = ::fstat(fd, &st) == 0;
+    if (ok && st.st_size == 0) {
+        ok = ::ftruncate(fd, static_cast<off_t>(std::max(bytes, MIN_SEGMENT_SIZE))) == 0 &&
+             ::fstat(fd, &st) == 0;
+    }
+    if (ok && static_cast<size_t>(st.st_size) >= MIN_SEGMENT_SIZE) {
+        mappedSize = static_cast<size_t>(st.st_size);
+        base = ::mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ok = base != MAP_FAILED;
+    } else {
+        ok = false;
+    }
+    
+    if (ok) {
+        uint64_t slotCount = MIN_SLOTS;
+        while (slotCount * 2 * BYTES_PER_SLOT <= mappedSize) {
+            slotCount *= 2;
+        }
+        header = static_cast<Header*>(base);
+        slots = reinterpret_cast<Slot*>(static_cast<char*>(base) + sizeof(Header));
+        ring = reinterpret_cast<char*>(slots + slotCount);
+        capacity = mappedSize - sizeof(Header) - slotCount * sizeof(Slot);
+        slotMask = slotCount - 1;
+        
+        if (std::memcmp(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0 ||
+            header->slotCount != slotCount || header->capacity != capacity) {
+            std::memset(base, 0, sizeof(Header) + slotCount * sizeof(Slot));
+            header->slotCount = slotCount;
+            header->capacity = capacity;
+            std::memcpy(header->magic, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+        }
+    }
+    ::flock(fd, LOCK_UN);
+    ::close(fd);
+    
+    if (!ok) {
+        if (base && base != MAP_FAILED) {
+            ::munmap(base, mappedSize);
+        }
+        throw std::runtime_error("Cannot map cache segment: " + path);
+    }
+}
+
+SharedCache::~SharedCache() {
+    ::munmap(base, mappedSize);
+}
+
+SharedCache::Slot& SharedCache::slotFor(const ObjectId& id) const {
+    uint64_t h;
+    std::memcpy(&h, id.data(), sizeof(h));
+    return slots[h & slotMask];
+}
+
+void SharedCache::copyIn(uint64_t offset, const char* data, size_t size) {
+    size_t start = static_cast<size_t>(offset % capacity);
+    size_t first = std::min<size_t>(size, capacity - start);
+    std::memcpy(ring + start, data, first);
+    std::memcpy(ring, data + first, size - first);
+}
+
+void SharedCache::copyOut(uint64_t offset, char* data, size_t size) const {
+    size_t start = static_cast<size_t>(offset % capacity);
+    size_t first = std::min<size_t>(size, capacity - start);
+    std::memcpy(data, ring + start, first);
+    std::memcpy(data + first, ring, size - first);
+}
+
+void SharedCache::store(const ObjectId& id, const ContentView& content) {
+    size_t size = content.size();
+    if (size == 0 || size > capacity / 8) {
+        return;
+    }
+    
+    // A slot some other writer holds is simply skipped.
+    Slot& slot = slotFor(id);
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    if ((sequence & 1) != 0 ||
+        !slot.sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire)) {
+        return;
+    }
+    
+    // Space is reserved before it is written, so a reader that copied
+    // from it meanwhile sees the new head and throws its copy away.
+    uint64_t offset = header->head.fetch_add(size, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    copyIn(offset, content.data(), size);
+    
+    uint64_t words[ObjectId::SIZE / 8];
+    std::memcpy(words, id.data(), sizeof(words));
+    for (size_t i = 0; i < ObjectId::SIZE / 8; i++) {
+        slot.id[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.offset.store(offset, std::memory_order_relaxed);
+    slot.size.store(size, std::memory_order_relaxed);
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool SharedCache::retrieve(const ObjectId& id, std::vector<char>& content) {
+    Slot& slot = slotFor(id);
+    uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    
+    uint64_t words[ObjectId::SIZE / 8];
+    for (size_t i = 0; i < ObjectId::SIZE / 8; i++) {
+        words[i] = slot.id[i].load(std::memory_order_relaxed);
+    }
+    uint64_t offset = slot.offset.load(std::memory_order_relaxed);
+    uint64_t size = slot.size.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    
+    if ((sequence & 1) != 0 || slot.sequence.load(std::memory_order_relaxed) != sequence ||
+        size == 0 || size > capacity || std::memcmp(words, id.data(), sizeof(words)) != 0) {
+        misses++;
+        return false;
+    }
+    
+    content.resize(static_cast<size_t>(size));
+    copyOut(offset, content.data(), content.size());
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->head.load(std::memory_order_relaxed) > offset + capacity) {
+        misses++;
+        return false;
+    }
+    hits++;
+    return true;
+}
+
+void SharedCache::erase(const ObjectId& id) {
+    Slot& slot = slotFor(id);
+    uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    if ((sequence & 1) != 0 ||
+        !slot.sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire)) {
+        return;
+    }
+    
+    uint64_t words[ObjectId::SIZE / 8];
+    std::memcpy(words, id.data(), sizeof(words));
+    bool match = true;
+    for (size_t i = 0; i < ObjectId::SIZE / 8; i++) {
+        match = match && slot.id[i].load(std::memory_order_relaxed) == words[i];
+    }
+    if (match) {
+        slot.size.store(0, std::memory_order_relaxed);
+    }
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+ObjectCache::ObjectCache(const std::string& storePath, const CacheConfig& config)
+    : memory(config.memoryEntries, config.memoryBytes) {
+    if (config.compressedBytes > 0) {
+        // Entry count is bounded by bytes alone.
+        compressed = std::make_unique<StoragePool<std::vector<char>>>(
+            std::max<size_t>(config.compressedBytes / 512, 1), config.compressedBytes);
+    }
+    if (config.sharedBytes > 0) {
+        std::string path = config.sharedPath.empty() ? defaultSegmentPath(storePath)
+                                                     : config.sharedPath;
+        try {
+            shared = std::make_unique<SharedCache>(path, config.sharedBytes);
+        } catch (const std::runtime_error&) {
+            // Without the segment this process just caches on its own.
+        }
+    }
+}
+
+// Compressed copies start with the original size.
+void ObjectCache::demote(std::vector<std::pair<ObjectId, ContentView>>& evicted) {
+    for (auto& victim : evicted) {
+        const ContentView& content = victim.second;
+        if (content.size() < 64 || compressed->contains(victim.first)) {
+            continue;
+        }
+        
+        uLongf length = compressBound(static_cast<uLong>(content.size()));
+        std::vector<char> packed(8 + length);
+        uint64_t size = content.size();
+        std::memcpy(packed.data(), &size, 8);
+        if (compress2(reinterpret_cast<Bytef*>(packed.data() + 8), &length,
+                      reinterpret_cast<const Bytef*>(content.data()),
+                      static_cast<uLong>(content.size()), Z_BEST_SPEED) != Z_OK ||
+            !worthCompressing(content.size(), length)) {
+            continue;
+        }
+        packed.resize(8 + length);
+        packed.shrink_to_fit();
+        compressed->store(victim.first, packed);
+    }
+}
+
+void ObjectCache::admit(const ObjectId& id, const ContentView& content) {
+    if (!compressed) {
+        memory.store(id, content);
+        return;
+    }
+    std::vector<std::pair<ObjectId, ContentView>> evicted;
+    memory.store(id, content, &evicted);
+    demote(evicted);
+}
+
+void ObjectCache::store(const ObjectId& id, const ContentView& content) {
+    admit(id, content);
+    if (shared) {
+        shared->store(id, content);
+    }
+}
+
+bool ObjectCache::retrieve(const ObjectId& id, ContentView& content) {
+    if (memory.retrieve(id, content)) {
+        return true;
+    }
+    
+    std::vector<char> packed;
+    if (compressed && compressed->retrieve(id, packed) && packed.size() >= 8) {
+        uint64_t size;
+        std::memcpy(&size, packed.data(), 8);
+        std::vector<char> inflated(static_cast<size_t>(size));
+        uLongf length = static_cast<uLongf>(size);
+        if (uncompress(reinterpret_cast<Bytef*>(inflated.data()), &length,
+                       reinterpret_cast<const Bytef*>(packed.data() + 8),
+                       static_cast<uLong>(packed.size() - 8)) == Z_OK && length == size) {
+            content = ContentView::fromBuffer(std::move(inflated));
+            admit(id, content);
+            return true;
+        }
+    }
+    
+    std::vector<char> copied;
+    if (shared && shared->retrieve(id, copied)) {
+        content = ContentView::fromBuffer(std::move(copied));
+        admit(id, content);
+        return true;
+    }
+    return false;
+}
+
+void ObjectCache::erase(const ObjectId& id) {
+    memory.erase(id);
+    if (compressed) {
+        compressed->erase(id);
+    }
+    if (shared) {
+        shared->erase(id);
+    }
+}
+
+CacheStats ObjectCache::getTierStats() const {
+    CacheStats stats;
+    stats.memory = memory.getStats();
+    stats.compressed = compressed ? compressed->getStats() : PoolStats{0, 0, 0, 0, 0};
+    stats.sharedHits = shared ? shared->getHits() : 0;
+    stats.sharedMisses = shared ? shared->getMisses() : 0;
+    stats.shared = shared != nullptr;
+    return stats;
+}
@@ -0,0 +1,269 @@
+#ifndef OBJECTCACHE_H
+#define OBJECTCACHE_H
+
+#include "ContentView.h"
+#include "ObjectId.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+template<typename T>
+struct PoolCost {
+    static size_t of(const T&) { return sizeof(T); }
+};
+
+template<>
+struct PoolCost<ContentView> {
+    static size_t of(const ContentView& value) { return sizeof(ContentView) + value.size(); }
+};
+
+template<>
+struct PoolCost<std::vector<char>> {
+    static size_t of(const std::vector<char>& value) { return sizeof(value) + value.size(); }
+};
+
+struct PoolStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    size_t entries;
+    size_t bytes;
+};
+
+template<typename T, typename Key = ObjectId>
+class StoragePool {
+private:
+    typedef std::list<std::pair<Key, T>> LruList;
+    
+    struct Shard {
+        mutable std::mutex mtx;
+        LruList lru;
+        std::unordered_map<Key, typename LruList::iterator> index;
+        size_t bytes = 0;
+    };
+    
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t maxEntriesPerShard;
+    size_t maxBytesPerShard;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    std::atomic<uint64_t> evictions;
+    
+    Shard& shardFor(const Key& key) const {
+        size_t h = std::hash<Key>()(key);
+        return *shards[(h ^ (h >> 32)) % shards.size()];
+    }
+    
+    void evict(Shard& shard, std::vector<std::pair<Key, T>>* evicted) {
+        while (!shard.lru.empty() &&
+               (shard.lru.size() > maxEntriesPerShard || shard.bytes > maxBytesPerShard)) {
+            auto& victim = shard.lru.back();
+            shard.bytes -= PoolCost<T>::of(victim.second);
+            shard.index.erase(victim.first);
+            if (evicted) {
+                evicted->push_back(std::move(victim));
+            }
+            shard.lru.pop_back();
+            evictions++;
+        }
+    }
+    
+public:
+    // Entries are spread over lock-striped shards, each an LRU list with
+    // its own share of the entry and byte budgets. A maxBytes of 0 means
+    // the pool is bounded by entry count only.
+    StoragePool(size_t maxEntries = 1000, size_t maxBytes = 0, size_t shardCount = 16)
+        : hits(0), misses(0), evictions(0) {
+        shardCount = std::max<size_t>(1, std::min(shardCount, std::max<size_t>(1, maxEntries)));
+        for (size_t i = 0; i < shardCount; i++) {
+            shards.push_back(std::make_unique<Shard>());
+        }
+        maxEntriesPerShard = std::max<size_t>(1, (maxEntries + shardCount - 1) / shardCount);
+        maxBytesPerShard = maxBytes == 0 ? SIZE_MAX : std::max<size_t>(1, maxBytes / shardCount);
+    }
+    
+    // Entries pushed out to make room are moved to evicted when it is
+    // given, for the caller to pass on once the shard lock is released.
+    void store(const Key& key, const T& value, std::vector<std::pair<Key, T>>* evicted = nullptr) {
+        size_t cost = PoolCost<T>::of(value);
+        if (cost > maxBytesPerShard) {
+            return;
+        }
+        
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.bytes -= PoolCost<T>::of(it->second->second);
+            it->second->second = value;
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        } else {
+            shard.lru.emplace_front(key, value);
+            shard.index[key] = shard.lru.begin();
+        }
+        shard.bytes += cost;
+        
+        evict(shard, evicted);
+    }
+    
+    bool retrieve(const Key& key, T& value) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            misses++;
+            return false;
+        }
+        
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        value = it->second->second;
+        hits++;
+        return true;
+    }
+    
+    bool contains(const Key& key) const {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        return shard.index.find(key) != shard.index.end();
+    }
+    
+    void erase(const Key& key) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mtx);
+        
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.bytes -= PoolCost<T>::of(it->second->second);
+            shard.lru.erase(it->second);
+            shard.index.erase(it);
+        }
+    }
+    
+    void clear() {
+        for (auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mtx);
+            shard->lru.clear();
+            shard->index.clear();
+            shard->bytes = 0;
+        }
+    }
+    
+    size_t size() const {
+        size_t total = 0;
+        for (const auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mtx);
+            total += shard->lru.size();
+        }
+        return total;
+    }
+    
+    size_t bytes() const {
+        size_t total = 0;
+        for (const auto& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard->mtx);
+            total += shard->bytes;
+        }
+        return total;
+    }
+    
+    PoolStats getStats() const {
+        return {hits.load(), misses.load(), evictions.load(), size(), bytes()};
+    }
+};
+
+
+struct CacheConfig {
+    size_t memoryEntries = 2000;
+    size_t memoryBytes = 256 * 1024 * 1024;
+    // Budgets for the optional tiers; 0 leaves a tier off.
+    size_t compressedBytes = 0;
+    size_t sharedBytes = 0;
+    // Segment file for the shared tier. Empty picks one under /dev/shm
+    // named after the store, so every process on the store finds it.
+    std::string sharedPath;
+};
+
+struct CacheStats {
+    PoolStats memory;
+    PoolStats compressed;
+    uint64_t sharedHits;
+    uint64_t sharedMisses;
+    bool shared;
+};
+
+// A cache segment mapped by every process using the same store. Objects
+// are appended to a ring of data behind a direct-mapped table of slots,
+// which are guarded by sequence counters rather than locks, so a process
+// dying mid-update loses at most that slot. A reader copies an object
+// out and then checks that the ring has not wrapped over it meanwhile.
+// Ids name immutable content, so any object found is the right one.
+class SharedCache {
+private:
+    struct Header;
+    struct Slot;
+    
+    void* base;
+    size_t mappedSize;
+    Header* header;
+    Slot* slots;
+    char* ring;
+    uint64_t capacity;
+    uint64_t slotMask;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    
+    Slot& slotFor(const ObjectId& id) const;
+    void copyIn(uint64_t offset, const char* data, size_t size);
+    void copyOut(uint64_t offset, char* data, size_t size) const;
+    
+public:
+    // Opens the segment at path, creating it with the given size if it
+    // does not exist; an existing segment keeps its size. Throws if the
+    // segment cannot be opened or mapped.
+    SharedCache(const std::string& path, size_t bytes);
+    ~SharedCache();
+    SharedCache(const SharedCache&) = delete;
+    SharedCache& operator=(const SharedCache&) = delete;
+    
+    void store(const ObjectId& id, const ContentView& content);
+    bool retrieve(const ObjectId& id, std::vector<char>& content);
+    void erase(const ObjectId& id);
+    
+    uint64_t getHits() const { return hits.load(); }
+    uint64_t getMisses() const { return misses.load(); }
+};
+
+// The store's object cache, in up to three tiers: recently used objects
+// as they are, then those pushed out of memory kept zlib-compressed, and
+// finally a segment shared with other processes. Objects found in a lower
+// tier are moved back up to the first.
+class ObjectCache {
+private:
+    StoragePool<ContentView> memory;
+    std::unique_ptr<StoragePool<std::vector<char>>> compressed;
+    std::unique_ptr<SharedCache> shared;
+    
+    void admit(const ObjectId& id, const ContentView& content);
+    void demote(std::vector<std::pair<ObjectId, ContentView>>& evicted);
+    
+public:
+    ObjectCache(const std::string& storePath, const CacheConfig& config);
+    
+    void store(const ObjectId& id, const ContentView& content);
+    bool retrieve(const ObjectId& id, ContentView& content);
+    void erase(const ObjectId& id);
+    
+    PoolStats getStats() const { return memory.getStats(); }
+    CacheStats getTierStats() const;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef OBJECTID_H
+#define OBJECTID_H
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+class ObjectId {
+private:
+    std::array<uint8_t, 32> bytes{};
+    
+    static constexpr int nibble(char c) {
+        return (c >= '0' && c <= '9') ? c - '0' :
+               (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+               (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+    }
+    
+public:
+    static const size_t SIZE = 32;
+    static const size_t HEX_SIZE = 64;
+    
+    constexpr ObjectId() = default;
+    explicit ObjectId(const uint8_t* raw) { std::memcpy(bytes.data(), raw, SIZE); }
+    
+    static constexpr bool parse(std::string_view hex, ObjectId& out) {
+        if (hex.size() != HEX_SIZE) {
+            return false;
+        }
+        for (size_t i = 0; i < SIZE; i++) {
+            int high = nibble(hex[2 * i]);
+            int low = nibble(hex[2 * i + 1]);
+            if (high < 0 || low < 0) {
+                return false;
+            }
+            out.bytes[i] = static_cast<uint8_t>((high << 4) | low);
+        }
+        return true;
+    }
+    
+    static ObjectId fromHex(std::string_view hex) {
+        ObjectId id;
+        if (!parse(hex, id)) {
+            throw std::invalid_argument("Invalid object id: " + std::string(hex));
+        }
+        return id;
+    }
+    
+    constexpr void formatHex(char* out) const {
+        const char* digits = "0123456789abcdef";
+        for (size_t i = 0; i < SIZE; i++) {
+            out[2 * i] = digits[bytes[i] >> 4];
+            out[2 * i + 1] = digits[bytes[i] & 0x0f];
+        }
+    }
+    
+    std::string toHex() const {
+        std::string hex(HEX_SIZE, '0');
+        formatHex(&hex[0]);
+        return hex;
+    }
+    
+    uint8_t* data() { return bytes.data(); }
+    const uint8_t* data() const { return bytes.data(); }
+    constexpr size_t size() const { return SIZE; }
+    const uint8_t* begin() const { return bytes.data(); }
+    const uint8_t* end() const { return bytes.data() + SIZE; }
+    uint8_t operator[](size_t i) const { return bytes[i]; }
+    
+    bool isNull() const {
+        for (uint8_t b : bytes) {
+            if (b != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    bool operator==(const ObjectId& other) const { return std::memcmp(data(), other.data(), SIZE) == 0; }
+    bool operator!=(const ObjectId& other) const { return !(*this == other); }
+    bool operator<(const ObjectId& other) const { return std::memcmp(data(), other.data(), SIZE) < 0; }
+    bool operator>(const ObjectId& other) const { return other < *this; }
+    bool operator<=(const ObjectId& other) const { return !(other < *this); }
+    bool operator>=(const ObjectId& other) const { return !(*this < other); }
+};
+
+namespace std {
+
+// Object ids are cryptographic digests, whichever algorithm the store uses
+// (SHA-256, BLAKE3 or SHA-1; Tree ids hash their entries the same way), and
+// every one is at least 16 bytes long, so bytes 8-15 are already uniformly
+// distributed; take them as-is instead of hashing again.
+template<>
+struct hash<ObjectId> {
+    size_t operator()(const ObjectId& id) const noexcept {
+        size_t value;
+        std::memcpy(&value, id.data() + 8, sizeof(value));
+        return value;
+    }
+};
+
+}
+
+#endif
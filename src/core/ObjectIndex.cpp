@@ -0,0 +1,621 @@
+#include "ObjectIndex.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char TABLE_MAGIC[4] = {'V', 'V', 'O', 'I'};
+const char JOURNAL_MAGIC[4] = {'V', 'V', 'O', 'J'};
+const char TOTALS_MAGIC[4] = {'V', 'V', 'O', 'T'};
+
+const size_t JOURNAL_HEADER_SIZE = 8;
+const size_t RECORD_SIZE = 32 + 8 + 1 + 1 + 4;
+const size_t MIN_BLOOM_ENTRIES = 1024;
+const size_t TOTALS_SIZE = 4 + 4 * 8;
+
+void putU32(std::vector<char>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void putU64(std::vector<char>& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+uint32_t getU32(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint32_t>(u[0]) | (static_cast<uint32_t>(u[1]) << 8) |
+           (static_cast<uint32_t>(u[2]) << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+uint64_t getU64(const char* p) {
+    return static_cast<uint64_t>(getU32(p)) | (static_cast<uint64_t>(getU32(p + 4)) << 32);
+}
+
+void putId(std::vector<char>& out, const ObjectId& id) {
+    out.insert(out.end(), reinterpret_cast<const char*>(id.begin()),
+               reinterpret_cast<const char*>(id.end()));
+}
+
+bool validLocation(uint8_t value) {
+    return value <= IndexEntry::PACKED;
+}
+
+ObjectType toType(uint8_t value) {
+    return value <= static_cast<uint8_t>(ObjectType::MANIFEST) ? static_cast<ObjectType>(value)
+                                                            : ObjectType::UNKNOWN;
+}
+
+// Holds flock() on the index's lock file for a scope. Callers hold the
+// index mutex exclusively first: threads of one process share the
+// descriptor, and flock() does not keep them out of each other's way.
+class FileLock {
+private:
+    int fd;
+    
+public:
+    FileLock(int descriptor, int operation) : fd(descriptor) { ::flock(fd, operation); }
+    ~FileLock() { ::flock(fd, LOCK_UN); }
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+};
+
+void account(IndexTotals& totals, const IndexEntry& entry, bool add) {
+    bool packed = entry.location == IndexEntry::PACKED;
+    uint64_t& objects = packed ? totals.packedObjects : totals.looseObjects;
+    uint64_t& bytes = packed ? totals.packedBytes : totals.looseBytes;
+    objects = add ? objects + 1 : objects - 1;
+    bytes = add ? bytes + entry.size : bytes - entry.size;
+}
+
+}
+
+BloomFilter::BloomFilter(size_t expected) : hashCount(HASH_COUNT) {
+    size_t wanted = std::max(expected, MIN_BLOOM_ENTRIES) * 10;
+    size_t bitCount = 64;
+    while (bitCount < wanted) {
+        bitCount <<= 1;
+    }
+    bits.assign(bitCount / 64, 0);
+    mask = bitCount - 1;
+}
+
+BloomFilter::BloomFilter(std::vector<uint64_t> words, uint32_t hashes)
+    : bits(std::move(words)), hashCount(hashes) {
+    mask = bits.size() * 64 - 1;
+}
+
+// Ids are already uniform hash output, so two of their words drive the
+// usual double-hashing scheme without any further mixing.
+void BloomFilter::add(const ObjectId& id) {
+    uint64_t h1, h2;
+    std::memcpy(&h1, id.data(), sizeof(h1));
+    std::memcpy(&h2, id.data() + 16, sizeof(h2));
+    h2 |= 1;
+    
+    for (uint32_t i = 0; i < hashCount; i++) {
+        uint64_t bit = (h1 + i * h2) & mask;
+        bits[bit >> 6] |= 1ULL << (bit & 63);
+    }
+}
+
+bool BloomFilter::mightContain(const ObjectId& id) const {
+    uint64_t h1, h2;
+    std::memcpy(&h1, id.data(), sizeof(h1));
+    std::memcpy(&h2, id.data() + 16, sizeof(h2));
+    h2 |= 1;
+    
+    for (uint32_t i = 0; i < hashCount; i++) {
+        uint64_t bit = (h1 + i * h2) & mask;
+        if ((bits[bit >> 6] & (1ULL << (bit & 63))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+ObjectIndex::ObjectIndex(const std::string& directory)
+    : tablePath(directory + "/index"), journalPath(directory + "/index.log"),
+      lockPath(directory + "/index.lock"), lockFd(-1), journalOffset(0),
+      tableCount(0), liveCount(0), journalEntries(0), existed(false), lastRefresh(0) {
+    fs::create_directories(directory);
+    lockFd = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lockFd < 0) {
+        throw std::runtime_error("Cannot open index lock: " + lockPath);
+    }
+    
+    FileLock lock(lockFd, LOCK_EX);
+    tableIdentity = identify(tablePath);
+    loadTable();
+    replayJournal(true);
+    openJournal();
+    noteJournalWritten();
+}
+
+ObjectIndex::~ObjectIndex() {
+    journal.close();
+    ::close(lockFd);
+}
+
+ObjectIndex::FileIdentity ObjectIndex::identify(const std::string& path) {
+    FileIdentity identity;
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0) {
+        identity.device = static_cast<uint64_t>(st.st_dev);
+        identity.inode = static_cast<uint64_t>(st.st_ino);
+        identity.size = static_cast<uint64_t>(st.st_size);
+        identity.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    }
+    return identity;
+}
+
+// Table layout: "VVOI", version, entry count, bloom hash count, bloom word
+// count, name bytes, fanout[256], sorted 56-byte entries, the bloom words,
+// the concatenated original paths and finally "VVOT" and the totals.
+// Tables written before the totals existed end at the paths and have
+// them counted once on load.
+void ObjectIndex::loadTable() {
+    if (!fs::exists(tablePath)) {
+        return;
+    }
+    
+    ContentView mapped = ContentView::mapFile(tablePath);
+    if (mapped.size() < HEADER_SIZE || std::memcmp(mapped.data(), TABLE_MAGIC, 4) != 0 ||
+        getU32(mapped.data() + 4) != VERSION) {
+        return;
+    }
+    
+    uint32_t count = getU32(mapped.data() + 8);
+    uint32_t hashes = getU32(mapped.data() + 12);
+    uint32_t words = getU32(mapped.data() + 16);
+    uint32_t nameBytes = getU32(mapped.data() + 20);
+    size_t bloomOffset = HEADER_SIZE + static_cast<size_t>(count) * ENTRY_SIZE;
+    if (words == 0 || (words & (words - 1)) != 0 ||
+        mapped.size() < bloomOffset + static_cast<size_t>(words) * 8 + nameBytes) {
+        return;
+    }
+    
+    std::vector<uint64_t> bits(words);
+    for (uint32_t i = 0; i < words; i++) {
+        bits[i] = getU64(mapped.data() + bloomOffset + 8 * static_cast<size_t>(i));
+    }
+    
+    table = mapped;
+    tableCount = count;
+    liveCount = count;
+    bloom = BloomFilter(std::move(bits), hashes);
+    existed = true;
+    
+    const char* trailer = mapped.data() + bloomOffset + static_cast<size_t>(words) * 8 + nameBytes;
+    if (static_cast<size_t>(mapped.end() - trailer) >= TOTALS_SIZE &&
+        std::memcmp(trailer, TOTALS_MAGIC, 4) == 0) {
+        totals.looseObjects = getU64(trailer + 4);
+        totals.looseBytes = getU64(trailer + 12);
+        totals.packedObjects = getU64(trailer + 20);
+        totals.packedBytes = getU64(trailer + 28);
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            account(totals, decodeEntry(tableEntry(i)), true);
+        }
+    }
+}
+
+const char* ObjectIndex::tableEntry(uint32_t i) const {
+    return table.data() + HEADER_SIZE + static_cast<size_t>(i) * ENTRY_SIZE;
+}
+
+IndexEntry ObjectIndex::decodeEntry(const char* entry) const {
+    const char* names = table.data() + HEADER_SIZE + static_cast<size_t>(tableCount) * ENTRY_SIZE +
+                        static_cast<size_t>(getU32(table.data() + 16)) * 8;
+    
+    IndexEntry result;
+    result.size = getU64(entry + 32);
+    result.path.assign(names + getU32(entry + 40), getU32(entry + 44));
+    result.location = static_cast<IndexEntry::Location>(entry[48]);
+    result.type = toType(static_cast<uint8_t>(entry[49]));
+    return result;
+}
+
+bool ObjectIndex::findInTable(const ObjectId& id, IndexEntry& entry) const {
+    if (tableCount == 0) {
+        return false;
+    }
+    
+    const char* fanout = table.data() + 24;
+    uint32_t lo = id[0] == 0 ? 0 : getU32(fanout + 4 * (id[0] - 1));
+    uint32_t hi = getU32(fanout + 4 * id[0]);
+    
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = std::memcmp(tableEntry(mid), id.data(), id.size());
+        if (cmp == 0) {
+            entry = decodeEntry(tableEntry(mid));
+            return true;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+bool ObjectIndex::findLocked(const ObjectId& id, IndexEntry& entry) const {
+    if (!bloom.mightContain(id)) {
+        return false;
+    }
+    
+    auto it = recent.find(id);
+    if (it != recent.end()) {
+        entry = it->second;
+        return entry.location != IndexEntry::NONE;
+    }
+    return findInTable(id, entry) && entry.location != IndexEntry::NONE;
+}
+
+// Journal layout: "VVOJ", version, then records of id, size, location,
+// type, path length and path. Records from journalOffset on are applied.
+// With repair set, which takes the exclusive lock, a record cut short by
+// a crash is dropped and the file truncated back to the last complete one.
+void ObjectIndex::replayJournal(bool repair) {
+    if (!fs::exists(journalPath)) {
+        return;
+    }
+    
+    ContentView log = ContentView::mapFile(journalPath);
+    if (log.size() < JOURNAL_HEADER_SIZE || std::memcmp(log.data(), JOURNAL_MAGIC, 4) != 0 ||
+        getU32(log.data() + 4) != VERSION) {
+        log = ContentView();
+        if (repair) {
+            fs::remove(journalPath);
+        }
+        return;
+    }
+    existed = true;
+    
+    const char* p = log.data() + std::max<uint64_t>(journalOffset, JOURNAL_HEADER_SIZE);
+    const char* end = log.end();
+    while (static_cast<size_t>(end - p) >= RECORD_SIZE) {
+        uint32_t pathLength = getU32(p + 42);
+        if (static_cast<size_t>(end - p) < RECORD_SIZE + pathLength ||
+            !validLocation(static_cast<uint8_t>(p[40]))) {
+            break;
+        }
+        
+        ObjectId id(reinterpret_cast<const uint8_t*>(p));
+        IndexEntry entry(static_cast<IndexEntry::Location>(p[40]), toType(static_cast<uint8_t>(p[41])),
+                         getU64(p + 32), std::string(p + RECORD_SIZE, pathLength));
+        apply(id, entry);
+        p += RECORD_SIZE + pathLength;
+    }
+    
+    journalOffset = p - log.data();
+    
+    if (repair && p != end) {
+        log = ContentView();
+        fs::resize_file(journalPath, journalOffset);
+    }
+}
+
+void ObjectIndex::openJournal() {
+    bool fresh = !fs::exists(journalPath) || fs::file_size(journalPath) < JOURNAL_HEADER_SIZE;
+    journal.open(journalPath, fresh ? std::ios::binary | std::ios::trunc
+                                    : std::ios::binary | std::ios::app);
+    if (!journal.is_open()) {
+        throw std::runtime_error("Cannot open index journal: " + journalPath);
+    }
+    
+    if (fresh) {
+        std::vector<char> header(JOURNAL_MAGIC, JOURNAL_MAGIC + 4);
+        putU32(header, VERSION);
+        journal.write(header.data(), header.size());
+        journal.flush();
+    }
+}
+
+// Catches up with other processes. A replaced table means one of them
+// compacted, folding in and emptying the journal, so everything is loaded
+// again; otherwise only journal records past the last one read are
+// applied. Called with the mutex and the lock file held.
+void ObjectIndex::syncLocked(bool repair) {
+    FileIdentity currentTable = identify(tablePath);
+    if (!(currentTable == tableIdentity)) {
+        table = ContentView();
+        tableCount = 0;
+        liveCount = 0;
+        totals = IndexTotals();
+        recent.clear();
+        bloom = BloomFilter();
+        journalEntries = 0;
+        tableIdentity = currentTable;
+        loadTable();
+        journalOffset = 0;
+    }
+    
+    FileIdentity currentJournal = identify(journalPath);
+    if (!currentJournal.sameFile(journalIdentity)) {
+        journalOffset = 0;
+    }
+    if (currentJournal.size != journalOffset) {
+        replayJournal(repair);
+        currentJournal = identify(journalPath);
+    }
+    
+    // Appends must go to the journal everyone else reads, not one a
+    // compaction has since unlinked.
+    if (!currentJournal.sameFile(journalIdentity)) {
+        journal.close();
+        openJournal();
+        currentJournal = identify(journalPath);
+        journalOffset = std::max<uint64_t>(journalOffset, JOURNAL_HEADER_SIZE);
+    }
+    journalIdentity = currentJournal;
+}
+
+// Only valid with the lock file held exclusively, once this process's own
+// records are flushed: then everything in the journal has been applied.
+void ObjectIndex::noteJournalWritten() {
+    journalIdentity = identify(journalPath);
+    journalOffset = journalIdentity.size;
+}
+
+// A compaction replaces the journal along with the table, so the journal
+// alone tells whether anything changed.
+bool ObjectIndex::refresh() {
+    FileIdentity currentJournal = identify(journalPath);
+    {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        if (currentJournal.sameFile(journalIdentity) && currentJournal.size == journalOffset) {
+            return false;
+        }
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    FileLock shared(lockFd, LOCK_SH);
+    syncLocked(false);
+    return true;
+}
+
+bool ObjectIndex::refreshIfDue() {
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int64_t last = lastRefresh.load(std::memory_order_relaxed);
+    // One thread per interval gets through; the rest carry on without it.
+    if (now - last < REFRESH_INTERVAL ||
+        !lastRefresh.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+        return false;
+    }
+    return refresh();
+}
+
+void ObjectIndex::append(const ObjectId& id, const IndexEntry& entry) {
+    std::vector<char> record;
+    record.reserve(RECORD_SIZE + entry.path.size());
+    putId(record, id);
+    putU64(record, entry.size);
+    record.push_back(static_cast<char>(entry.location));
+    record.push_back(static_cast<char>(entry.type));
+    putU32(record, static_cast<uint32_t>(entry.path.size()));
+    record.insert(record.end(), entry.path.begin(), entry.path.end());
+    
+    journal.write(record.data(), record.size());
+    if (!journal) {
+        throw std::runtime_error("Cannot write index journal: " + journalPath);
+    }
+    
+    apply(id, entry);
+}
+
+void ObjectIndex::apply(const ObjectId& id, const IndexEntry& entry) {
+    IndexEntry previous;
+    bool wasLive = findLocked(id, previous);
+    bool isLive = entry.location != IndexEntry::NONE;
+    liveCount = liveCount + isLive - wasLive;
+    if (wasLive) {
+        account(totals, previous, false);
+    }
+    if (isLive) {
+        account(totals, entry, true);
+    }
+    
+    recent[id] = entry;
+    bloom.add(id);
+    journalEntries++;
+}
+
+bool ObjectIndex::contains(const ObjectId& id) const {
+    std::shared_lock<std::shared_mutex> lock(mtx);
+    IndexEntry entry;
+    return findLocked(id, entry);
+}
+
+bool ObjectIndex::lookup(const ObjectId& id, IndexEntry& entry) const {
+    std::shared_lock<std::shared_mutex> lock(mtx);
+    return findLocked(id, entry);
+}
+
+void ObjectIndex::put(const ObjectId& id, const IndexEntry& entry) {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    FileLock exclusive(lockFd, LOCK_EX);
+    syncLocked(true);
+    append(id, entry);
+    journal.flush();
+    noteJournalWritten();
+    compactIfNeeded();
+}
+
+void ObjectIndex::putAll(const std::vector<std::pair<ObjectId, IndexEntry>>& entries) {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    FileLock exclusive(lockFd, LOCK_EX);
+    syncLocked(true);
+    for (const auto& pair : entries) {
+        append(pair.first, pair.second);
+    }
+    journal.flush();
+    noteJournalWritten();
+    compactIfNeeded();
+}
+
+void ObjectIndex::remove(const ObjectId& id) {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    FileLock exclusive(lockFd, LOCK_EX);
+    syncLocked(true);
+    IndexEntry existing;
+    if (!findLocked(id, existing)) {
+        return;
+    }
+    append(id, IndexEntry());
+    journal.flush();
+    noteJournalWritten();
+}
+
+void ObjectIndex::removeAll(const std::vector<ObjectId>& ids) {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    FileLock exclusive(lockFd, LOCK_EX);
+    syncLocked(true);
+    for (const ObjectId& id : ids) {
+        IndexEntry existing;
+        if (findLocked(id, existing)) {
+            append(id, IndexEntry());
+        }
+    }
+    journal.flush();
+    noteJournalWritten();
+    compactIfNeeded();
+}
+
+void ObjectIndex::compactIfNeeded() {
+    size_t threshold = std::max(MIN_COMPACT_ENTRIES, static_cast<size_t>(tableCount) / 4);
+    if (journalEntries >= threshold || tableCount + recent.size() > bloom.capacity()) {
+        compactLocked();
+    }
+}
+
+void ObjectIndex::compact() {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    FileLock exclusive(lockFd, LOCK_EX);
+    syncLocked(true);
+    compactLocked();
+}
+
+void ObjectIndex::compactLocked() {
+    std::vector<std::pair<ObjectId, IndexEntry>> live;
+    live.reserve(tableCount + recent.size());
+    for (uint32_t i = 0; i < tableCount; i++) {
+        ObjectId id(reinterpret_cast<const uint8_t*>(tableEntry(i)));
+        if (recent.find(id) == recent.end()) {
+            live.emplace_back(id, decodeEntry(tableEntry(i)));
+        }
+    }
+    for (const auto& pair : recent) {
+        if (pair.second.location != IndexEntry::NONE) {
+            live.push_back(pair);
+        }
+    }
+    std::sort(live.begin(), live.end(),
+        [](const std::pair<ObjectId, IndexEntry>& a, const std::pair<ObjectId, IndexEntry>& b) {
+            return a.first < b.first;
+        });
+    
+    // Leave headroom so the filter stays accurate while the journal refills.
+    BloomFilter rebuilt(live.size() * 2);
+    uint32_t fanout[256] = {0};
+    std::vector<char> names;
+    IndexTotals counted;
+    for (const auto& pair : live) {
+        rebuilt.add(pair.first);
+        account(counted, pair.second, true);
+        fanout[pair.first[0]]++;
+        names.insert(names.end(), pair.second.path.begin(), pair.second.path.end());
+    }
+    
+    std::vector<char> out(TABLE_MAGIC, TABLE_MAGIC + 4);
+    out.reserve(HEADER_SIZE + live.size() * ENTRY_SIZE + rebuilt.getWords().size() * 8 + names.size() +
+                TOTALS_SIZE);
+    putU32(out, VERSION);
+    putU32(out, static_cast<uint32_t>(live.size()));
+    putU32(out, rebuilt.getHashCount());
+    putU32(out, static_cast<uint32_t>(rebuilt.getWords().size()));
+    putU32(out, static_cast<uint32_t>(names.size()));
+    
+    uint32_t running = 0;
+    for (int i = 0; i < 256; i++) {
+        running += fanout[i];
+        putU32(out, running);
+    }
+    
+    uint32_t nameOffset = 0;
+    for (const auto& pair : live) {
+        putId(out, pair.first);
+        putU64(out, pair.second.size);
+        putU32(out, nameOffset);
+        putU32(out, static_cast<uint32_t>(pair.second.path.size()));
+        out.push_back(static_cast<char>(pair.second.location));
+        out.push_back(static_cast<char>(pair.second.type));
+        out.insert(out.end(), 6, 0);
+        nameOffset += static_cast<uint32_t>(pair.second.path.size());
+    }
+    for (uint64_t word : rebuilt.getWords()) {
+        putU64(out, word);
+    }
+    out.insert(out.end(), names.begin(), names.end());
+    out.insert(out.end(), TOTALS_MAGIC, TOTALS_MAGIC + 4);
+    putU64(out, counted.looseObjects);
+    putU64(out, counted.looseBytes);
+    putU64(out, counted.packedObjects);
+    putU64(out, counted.packedBytes);
+    
+    std::string tmpPath = tablePath + ".tmp";
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot create object index: " + tablePath);
+    }
+    file.write(out.data(), out.size());
+    file.close();
+    if (!file) {
+        fs::remove(tmpPath);
+        throw std::runtime_error("Cannot write object index: " + tablePath);
+    }
+    
+    // The table is replaced before the journal is emptied, so a crash in
+    // between only replays entries the new table already holds.
+    table = ContentView();
+    fs::rename(tmpPath, tablePath);
+    table = ContentView::mapFile(tablePath);
+    tableIdentity = identify(tablePath);
+    tableCount = static_cast<uint32_t>(live.size());
+    liveCount = live.size();
+    totals = counted;
+    bloom = std::move(rebuilt);
+    
+    recent.clear();
+    journalEntries = 0;
+    journal.close();
+    fs::remove(journalPath);
+    openJournal();
+    noteJournalWritten();
+    existed = true;
+}
+
+size_t ObjectIndex::size() const {
+    std::shared_lock<std::shared_mutex> lock(mtx);
+    return liveCount;
+}
+
+IndexTotals ObjectIndex::getTotals() const {
+    std::shared_lock<std::shared_mutex> lock(mtx);
+    return totals;
+}
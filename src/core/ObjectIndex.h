@@ -0,0 +1,185 @@
+#ifndef OBJECTINDEX_H
+#define OBJECTINDEX_H
+
+#include "FileObject.h"
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+
+class BloomFilter {
+private:
+    std::vector<uint64_t> bits;
+    uint64_t mask;
+    uint32_t hashCount;
+    
+public:
+    static const uint32_t HASH_COUNT = 7;
+    
+    // Sized at about ten bits per expected entry, roughly a 1% false
+    // positive rate until the filter is filled past its capacity.
+    explicit BloomFilter(size_t expected = 0);
+    BloomFilter(std::vector<uint64_t> words, uint32_t hashes);
+    
+    void add(const ObjectId& id);
+    bool mightContain(const ObjectId& id) const;
+    
+    size_t capacity() const { return bits.size() * 64 / 10; }
+    uint32_t getHashCount() const { return hashCount; }
+    const std::vector<uint64_t>& getWords() const { return bits; }
+};
+
+struct IndexEntry {
+    enum Location : uint8_t {
+        NONE = 0,
+        LOOSE = 1,
+        PACKED = 2
+    };
+    
+    Location location;
+    ObjectType type;
+    uint64_t size;
+    std::string path;
+    
+    IndexEntry() : location(NONE), type(ObjectType::UNKNOWN), size(0) {}
+    IndexEntry(Location l, ObjectType t, uint64_t s, const std::string& p)
+        : location(l), type(t), size(s), path(p) {}
+};
+
+// Running totals over the live entries, by where the objects live. Sizes
+// are those recorded in the entries: the object's own bytes, before any
+// compression a pack applies.
+struct IndexTotals {
+    uint64_t looseObjects = 0;
+    uint64_t looseBytes = 0;
+    uint64_t packedObjects = 0;
+    uint64_t packedBytes = 0;
+};
+
+// Persistent map from object id to where the object lives, what it is and
+// the path it was stored from. The bulk of it is a sorted table that is
+// mapped rather than parsed on open; entries added since the table was
+// written sit in memory and in an append-only journal, and are folded
+// into a new table by compact(). A Bloom filter over every id keeps
+// lookups of absent objects off the table and the filesystem.
+//
+// Several processes may share one index. Changes and compaction hold a
+// lock on a file next to the table, and first catch up with what the
+// others wrote; refresh() does the same for readers.
+class ObjectIndex {
+private:
+    static constexpr size_t MIN_COMPACT_ENTRIES = 4096;
+    
+    // Tells whether a file was replaced or grew since it was last read.
+    struct FileIdentity {
+        uint64_t device = 0;
+        uint64_t inode = 0;
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        
+        bool sameFile(const FileIdentity& other) const {
+            return device == other.device && inode == other.inode;
+        }
+        bool operator==(const FileIdentity& other) const {
+            return sameFile(other) && size == other.size && mtime == other.mtime;
+        }
+    };
+    
+    std::string tablePath;
+    std::string journalPath;
+    std::string lockPath;
+    int lockFd;
+    FileIdentity tableIdentity;
+    FileIdentity journalIdentity;
+    uint64_t journalOffset;
+    ContentView table;
+    uint32_t tableCount;
+    size_t liveCount;
+    IndexTotals totals;
+    std::unordered_map<ObjectId, IndexEntry> recent;
+    BloomFilter bloom;
+    std::ofstream journal;
+    size_t journalEntries;
+    bool existed;
+    // Steady-clock time of the last refreshIfDue() that went to the disk.
+    std::atomic<int64_t> lastRefresh;
+    mutable std::shared_mutex mtx;
+    
+    const char* tableEntry(uint32_t i) const;
+    IndexEntry decodeEntry(const char* entry) const;
+    bool findInTable(const ObjectId& id, IndexEntry& entry) const;
+    bool findLocked(const ObjectId& id, IndexEntry& entry) const;
+    
+    static FileIdentity identify(const std::string& path);
+    
+    void loadTable();
+    void replayJournal(bool repair);
+    void openJournal();
+    void syncLocked(bool repair);
+    void noteJournalWritten();
+    void append(const ObjectId& id, const IndexEntry& entry);
+    void apply(const ObjectId& id, const IndexEntry& entry);
+    void compactLocked();
+    void compactIfNeeded();
+    
+public:
+    static const uint32_t VERSION = 1;
+    static const size_t HEADER_SIZE = 24 + 256 * 4;
+    static const size_t ENTRY_SIZE = 32 + 8 + 4 + 4 + 8;
+    // Nanoseconds between the refreshes refreshIfDue() lets through.
+    static const int64_t REFRESH_INTERVAL = 100000000LL;
+    
+    explicit ObjectIndex(const std::string& directory);
+    ~ObjectIndex();
+    ObjectIndex(const ObjectIndex&) = delete;
+    ObjectIndex& operator=(const ObjectIndex&) = delete;
+    
+    // False when no index was found on disk, e.g. a store written before
+    // the index existed, so the caller knows to rebuild it.
+    bool existedOnDisk() const { return existed; }
+    
+    bool contains(const ObjectId& id) const;
+    bool lookup(const ObjectId& id, IndexEntry& entry) const;
+    
+    // Picks up what other processes changed since this index last looked.
+    // False, after one stat call, when nothing did.
+    bool refresh();
+    // refresh() at most once per REFRESH_INTERVAL and false otherwise, for
+    // callers that must answer misses from memory: a run of them costs one
+    // stat call per interval, not one each.
+    bool refreshIfDue();
+    
+    void put(const ObjectId& id, const IndexEntry& entry);
+    void putAll(const std::vector<std::pair<ObjectId, IndexEntry>>& entries);
+    void remove(const ObjectId& id);
+    void removeAll(const std::vector<ObjectId>& ids);
+    
+    void compact();
+    size_t size() const;
+    // Kept up to date by every change and stored with the table, so this
+    // never has to look at the entries.
+    IndexTotals getTotals() const;
+    
+    // Visits every live entry in no particular order under a shared lock;
+    // func must not modify the index.
+    template<typename Func>
+    void forEach(Func&& func) const {
+        std::shared_lock<std::shared_mutex> lock(mtx);
+        for (uint32_t i = 0; i < tableCount; i++) {
+            ObjectId id(reinterpret_cast<const uint8_t*>(tableEntry(i)));
+            if (recent.find(id) == recent.end()) {
+                func(id, decodeEntry(tableEntry(i)));
+            }
+        }
+        for (const auto& pair : recent) {
+            if (pair.second.location != IndexEntry::NONE) {
+                func(pair.first, pair.second);
+            }
+        }
+    }
+};
+
+#endif
@@ -1,140 +1,844 @@
 #include "ObjectStore.h"
+#include "Metrics.h"
+#include "ThreadPool.h"
+#include <cerrno>
+#include <cstring>
+#include <ctime>
 #include <filesystem>
 #include <fstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
-ObjectStore* ObjectStore::instance = nullptr;
+std::atomic<ObjectStore*> ObjectStore::instance(nullptr);
 std::mutex ObjectStore::mtx;
 
-ObjectStore::ObjectStore(const std::string& path) 
-    : storePath(path), objectPool(2000) {
+namespace {
+
+const char MANIFEST_MAGIC[4] = {'V', 'V', 'M', 'F'};
+const uint32_t MANIFEST_VERSION = 1;
+const size_t MANIFEST_HEADER_SIZE = 20;
+const size_t MANIFEST_ENTRY_SIZE = ObjectId::SIZE + 4;
+
+// Objects removed from the index and the disk per hold of the rescue lock.
+const size_t SWEEP_BATCH_SIZE = 256;
+
+void putU32(std::vector<char>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void putU64(std::vector<char>& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+uint32_t getU32(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint32_t>(u[0]) | (static_cast<uint32_t>(u[1]) << 8) |
+           (static_cast<uint32_t>(u[2]) << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+uint64_t getU64(const char* p) {
+    return static_cast<uint64_t>(getU32(p)) | (static_cast<uint64_t>(getU32(p + 4)) << 32);
+}
+
+// Checks the header and that the manifest holds all of its chunk entries.
+bool readManifestHeader(const ContentView& manifest, uint32_t& count, uint64_t& total) {
+    if (manifest.size() < MANIFEST_HEADER_SIZE ||
+        std::memcmp(manifest.data(), MANIFEST_MAGIC, 4) != 0 ||
+        getU32(manifest.data() + 4) != MANIFEST_VERSION) {
+        return false;
+    }
+    count = getU32(manifest.data() + 8);
+    total = getU64(manifest.data() + 12);
+    return manifest.size() >= MANIFEST_HEADER_SIZE + static_cast<size_t>(count) * MANIFEST_ENTRY_SIZE;
+}
+
+const char* manifestEntry(const ContentView& manifest, uint32_t i) {
+    return manifest.data() + MANIFEST_HEADER_SIZE + static_cast<size_t>(i) * MANIFEST_ENTRY_SIZE;
+}
+
+}
+
+ObjectStore::ObjectStore(const std::string& path, const CacheConfig& cache, HashAlgorithm requested)
+    : storePath(path), format(HashAlgorithm::SHA256), objectCache(path, cache), index(path),
+      young(path), writer(index, young, path), packFileBytes(0), collecting(false) {
+    loadPacks();
+    if (!index.existedOnDisk()) {
+        rebuildIndex();
+    }
+    format = loadFormat(requested);
+    FileObject::setHashAlgorithm(format);
+}
+
+// Stores without a format file are SHA-256, which is what every store was
+// before formats were recorded, so only other formats are written down.
+HashAlgorithm ObjectStore::loadFormat(HashAlgorithm requested) {
+    std::string formatPath = getFormatPath();
+    std::ifstream in(formatPath);
+    if (in.is_open()) {
+        std::string name;
+        HashAlgorithm recorded;
+        in >> name;
+        if (!Hasher::parseName(name, recorded) || recorded == HashAlgorithm::SHA1) {
+            throw std::runtime_error("Unknown object format in " + formatPath + ": " + name);
+        }
+        return recorded;
+    }
+    
+    IndexTotals totals = index.getTotals();
+    if (requested == HashAlgorithm::SHA256 || totals.looseObjects + totals.packedObjects > 0) {
+        return HashAlgorithm::SHA256;
+    }
+    if (requested == HashAlgorithm::SHA1) {
+        throw std::runtime_error("SHA-1 is not an object format: " + storePath);
+    }
+    
     fs::create_directories(storePath);
+    std::ofstream out(formatPath, std::ios::trunc);
+    out << Hasher::name(requested) << '\n';
+    out.close();
+    if (!out) {
+        throw std::runtime_error("Cannot write object format: " + formatPath);
+    }
+    return requested;
 }
 
-ObjectStore* ObjectStore::getInstance(const std::string& path) {
-    if (instance == nullptr) {
-        std::lock_guard<std::mutex> lock(mtx);
-        if (instance == nullptr) {
-            std::string actualPath = path.empty() ? ".vv/objects" : path;
-            instance = new ObjectStore(actualPath);
+void ObjectStore::loadPacks() {
+    packs.clear();
+    packFileBytes = 0;
+    
+    std::string packDir = getPackDirectory();
+    if (!fs::is_directory(packDir)) {
+        return;
+    }
+    
+    for (const auto& entry : fs::directory_iterator(packDir)) {
+        if (entry.path().extension() != ".idx") {
+            continue;
+        }
+        
+        fs::path packFile = entry.path();
+        packFile.replace_extension(".pack");
+        if (!fs::exists(packFile)) {
+            continue;
         }
+        
+        packs.push_back(std::make_unique<PackFile>(packFile.string(), entry.path().string()));
+        packFileBytes += fs::file_size(packFile) + entry.file_size();
     }
-    return instance;
 }
 
-std::string ObjectStore::getObjectPath(const std::string& hash) {
-    std::string dir = hash.substr(0, 2);
-    std::string file = hash.substr(2);
-    return storePath + "/" + dir + "/" + file;
+// Packs that other processes on the same store wrote since this one
+// looked. False when there were none.
+bool ObjectStore::loadNewPacks() {
+    std::string packDir = getPackDirectory();
+    if (!fs::is_directory(packDir)) {
+        return false;
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(packMutex);
+    std::unordered_set<std::string> known;
+    for (const auto& pack : packs) {
+        known.insert(pack->getPath());
+    }
+    
+    bool found = false;
+    for (const auto& entry : fs::directory_iterator(packDir)) {
+        if (entry.path().extension() != ".idx") {
+            continue;
+        }
+        
+        fs::path packFile = entry.path();
+        packFile.replace_extension(".pack");
+        if (known.count(packFile.string()) || !fs::exists(packFile)) {
+            continue;
+        }
+        
+        packs.push_back(std::make_unique<PackFile>(packFile.string(), entry.path().string()));
+        packFileBytes += fs::file_size(packFile) + entry.file_size();
+        found = true;
+    }
+    return found;
 }
 
-std::string ObjectStore::storeObject(FileObject& obj) {
-    std::string hash = obj.getHash();
+// Stores written before the index existed keep their objects but not the
+// paths they came from; those entries fall back to type detection.
+void ObjectStore::rebuildIndex() {
+    std::vector<std::pair<ObjectId, IndexEntry>> entries;
+    std::string packDir = getPackDirectory();
     
-    if (hasObject(hash)) {
-        return hash;
+    for (const auto& dir : fs::directory_iterator(storePath)) {
+        std::string prefix = dir.path().filename().string();
+        if (!dir.is_directory() || prefix.size() != 2 || dir.path() == packDir) {
+            continue;
+        }
+        
+        for (const auto& entry : fs::directory_iterator(dir.path())) {
+            ObjectId id;
+            if (entry.is_regular_file() && ObjectId::parse(prefix + entry.path().filename().string(), id)) {
+                entries.emplace_back(id, IndexEntry(IndexEntry::LOOSE, ObjectType::UNKNOWN,
+                                                    entry.file_size(), ""));
+            }
+        }
+    }
+    
+    for (const auto& pack : packs) {
+        pack->forEach([&entries](const ObjectId& id) {
+            entries.emplace_back(id, IndexEntry(IndexEntry::PACKED, ObjectType::UNKNOWN, 0, ""));
+        });
     }
     
-    std::vector<char> content = obj.readContent();
-    objectPool.store(hash, content);
+    index.putAll(entries);
+    index.compact();
+}
+
+bool ObjectStore::findInPacks(const ObjectId& id, std::vector<char>& content) {
+    {
+        std::shared_lock<std::shared_mutex> lock(packMutex);
+        for (const auto& pack : packs) {
+            if (pack->read(id, content)) {
+                return true;
+            }
+        }
+    }
     
-    std::string objPath = getObjectPath(hash);
-    fs::create_directories(fs::path(objPath).parent_path());
+    if (!loadNewPacks()) {
+        return false;
+    }
+    std::shared_lock<std::shared_mutex> lock(packMutex);
+    for (const auto& pack : packs) {
+        if (pack->read(id, content)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t ObjectStore::getPackCount() const {
+    std::shared_lock<std::shared_mutex> lock(packMutex);
+    return packs.size();
+}
+
+ObjectStore* ObjectStore::getInstance(const std::string& path, const CacheConfig& cache,
+                                      HashAlgorithm format) {
+    ObjectStore* store = instance.load(std::memory_order_acquire);
+    if (store == nullptr) {
+        std::lock_guard<std::mutex> lock(mtx);
+        store = instance.load(std::memory_order_relaxed);
+        if (store == nullptr) {
+            std::string actualPath = path.empty() ? ".vv/objects" : path;
+            store = new ObjectStore(actualPath, cache, format);
+            instance.store(store, std::memory_order_release);
+        }
+    }
+    return store;
+}
+
+std::string ObjectStore::getObjectPath(const ObjectId& id) const {
+    std::string path;
+    path.reserve(storePath.size() + ObjectId::HEX_SIZE + 2);
+    path += storePath;
+    path += '/';
+    
+    char hex[ObjectId::HEX_SIZE];
+    id.formatHex(hex);
+    path.append(hex, 2);
+    path += '/';
+    path.append(hex + 2, ObjectId::HEX_SIZE - 2);
+    return path;
+}
+
+// For retrieval, where a miss is rare and worth a look at the disk. The
+// index only knows what this process has seen: objects other processes
+// stored since are picked up by refreshing it, and a loose file with no
+// entry at all is still found at its path, as before the index.
+bool ObjectStore::findObject(const ObjectId& id, IndexEntry& entry) {
+    if (index.lookup(id, entry) || (index.refresh() && index.lookup(id, entry))) {
+        return true;
+    }
+    
+    struct stat st;
+    if (::stat(getObjectPath(id).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    entry = IndexEntry(IndexEntry::LOOSE, ObjectType::UNKNOWN, static_cast<uint64_t>(st.st_size), "");
+    return true;
+}
+
+bool ObjectStore::readStoredObject(const ObjectId& id, const IndexEntry& entry, ContentView& content) {
+    std::vector<char> packed;
+    if (entry.location == IndexEntry::PACKED) {
+        if (!findInPacks(id, packed)) {
+            return false;
+        }
+        VV_COUNT(BYTES_READ, packed.size());
+        content = ContentView::fromBuffer(std::move(packed));
+        return true;
+    }
     
-    std::ofstream outFile(objPath, std::ios::binary);
-    if (!outFile.is_open()) {
-        throw std::runtime_error("Cannot create object file: " + objPath);
+    try {
+        content = ContentView::mapFile(getObjectPath(id));
+    } catch (const std::runtime_error&) {
+        // A concurrent repack may have just moved it into a pack.
+        if (!findInPacks(id, packed)) {
+            return false;
+        }
+        VV_COUNT(BYTES_READ, packed.size());
+        content = ContentView::fromBuffer(std::move(packed));
+    }
+    return true;
+}
+
+// Objects still waiting in the writer are served from memory; checking
+// them first means an object is never missed while it moves to disk.
+bool ObjectStore::loadObject(const ObjectId& id, IndexEntry& entry, ContentView& content) {
+    if (writer.findPending(id, entry, content)) {
+        return true;
+    }
+    return findObject(id, entry) && readStoredObject(id, entry, content);
+}
+
+// Each chunk is stored as an object of its own, so versions of a large
+// file share every chunk outside the regions that changed. The file's id
+// then names a manifest listing the chunk ids in order.
+void ObjectStore::storeChunked(const ObjectId& id, FileObject& obj, const ContentView& content) {
+    std::vector<std::pair<size_t, size_t>> chunks = chunker.split(content);
+    std::vector<ContentView> chunkViews;
+    chunkViews.reserve(chunks.size());
+    for (const auto& chunk : chunks) {
+        chunkViews.push_back(content.slice(chunk.first, chunk.second));
     }
+    std::vector<ObjectId> chunkIds = Hasher::hashMany(format, chunkViews);
     
-    outFile.write(content.data(), content.size());
-    outFile.close();
+    ThreadPool::shared().parallelFor(chunks.size(), [&](size_t i) {
+        noteStored(chunkIds[i]);
+        if (!writer.isPending(chunkIds[i]) &&
+            !(index.contains(chunkIds[i]) && freshen(chunkIds[i]))) {
+            writer.submit(chunkIds[i], getObjectPath(chunkIds[i]), chunkViews[i],
+                          IndexEntry(IndexEntry::LOOSE, ObjectType::CHUNK, chunks[i].second, ""));
+        }
+    });
     
-    hashToPath[hash] = obj.filepath;
+    std::vector<char> manifest(MANIFEST_MAGIC, MANIFEST_MAGIC + 4);
+    putU32(manifest, MANIFEST_VERSION);
+    putU32(manifest, static_cast<uint32_t>(chunks.size()));
+    putU64(manifest, content.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        manifest.insert(manifest.end(), reinterpret_cast<const char*>(chunkIds[i].begin()),
+                        reinterpret_cast<const char*>(chunkIds[i].end()));
+        putU32(manifest, static_cast<uint32_t>(chunks[i].second));
+    }
     
-    return hash;
+    // Indexed at its own size, as every other object is, so the storage
+    // totals count the chunks' bytes once.
+    size_t manifestSize = manifest.size();
+    writer.submit(id, getObjectPath(id), ContentView::fromBuffer(std::move(manifest)),
+                  IndexEntry(IndexEntry::LOOSE, ObjectType::MANIFEST, manifestSize, obj.filepath));
 }
 
-std::unique_ptr<FileObject> ObjectStore::retrieveObject(const std::string& hash) {
-    std::vector<char> content;
+bool ObjectStore::assembleChunks(const ContentView& manifest, std::vector<char>& content) {
+    uint32_t count;
+    uint64_t total;
+    if (!readManifestHeader(manifest, count, total)) {
+        return false;
+    }
     
-    if (objectPool.retrieve(hash, content)) {
-        auto it = hashToPath.find(hash);
-        std::string path = (it != hashToPath.end()) ? it->second : "temp";
+    content.resize(total);
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const char* entry = manifestEntry(manifest, i);
+        ObjectId chunkId(reinterpret_cast<const uint8_t*>(entry));
+        uint32_t length = getU32(entry + ObjectId::SIZE);
         
-        auto obj = FileFactory::createFileObject(path);
-        obj->writeContent(content);
-        return obj;
+        IndexEntry chunkEntry;
+        ContentView chunk;
+        if (!loadObject(chunkId, chunkEntry, chunk) ||
+            chunk.size() != length || offset + length > total) {
+            return false;
+        }
+        std::memcpy(content.data() + offset, chunk.data(), length);
+        offset += length;
     }
+    return offset == total;
+}
+
+ObjectId ObjectStore::storeObject(FileObject& obj) {
+    VV_TIME(STORE_OBJECT);
+    ObjectId hash = obj.getId();
+    noteStored(hash);
     
-    std::string objPath = getObjectPath(hash);
-    if (!fs::exists(objPath)) {
-        return nullptr;
+    if (hasObject(hash) && freshen(hash)) {
+        VV_COUNT(OBJECTS_DEDUPLICATED, 1);
+        return hash;
     }
+    VV_COUNT(OBJECTS_STORED, 1);
     
-    std::ifstream inFile(objPath, std::ios::binary | std::ios::ate);
-    if (!inFile.is_open()) {
-        return nullptr;
+    // Mapped content is written straight from the page cache and left out
+    // of the pool, which only keeps snapshots that cannot change under it.
+    ContentView content = obj.viewContent();
+    if (!content.isMapped()) {
+        content = content.retain();
+        objectCache.store(hash, content);
     }
     
-    size_t size = inFile.tellg();
-    inFile.seekg(0, std::ios::beg);
+    if (obj.isBinary() && content.size() >= CHUNK_THRESHOLD) {
+        storeChunked(hash, obj, content);
+        return hash;
+    }
     
-    content.resize(size);
-    inFile.read(content.data(), size);
-    inFile.close();
+    writer.submit(hash, getObjectPath(hash), content,
+                  IndexEntry(IndexEntry::LOOSE, obj.getType(), content.size(), obj.filepath));
     
-    objectPool.store(hash, content);
+    return hash;
+}
+
+std::unique_ptr<FileObject> ObjectStore::retrieveObject(const ObjectId& hash) {
+    VV_TIME(RETRIEVE_OBJECT);
+    IndexEntry entry;
+    ContentView content;
+    bool pending = writer.findPending(hash, entry, content);
+    if (!pending && !findObject(hash, entry)) {
+        return nullptr;
+    }
+    
+    if (!pending && objectCache.retrieve(hash, content)) {
+        VV_COUNT(POOL_HITS, 1);
+    } else {
+        if (!pending) {
+            VV_COUNT(POOL_MISSES, 1);
+            if (!readStoredObject(hash, entry, content)) {
+                return nullptr;
+            }
+        }
+        
+        if (entry.type == ObjectType::MANIFEST) {
+            std::vector<char> assembled;
+            if (!assembleChunks(content, assembled)) {
+                return nullptr;
+            }
+            content = ContentView::fromBuffer(std::move(assembled));
+        }
+        
+        objectCache.store(hash, content);
+    }
     
-    auto it = hashToPath.find(hash);
-    std::string path = (it != hashToPath.end()) ? it->second : "temp";
+    std::string path = entry.path.empty() ? "temp" : entry.path;
     
-    auto obj = FileFactory::createFileObject(path);
+    auto obj = FileFactory::createFileObject(path, entry.type);
     obj->writeContent(content);
+    VV_COUNT(OBJECTS_RETRIEVED, 1);
     return obj;
 }
 
-bool ObjectStore::hasObject(const std::string& hash) {
-    if (objectPool.contains(hash)) {
-        return true;
+// The pool is not consulted: a retrieve racing a collection may put back
+// content whose object has just been deleted. Misses are answered by the
+// Bloom filter, so staging new objects stays off the filesystem; what other
+// processes stored shows up within one refresh interval, and until then at
+// worst gets written a second time.
+bool ObjectStore::hasObject(const ObjectId& hash) {
+    return writer.isPending(hash) || index.contains(hash) ||
+           (index.refreshIfDue() && index.contains(hash));
+}
+
+void ObjectStore::flush() {
+    std::vector<ObjectId> failed;
+    std::string error;
+    if (writer.flush(failed, error)) {
+        return;
     }
     
-    std::string objPath = getObjectPath(hash);
-    return fs::exists(objPath);
+    // The pool may still hold the content, which would otherwise let
+    // hasObject() report an object that never reached the disk.
+    for (const ObjectId& id : failed) {
+        objectCache.erase(id);
+    }
+    throw std::runtime_error(error);
 }
 
-void ObjectStore::compressObject(const std::string& hash) {
+std::vector<ObjectId> ObjectStore::storeObjects(const std::vector<FileObject*>& objects) {
+    std::vector<ObjectId> hashes(objects.size());
+    FileObject::computeIds(objects);
+    
+    ThreadPool::shared().parallelFor(objects.size(), [&](size_t i) {
+        hashes[i] = storeObject(*objects[i]);
+    });
+    flush();
+    
+    return hashes;
 }
 
-void ObjectStore::decompressObject(const std::string& hash) {
+std::vector<ObjectId> ObjectStore::storeObjects(std::vector<FileValue>& files) {
+    std::vector<ObjectId> hashes(files.size());
+    FileObject::computeIds(files);
+    
+    ThreadPool::shared().parallelFor(files.size(), [&](size_t i) {
+        hashes[i] = storeObject(asFileObject(files[i]));
+    });
+    flush();
+    
+    return hashes;
 }
 
-size_t ObjectStore::getStorageSize() const {
-    size_t totalSize = 0;
+std::vector<std::unique_ptr<FileObject>> ObjectStore::retrieveObjects(
+    const std::vector<ObjectId>& hashes) {
     
-    for (const auto& entry : fs::recursive_directory_iterator(storePath)) {
-        if (entry.is_regular_file()) {
-            totalSize += entry.file_size();
+    std::vector<std::unique_ptr<FileObject>> objects(hashes.size());
+    
+    // Each hash is checked out once; repeats would write the same path from
+    // several threads, so they just open the file the first one produced.
+    std::unordered_map<ObjectId, size_t> first;
+    std::vector<size_t> unique;
+    for (size_t i = 0; i < hashes.size(); i++) {
+        if (first.emplace(hashes[i], i).second) {
+            unique.push_back(i);
         }
     }
     
-    return totalSize;
+    ThreadPool::shared().parallelFor(unique.size(), [&](size_t u) {
+        objects[unique[u]] = retrieveObject(hashes[unique[u]]);
+    });
+    
+    for (size_t i = 0; i < hashes.size(); i++) {
+        size_t origin = first[hashes[i]];
+        if (origin != i && objects[origin]) {
+            objects[i] = FileFactory::createFileObject(objects[origin]->getPath());
+        }
+    }
+    
+    return objects;
 }
 
-void ObjectStore::cleanup(int daysOld) {
-    auto now = fs::file_time_type::clock::now();
+size_t ObjectStore::repack() {
+    std::lock_guard<std::mutex> gcLock(gcMutex);
+    flush();
+    std::string packDir = getPackDirectory();
+    PackWriter writer(packDir);
+    std::vector<fs::path> loose;
+    std::vector<std::pair<ObjectId, IndexEntry>> moved;
     
-    for (const auto& entry : fs::recursive_directory_iterator(storePath)) {
-        if (entry.is_regular_file()) {
-            auto ftime = fs::last_write_time(entry);
-            auto age = std::chrono::duration_cast<std::chrono::hours>(now - ftime).count() / 24;
+    for (const auto& dir : fs::directory_iterator(storePath)) {
+        std::string prefix = dir.path().filename().string();
+        if (!dir.is_directory() || prefix.size() != 2 || dir.path() == packDir) {
+            continue;
+        }
+        
+        for (const auto& entry : fs::directory_iterator(dir.path())) {
+            ObjectId id;
+            std::string hex = prefix + entry.path().filename().string();
+            if (!entry.is_regular_file() || !ObjectId::parse(hex, id)) {
+                continue;
+            }
+            
+            IndexEntry indexed;
+            index.lookup(id, indexed);
+            writer.add(id, entry.path().string(), entry.file_size(), indexed.path);
+            loose.push_back(entry.path());
             
-            if (age > daysOld) {
-                fs::remove(entry.path());
+            indexed.location = IndexEntry::PACKED;
+            indexed.size = entry.file_size();
+            moved.emplace_back(id, indexed);
+        }
+    }
+    
+    if (loose.empty()) {
+        return 0;
+    }
+    
+    std::string name = writer.finish();
+    {
+        std::unique_lock<std::shared_mutex> lock(packMutex);
+        packs.push_back(std::make_unique<PackFile>(name + ".pack", name + ".idx"));
+        packFileBytes += fs::file_size(name + ".pack") + fs::file_size(name + ".idx");
+    }
+    index.putAll(moved);
+    index.compact();
+    
+    for (const auto& path : loose) {
+        fs::remove(path);
+        std::error_code ec;
+        fs::remove(path.parent_path(), ec);
+    }
+    
+    return loose.size();
+}
+
+size_t ObjectStore::getStorageSize() const {
+    StorageStats stats = getStorageStats();
+    return static_cast<size_t>(stats.looseBytes + stats.packFileBytes);
+}
+
+StorageStats ObjectStore::getStorageStats() const {
+    IndexTotals totals = index.getTotals();
+    StorageStats stats;
+    stats.objects = totals.looseObjects + totals.packedObjects;
+    stats.looseObjects = totals.looseObjects;
+    stats.looseBytes = totals.looseBytes;
+    stats.packedObjects = totals.packedObjects;
+    stats.packedBytes = totals.packedBytes;
+    stats.packFileBytes = packFileBytes.load();
+    return stats;
+}
+
+void ObjectStore::noteStored(const ObjectId& id) {
+    if (collecting.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(rescueMutex);
+        rescued.insert(id);
+    }
+}
+
+// Collections in other processes keep unreachable loose objects whose
+// files are recent, so a store that finds its object already there makes
+// the file recent, as git does. The path is looked up before the time is
+// set, so a collection can move the file aside in between; it is checked
+// again afterwards. False when the object turns out to be gone, and it
+// has to be written again.
+bool ObjectStore::freshen(const ObjectId& id) {
+    IndexEntry entry;
+    if (writer.isPending(id)) {
+        return true;
+    }
+    if (!index.lookup(id, entry)) {
+        return false;
+    }
+    if (entry.location != IndexEntry::LOOSE) {
+        return true;
+    }
+    
+    std::string path = getObjectPath(id);
+    struct stat st;
+    if (::utimensat(AT_FDCWD, path.c_str(), nullptr, 0) != 0 && errno == ENOENT) {
+        return false;
+    }
+    return ::stat(path.c_str(), &st) == 0 || errno != ENOENT;
+}
+
+// Manifests are the only objects that reference others. Stores written
+// before the index existed have no types recorded, so those objects are
+// checked for a manifest header instead.
+void ObjectStore::markChunks(const ObjectId& id, std::vector<ObjectId>& chunks) {
+    IndexEntry entry;
+    if (!index.lookup(id, entry) ||
+        (entry.type != ObjectType::MANIFEST && entry.type != ObjectType::UNKNOWN)) {
+        return;
+    }
+    
+    ContentView manifest;
+    uint32_t count;
+    uint64_t total;
+    if (!readStoredObject(id, entry, manifest) || !readManifestHeader(manifest, count, total)) {
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        chunks.emplace_back(reinterpret_cast<const uint8_t*>(manifestEntry(manifest, i)));
+    }
+}
+
+// Lists every loose object on disk, indexed or not, and deletes temporary
+// files that writes which never finished left behind.
+void ObjectStore::scanLooseObjects(std::vector<ObjectId>& ids, std::chrono::seconds gracePeriod) {
+    std::string packDir = getPackDirectory();
+    auto cutoff = fs::file_time_type::clock::now() - gracePeriod;
+    
+    for (const auto& dir : fs::directory_iterator(storePath)) {
+        std::string prefix = dir.path().filename().string();
+        if (!dir.is_directory() || prefix.size() != 2 || dir.path() == packDir) {
+            continue;
+        }
+        
+        for (const auto& entry : fs::directory_iterator(dir.path())) {
+            std::string name = entry.path().filename().string();
+            ObjectId id;
+            if (ObjectId::parse(prefix + name, id)) {
+                ids.push_back(id);
+                continue;
+            }
+            
+            std::error_code ec;
+            if (name.find(".tmp") != std::string::npos && entry.is_regular_file(ec) &&
+                fs::last_write_time(entry.path(), ec) < cutoff && !ec) {
+                fs::remove(entry.path(), ec);
             }
         }
     }
 }
 
+// Only the loose objects added since the last run are candidates in an
+// incremental run. That is safe as a manifest is never older than its
+// chunks: an object only becomes young again by being stored anew after
+// a run deleted it, and no run deletes a chunk while keeping a manifest
+// that lists it, since the chunks of every kept candidate, every packed
+// manifest and, in a full run, every root are marked.
+GcStats ObjectStore::cleanup(const std::vector<ObjectId>& roots, const GcOptions& options) {
+    std::lock_guard<std::mutex> gcLock(gcMutex);
+    flush();
+    
+    struct Collecting {
+        ObjectStore& store;
+        
+        explicit Collecting(ObjectStore& s) : store(s) { store.collecting = true; }
+        ~Collecting() {
+            store.collecting = false;
+            std::lock_guard<std::mutex> lock(store.rescueMutex);
+            store.rescued.clear();
+        }
+    } collectingScope(*this);
+    
+    GcStats stats;
+    std::vector<ObjectId> candidates;
+    uint64_t mark;
+    stats.full = !young.begin(candidates, mark) || options.full;
+    if (stats.full) {
+        candidates.clear();
+        scanLooseObjects(candidates, options.gracePeriod);
+    }
+    std::unordered_set<ObjectId> candidateSet(candidates.begin(), candidates.end());
+    stats.scanned = candidateSet.size();
+    
+    ThreadPool& threads = ThreadPool::shared();
+    std::unordered_set<ObjectId> reachable(roots.begin(), roots.end());
+    auto markAll = [&](const std::vector<ObjectId>& ids) {
+        std::vector<std::vector<ObjectId>> chunks(ids.size());
+        threads.parallelFor(ids.size(), [&](size_t i) {
+            markChunks(ids[i], chunks[i]);
+        });
+        for (const auto& list : chunks) {
+            reachable.insert(list.begin(), list.end());
+        }
+    };
+    
+    // Mark: the chunks of the roots and, since packs are never rewritten
+    // here, of every packed manifest.
+    std::vector<ObjectId> marking;
+    for (const ObjectId& id : reachable) {
+        if (stats.full || candidateSet.count(id)) {
+            marking.push_back(id);
+        }
+    }
+    if (stats.full) {
+        index.forEach([&](const ObjectId& id, const IndexEntry& entry) {
+            if (entry.location == IndexEntry::PACKED && entry.type != ObjectType::CHUNK &&
+                !reachable.count(id)) {
+                marking.push_back(id);
+            }
+        });
+    }
+    markAll(marking);
+    
+    std::vector<ObjectId> unreachable;
+    for (const ObjectId& id : candidateSet) {
+        if (!reachable.count(id)) {
+            unreachable.push_back(id);
+        }
+    }
+    
+    enum Fate : uint8_t { MISSING, EXPIRED, YOUNG, IN_PACK };
+    std::vector<Fate> fates(unreachable.size(), MISSING);
+    std::vector<uint64_t> sizes(unreachable.size(), 0);
+    time_t cutoff = std::time(nullptr) - static_cast<time_t>(options.gracePeriod.count());
+    threads.parallelFor(unreachable.size(), [&](size_t i) {
+        IndexEntry entry;
+        if (index.lookup(unreachable[i], entry) && entry.location == IndexEntry::PACKED) {
+            fates[i] = IN_PACK;
+            return;
+        }
+        struct stat st;
+        if (::stat(getObjectPath(unreachable[i]).c_str(), &st) == 0) {
+            fates[i] = st.st_mtime > cutoff ? YOUNG : EXPIRED;
+            sizes[i] = static_cast<uint64_t>(st.st_size);
+        }
+    });
+    
+    // Whatever is kept keeps its chunks too.
+    std::vector<ObjectId> kept;
+    for (size_t i = 0; i < unreachable.size(); i++) {
+        if (fates[i] == YOUNG || fates[i] == IN_PACK) {
+            kept.push_back(unreachable[i]);
+        }
+    }
+    markAll(kept);
+    
+    // Sweep. An id stored since the run began is left alone; holding the
+    // rescue lock from the check until the file is gone means a store
+    // either rescues the object or finds it removed and writes it again.
+    // Stores in other processes only freshen the file, so each one is
+    // moved aside before its mtime is checked again: a store either
+    // freshened it in time or finds it gone and writes it again.
+    std::string asideSuffix = ".tmp-gc" + std::to_string(::getpid());
+    std::vector<ObjectId> survivors;
+    for (size_t start = 0; start < unreachable.size(); start += SWEEP_BATCH_SIZE) {
+        size_t end = std::min(unreachable.size(), start + SWEEP_BATCH_SIZE);
+        std::lock_guard<std::mutex> lock(rescueMutex);
+        
+        std::vector<size_t> batch;
+        std::vector<ObjectId> ids;
+        for (size_t i = start; i < end; i++) {
+            const ObjectId& id = unreachable[i];
+            if (fates[i] == YOUNG ||
+                (fates[i] == EXPIRED && (rescued.count(id) || writer.isPending(id)))) {
+                stats.retained++;
+                survivors.push_back(id);
+            } else if (fates[i] == EXPIRED && !reachable.count(id)) {
+                batch.push_back(i);
+                ids.push_back(id);
+            }
+        }
+        
+        std::vector<size_t> doomed;
+        std::vector<ObjectId> removing;
+        for (size_t k = 0; k < batch.size(); k++) {
+            std::string path = getObjectPath(ids[k]);
+            std::string aside = path + asideSuffix;
+            if (::rename(path.c_str(), aside.c_str()) != 0) {
+                if (errno == ENOENT) {
+                    removing.push_back(ids[k]);
+                }
+                continue;
+            }
+            
+            struct stat st;
+            if (::stat(aside.c_str(), &st) == 0 && st.st_mtime > cutoff) {
+                ::rename(aside.c_str(), path.c_str());
+                stats.retained++;
+                survivors.push_back(ids[k]);
+                continue;
+            }
+            doomed.push_back(batch[k]);
+            removing.push_back(ids[k]);
+        }
+        
+        index.removeAll(removing);
+        for (const ObjectId& id : removing) {
+            objectCache.erase(id);
+        }
+        for (size_t i : doomed) {
+            if (::unlink((getObjectPath(unreachable[i]) + asideSuffix).c_str()) == 0) {
+                stats.removed++;
+                stats.bytesFreed += sizes[i];
+            }
+        }
+    }
+    
+    if (stats.full) {
+        index.forEach([&](const ObjectId& id, const IndexEntry& entry) {
+            if (entry.location == IndexEntry::PACKED && !reachable.count(id)) {
+                stats.packed++;
+            }
+        });
+    } else {
+        stats.packed = std::count(fates.begin(), fates.end(), IN_PACK);
+    }
+    
+    // Reachable candidates are promoted out of the young generation.
+    young.finish(survivors, mark);
+    stats.reachable = reachable.size();
+    return stats;
+}
+
 ObjectStore::~ObjectStore() {
 }
@@ -2,80 +2,159 @@
 #define OBJECTSTORE_H
 
 #include "FileObject.h"
+#include "PackFile.h"
+#include "ObjectIndex.h"
+#include "ObjectWriter.h"
+#include "YoungGeneration.h"
+#include "Chunker.h"
+#include "ObjectCache.h"
+#include <chrono>
 #include <map>
 #include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <algorithm>
+#include <cstdint>
 
-template<typename T>
-class StoragePool {
-private:
-    std::map<std::string, T> pool;
-    size_t maxSize;
-    
-public:
-    StoragePool(size_t max = 1000) : maxSize(max) {}
-    
-    void store(const std::string& key, const T& value) {
-        if (pool.size() >= maxSize) {
-            pool.erase(pool.begin());
-        }
-        pool[key] = value;
-    }
-    
-    bool retrieve(const std::string& key, T& value) {
-        auto it = pool.find(key);
-        if (it != pool.end()) {
-            value = it->second;
-            return true;
-        }
-        return false;
-    }
-    
-    bool contains(const std::string& key) const {
-        return pool.find(key) != pool.end();
-    }
-    
-    void clear() {
-        pool.clear();
-    }
-    
-    size_t size() const {
-        return pool.size();
-    }
+struct StorageStats {
+    uint64_t objects;
+    uint64_t looseObjects;
+    uint64_t looseBytes;
+    uint64_t packedObjects;
+    // The packed objects' own size, and what their packs take on disk
+    // once deltified and compressed.
+    uint64_t packedBytes;
+    uint64_t packFileBytes;
+};
+
+struct GcOptions {
+    // A full run considers every loose object; otherwise only those added
+    // since the last run are. The first run on a store is always full.
+    bool full = false;
+    // Unreachable objects whose files are younger than this are kept, as
+    // another process may be about to reference them.
+    std::chrono::seconds gracePeriod = std::chrono::hours(14 * 24);
+};
+
+struct GcStats {
+    bool full = false;
+    size_t reachable = 0;
+    size_t scanned = 0;
+    size_t removed = 0;
+    uint64_t bytesFreed = 0;
+    // Unreachable, but within the grace period or stored during the run.
+    size_t retained = 0;
+    // Unreachable, but in a pack, which is never rewritten here.
+    size_t packed = 0;
 };
 
 class ObjectStore {
 private:
-    static ObjectStore* instance;
+    static std::atomic<ObjectStore*> instance;
     static std::mutex mtx;
     
     std::string storePath;
-    StoragePool<std::vector<char>> objectPool;
-    std::map<std::string, std::string> hashToPath;
+    HashAlgorithm format;
+    ObjectCache objectCache;
+    ObjectIndex index;
+    YoungGeneration young;
+    ObjectWriter writer;
+    Chunker chunker;
+    std::vector<std::unique_ptr<PackFile>> packs;
+    mutable std::shared_mutex packMutex;
+    std::atomic<uint64_t> packFileBytes;
+    
+    // Held by a collection and by repack(), which both move loose files.
+    std::mutex gcMutex;
+    // While a collection runs, every id stored is noted in rescued, so the
+    // sweep never deletes an object a concurrent store relied on.
+    std::atomic<bool> collecting;
+    std::mutex rescueMutex;
+    std::unordered_set<ObjectId> rescued;
     
-    ObjectStore(const std::string& path);
+    ObjectStore(const std::string& path, const CacheConfig& cache, HashAlgorithm requested);
     ObjectStore(const ObjectStore&) = delete;
     ObjectStore& operator=(const ObjectStore&) = delete;
     
-    std::string getObjectPath(const std::string& hash);
+    std::string getObjectPath(const ObjectId& id) const;
+    std::string getPackDirectory() const { return storePath + "/pack"; }
+    std::string getFormatPath() const { return storePath + "/format"; }
+    
+    HashAlgorithm loadFormat(HashAlgorithm requested);
+    void loadPacks();
+    bool loadNewPacks();
+    void rebuildIndex();
+    bool findInPacks(const ObjectId& id, std::vector<char>& content);
+    
+    bool findObject(const ObjectId& id, IndexEntry& entry);
+    bool readStoredObject(const ObjectId& id, const IndexEntry& entry, ContentView& content);
+    bool loadObject(const ObjectId& id, IndexEntry& entry, ContentView& content);
+    void storeChunked(const ObjectId& id, FileObject& obj, const ContentView& content);
+    bool assembleChunks(const ContentView& manifest, std::vector<char>& content);
+    void noteStored(const ObjectId& id);
+    bool freshen(const ObjectId& id);
+    void markChunks(const ObjectId& id, std::vector<ObjectId>& chunks);
+    void scanLooseObjects(std::vector<ObjectId>& ids, std::chrono::seconds gracePeriod);
     
 public:
-    static ObjectStore* getInstance(const std::string& path = "");
+    // Binary content at least this large is split into chunks.
+    static const size_t CHUNK_THRESHOLD = 1024 * 1024;
+    
+    // The cache configuration only applies when the instance is created,
+    // and the object format only when the store itself is: an existing
+    // store keeps the format it was created with.
+    static ObjectStore* getInstance(const std::string& path = "",
+                                    const CacheConfig& cache = CacheConfig(),
+                                    HashAlgorithm format = HashAlgorithm::SHA256);
+    
+    // What object ids are computed with; opening the store makes it the
+    // algorithm FileObject ids are computed with.
+    HashAlgorithm getFormat() const { return format; }
     
-    std::string storeObject(FileObject& obj);
-    std::unique_ptr<FileObject> retrieveObject(const std::string& hash);
-    bool hasObject(const std::string& hash);
+    // Objects are written in the background and can be retrieved at once,
+    // but are only durable once flush() returns; storeObjects() flushes
+    // its batch itself.
+    ObjectId storeObject(FileObject& obj);
+    std::unique_ptr<FileObject> retrieveObject(const ObjectId& id);
+    bool hasObject(const ObjectId& id);
     
-    void compressObject(const std::string& hash);
-    void decompressObject(const std::string& hash);
+    std::vector<ObjectId> storeObjects(const std::vector<FileObject*>& objects);
+    std::vector<ObjectId> storeObjects(std::vector<FileValue>& files);
+    std::vector<std::unique_ptr<FileObject>> retrieveObjects(const std::vector<ObjectId>& ids);
     
+    // Waits for pending writes and syncs them to disk as one group. Throws
+    // if any of them failed; those objects are then no longer stored.
+    void flush();
+    // With durability off, writes are never synced and flush() only waits.
+    void setDurable(bool sync) { writer.setDurable(sync); }
+    
+    size_t repack();
+    size_t getPackCount() const;
+    PoolStats getCacheStats() const { return objectCache.getStats(); }
+    CacheStats getCacheTierStats() const { return objectCache.getTierStats(); }
+    
+    // Bytes the loose objects and the packs take on disk. Both this and
+    // getStorageStats() come from running totals and touch no files;
+    // objects not yet flushed are not counted.
     size_t getStorageSize() const;
-    void cleanup(int daysOld);
+    StorageStats getStorageStats() const;
+    
+    // Mark and sweep from roots, the ids of everything still referenced:
+    // every object reachable from them, directly or as a chunk, is kept
+    // and unreachable loose objects are deleted. Objects stored by this
+    // process during the run are safe. A store in another process that
+    // finds its object already there freshens the file's mtime, which the
+    // sweep checks again once the file is out of reach of new stores.
+    GcStats cleanup(const std::vector<ObjectId>& roots, const GcOptions& options = GcOptions());
     
+    // Holds a shared lock for the whole walk; func must not store objects.
     template<typename Func>
     void forEach(Func&& func) {
-        for (const auto& pair : hashToPath) {
-            func(pair.first, pair.second);
-        }
+        index.forEach([&func](const ObjectId& id, const IndexEntry& entry) {
+            func(id, entry.path);
+        });
     }
     
     ~ObjectStore();
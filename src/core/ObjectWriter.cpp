@@ -0,0 +1,312 @@
+#include "ObjectWriter.h"
+#include "Metrics.h"
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::atomic<uint64_t> tempCounter(0);
+
+std::string tempPathFor(const std::string& path) {
+    return path + ".tmp" + std::to_string(tempCounter.fetch_add(1)) + "_" +
+           std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+}
+
+std::string errorText(const std::string& what, const std::string& path) {
+    return what + ": " + path + " (" + std::strerror(errno) + ")";
+}
+
+}
+
+ObjectWriter::ObjectWriter(ObjectIndex& objectIndex, YoungGeneration& generation,
+                           const std::string& directory, ThreadPool& threads)
+    : index(objectIndex), young(generation), pool(threads), root(directory), durable(true),
+      stagedBytes(0), pendingCount(0), activeTasks(0), committing(0) {
+}
+
+ObjectWriter::~ObjectWriter() {
+    std::vector<ObjectId> ignored;
+    std::string error;
+    flush(ignored, error);
+}
+
+void ObjectWriter::submit(const ObjectId& id, const std::string& path,
+                          const ContentView& content, const IndexEntry& entry) {
+    Write write;
+    write.id = id;
+    write.path = path;
+    write.content = content.retain();
+    write.entry = entry;
+    
+    // A mapping follows later changes to the file behind it, so mapped
+    // content is copied to disk right away, and readers are then served
+    // from the temporary file, which nothing else writes.
+    if (content.isMapped()) {
+        if (isPending(id)) {
+            return;
+        }
+        writeTemporary(write);
+        write.content = ContentView::mapFile(write.tmpPath);
+        
+        bool commit;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!pending.emplace(id, write).second) {
+                ::unlink(write.tmpPath.c_str());
+                return;
+            }
+            pendingCount.fetch_add(1, std::memory_order_release);
+            commit = stage(std::move(write));
+        }
+        if (commit) {
+            commitStaged();
+        }
+        return;
+    }
+    
+    bool spawn = false;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!pending.emplace(id, write).second) {
+            return;
+        }
+        pendingCount.fetch_add(1, std::memory_order_release);
+        queue.push_back(std::move(write));
+        
+        // One task per BATCH_SIZE queued writes, up to one per worker.
+        size_t wanted = std::min(pool.getThreadCount(), (queue.size() + BATCH_SIZE - 1) / BATCH_SIZE);
+        if (activeTasks < std::max<size_t>(wanted, 1)) {
+            activeTasks++;
+            spawn = true;
+        }
+    }
+    
+    if (spawn) {
+        pool.submit([this]() { drain(); });
+    }
+}
+
+bool ObjectWriter::isPending(const ObjectId& id) const {
+    if (pendingCount.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    return pending.find(id) != pending.end();
+}
+
+bool ObjectWriter::findPending(const ObjectId& id, IndexEntry& entry, ContentView& content) const {
+    if (pendingCount.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = pending.find(id);
+    if (it == pending.end()) {
+        return false;
+    }
+    entry = it->second.entry;
+    content = it->second.content;
+    return true;
+}
+
+void ObjectWriter::fail(const ObjectId& id, const std::string& message) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (failed.empty()) {
+        firstError = message;
+    }
+    failed.push_back(id);
+    if (pending.erase(id)) {
+        pendingCount.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+// Fan-out directories are only created when the open finds them missing,
+// so a store that already has them pays no extra syscalls.
+void ObjectWriter::writeTemporary(Write& write) {
+    write.tmpPath = tempPathFor(write.path);
+    int fd = ::open(write.tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0 && errno == ENOENT) {
+        std::error_code ec;
+        fs::create_directories(fs::path(write.path).parent_path(), ec);
+        VV_COUNT(DIRECTORY_CREATES, 1);
+        fd = ::open(write.tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    }
+    if (fd < 0) {
+        throw std::runtime_error(errorText("Cannot create object file", write.path));
+    }
+    VV_COUNT(FILE_OPENS, 1);
+    
+    const char* data = write.content.data();
+    size_t remaining = write.content.size();
+    while (remaining > 0) {
+        ssize_t n = ::write(fd, data, remaining);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            std::string message = errorText("Cannot write object file", write.path);
+            ::close(fd);
+            ::unlink(write.tmpPath.c_str());
+            throw std::runtime_error(message);
+        }
+        data += n;
+        remaining -= static_cast<size_t>(n);
+    }
+    
+    if (::close(fd) != 0) {
+        std::string message = errorText("Cannot write object file", write.path);
+        ::unlink(write.tmpPath.c_str());
+        throw std::runtime_error(message);
+    }
+    VV_COUNT(BYTES_WRITTEN, write.content.size());
+}
+
+void ObjectWriter::syncFilesystem() {
+#if defined(__linux__)
+    int fd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        int result = ::syncfs(fd);
+        ::close(fd);
+        if (result == 0) {
+            return;
+        }
+    }
+#endif
+    ::sync();
+}
+
+void ObjectWriter::commitStaged() {
+    std::lock_guard<std::mutex> commitLock(commitMtx);
+    
+    std::vector<Write> group;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        group.swap(staged);
+        stagedBytes = 0;
+        if (group.empty()) {
+            return;
+        }
+        committing++;
+    }
+    
+    if (durable) {
+        syncFilesystem();
+    }
+    
+    std::vector<std::pair<ObjectId, IndexEntry>> entries;
+    entries.reserve(group.size());
+    for (Write& write : group) {
+        if (::rename(write.tmpPath.c_str(), write.path.c_str()) != 0) {
+            std::string message = errorText("Cannot rename object file", write.path);
+            ::unlink(write.tmpPath.c_str());
+            fail(write.id, message);
+            continue;
+        }
+        VV_COUNT(FILE_RENAMES, 1);
+        entries.emplace_back(write.id, write.entry);
+    }
+    
+    try {
+        index.putAll(entries);
+        young.record(entries);
+    } catch (const std::exception& e) {
+        for (const auto& entry : entries) {
+            fail(entry.first, e.what());
+        }
+    }
+    
+    if (durable) {
+        syncFilesystem();
+    }
+    
+    // Only now that the index has them can readers stop being served
+    // from memory.
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const Write& write : group) {
+        if (pending.erase(write.id)) {
+            pendingCount.fetch_sub(1, std::memory_order_release);
+        }
+    }
+    committing--;
+    done.notify_all();
+}
+
+void ObjectWriter::drain() {
+    while (true) {
+        std::vector<Write> batch;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            while (!queue.empty() && batch.size() < BATCH_SIZE) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+            if (batch.empty()) {
+                activeTasks--;
+                done.notify_all();
+                return;
+            }
+        }
+        
+        bool commit = false;
+        for (Write& write : batch) {
+            try {
+                writeTemporary(write);
+            } catch (const std::exception& e) {
+                fail(write.id, e.what());
+                continue;
+            }
+            
+            std::lock_guard<std::mutex> lock(mtx);
+            commit = stage(std::move(write)) || commit;
+        }
+        
+        if (commit) {
+            commitStaged();
+        }
+    }
+}
+
+bool ObjectWriter::stage(Write&& write) {
+    stagedBytes += write.content.size();
+    staged.push_back(std::move(write));
+    return !durable || staged.size() >= MAX_STAGED_OBJECTS || stagedBytes >= MAX_STAGED_BYTES;
+}
+
+bool ObjectWriter::isIdle() const {
+    return queue.empty() && activeTasks == 0 && committing == 0;
+}
+
+bool ObjectWriter::flush(std::vector<ObjectId>& failedIds, std::string& error) {
+    // A flush from inside a pool task helps with the queue rather than
+    // blocking a worker the writes may be waiting for.
+    while (true) {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (isIdle()) {
+            break;
+        }
+        lock.unlock();
+        if (pool.tryRunTask()) {
+            continue;
+        }
+        lock.lock();
+        done.wait(lock, [this]() { return isIdle(); });
+        break;
+    }
+    
+    commitStaged();
+    
+    std::lock_guard<std::mutex> lock(mtx);
+    if (failed.empty()) {
+        return true;
+    }
+    failedIds.insert(failedIds.end(), failed.begin(), failed.end());
+    error = firstError;
+    failed.clear();
+    firstError.clear();
+    return false;
+}
@@ -0,0 +1,100 @@
+#ifndef OBJECTWRITER_H
+#define OBJECTWRITER_H
+
+#include "ContentView.h"
+#include "ObjectIndex.h"
+#include "ThreadPool.h"
+#include "YoungGeneration.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Writes loose objects in the background. Each object goes to a private
+// temporary file from a pool task, and finished files are committed in
+// groups: one sync of the filesystem makes the whole group's data durable,
+// the files are renamed into place and their index entries added, and a
+// second sync covers the renames and the index journal. An object is thus
+// either absent after a crash or complete, and is never indexed before
+// its file exists.
+//
+// Until its group is committed an object is served from memory by
+// findPending(). With durability off, files are renamed and indexed as
+// soon as they are written and nothing is synced.
+class ObjectWriter {
+private:
+    struct Write {
+        ObjectId id;
+        std::string path;
+        std::string tmpPath;
+        ContentView content;
+        IndexEntry entry;
+    };
+    
+    ObjectIndex& index;
+    YoungGeneration& young;
+    ThreadPool& pool;
+    std::string root;
+    std::atomic<bool> durable;
+    
+    mutable std::mutex mtx;
+    std::condition_variable done;
+    std::deque<Write> queue;
+    std::vector<Write> staged;
+    size_t stagedBytes;
+    std::unordered_map<ObjectId, Write> pending;
+    std::atomic<size_t> pendingCount;
+    size_t activeTasks;
+    size_t committing;
+    std::vector<ObjectId> failed;
+    std::string firstError;
+    
+    // Serialises commits, so groups reach the index in order.
+    std::mutex commitMtx;
+    
+    void drain();
+    void writeTemporary(Write& write);
+    // Called with mtx held; true when the staged group is due a commit.
+    bool stage(Write&& write);
+    void commitStaged();
+    void syncFilesystem();
+    void fail(const ObjectId& id, const std::string& message);
+    bool isIdle() const;
+    
+public:
+    // Writes taken off the queue by a task at a time.
+    static const size_t BATCH_SIZE = 64;
+    // A group is committed by the writers themselves once it grows past
+    // either limit, so nothing piles up in memory between flushes.
+    static const size_t MAX_STAGED_OBJECTS = 4096;
+    static const size_t MAX_STAGED_BYTES = 64 * 1024 * 1024;
+    
+    ObjectWriter(ObjectIndex& objectIndex, YoungGeneration& generation,
+                 const std::string& directory, ThreadPool& threads = ThreadPool::shared());
+    ~ObjectWriter();
+    ObjectWriter(const ObjectWriter&) = delete;
+    ObjectWriter& operator=(const ObjectWriter&) = delete;
+    
+    void setDurable(bool sync) { durable = sync; }
+    bool isDurable() const { return durable; }
+    
+    // Queues content to be written to path and indexed under id. Unowned
+    // views are copied first and mapped ones written out before returning,
+    // so the caller's buffers and files are free to change afterwards. Ids
+    // already queued are ignored.
+    void submit(const ObjectId& id, const std::string& path, const ContentView& content,
+                const IndexEntry& entry);
+    
+    bool isPending(const ObjectId& id) const;
+    bool findPending(const ObjectId& id, IndexEntry& entry, ContentView& content) const;
+    
+    // Waits for every queued write and commits whatever is left. Returns
+    // false if any write since the last flush failed, with the ids of the
+    // failed objects appended to failedIds and the first error in error.
+    bool flush(std::vector<ObjectId>& failedIds, std::string& error);
+};
+
+#endif
@@ -0,0 +1,491 @@
+#include "PackFile.h"
+#include <zlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char PACK_MAGIC[4] = {'V', 'V', 'P', 'K'};
+const char INDEX_MAGIC[4] = {'V', 'V', 'I', 'X'};
+
+const unsigned char ENTRY_FULL = 1;
+const unsigned char ENTRY_DELTA = 2;
+const unsigned char ENTRY_STORED = 0x10;
+
+const unsigned char OP_INSERT = 0;
+const unsigned char OP_COPY = 1;
+
+const size_t DELTA_BLOCK = 16;
+const int MAX_WRITE_DEPTH = 10;
+
+void putU32(std::vector<char>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void putU64(std::vector<char>& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+uint32_t getU32(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint32_t>(u[0]) | (static_cast<uint32_t>(u[1]) << 8) |
+           (static_cast<uint32_t>(u[2]) << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+uint64_t getU64(const char* p) {
+    return static_cast<uint64_t>(getU32(p)) | (static_cast<uint64_t>(getU32(p + 4)) << 32);
+}
+
+void putVarint(std::vector<char>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+uint64_t getVarint(const char*& p, const char* end) {
+    uint64_t value = 0;
+    int shift = 0;
+    while (p < end && shift < 64) {
+        unsigned char byte = static_cast<unsigned char>(*p++);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+        shift += 7;
+    }
+    throw std::runtime_error("Corrupt varint in pack data");
+}
+
+uint64_t hashName(const std::string& path) {
+    // Group objects from the same file name together so successive versions
+    // fall into the same delta window.
+    std::string name = fs::path(path).filename().string();
+    uint64_t hash = 1469598103934665603ULL;
+    for (unsigned char c : name) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+const uint64_t ROLL_PRIME = 0x100000001b3ULL;
+
+uint64_t rollPower() {
+    uint64_t power = 1;
+    for (size_t i = 0; i < DELTA_BLOCK; i++) {
+        power *= ROLL_PRIME;
+    }
+    return power;
+}
+
+uint64_t blockHash(const char* p) {
+    uint64_t hash = 0;
+    for (size_t i = 0; i < DELTA_BLOCK; i++) {
+        hash = hash * ROLL_PRIME + static_cast<unsigned char>(p[i]);
+    }
+    return hash;
+}
+
+}
+
+PackFile::PackFile(const std::string& packFile, const std::string& indexFile)
+    : packPath(packFile), count(0) {
+    pack = ContentView::mapFile(packFile);
+    index = ContentView::mapFile(indexFile);
+    
+    if (index.size() < INDEX_HEADER_SIZE || std::memcmp(index.data(), INDEX_MAGIC, 4) != 0 ||
+        getU32(index.data() + 4) != VERSION) {
+        throw std::runtime_error("Invalid pack index: " + indexFile);
+    }
+    if (pack.size() < 12 || std::memcmp(pack.data(), PACK_MAGIC, 4) != 0 ||
+        getU32(pack.data() + 4) != VERSION) {
+        throw std::runtime_error("Invalid pack file: " + packFile);
+    }
+    
+    count = getU32(index.data() + 8);
+    if (index.size() < INDEX_HEADER_SIZE + static_cast<size_t>(count) * INDEX_ENTRY_SIZE) {
+        throw std::runtime_error("Truncated pack index: " + indexFile);
+    }
+}
+
+const unsigned char* PackFile::entryAt(uint32_t i) const {
+    return reinterpret_cast<const unsigned char*>(index.data() + INDEX_HEADER_SIZE) +
+           static_cast<size_t>(i) * INDEX_ENTRY_SIZE;
+}
+
+bool PackFile::find(const ObjectId& id, uint64_t& offset) const {
+    const char* fanout = index.data() + 12;
+    uint32_t lo = id[0] == 0 ? 0 : getU32(fanout + 4 * (id[0] - 1));
+    uint32_t hi = getU32(fanout + 4 * id[0]);
+    
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = std::memcmp(entryAt(mid), id.data(), id.size());
+        if (cmp == 0) {
+            offset = getU64(reinterpret_cast<const char*>(entryAt(mid)) + id.size());
+            return true;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+bool PackFile::contains(const ObjectId& id) const {
+    uint64_t offset;
+    return find(id, offset);
+}
+
+bool PackFile::read(const ObjectId& id, std::vector<char>& content) const {
+    uint64_t offset;
+    if (!find(id, offset)) {
+        return false;
+    }
+    content = readEntry(offset, 0);
+    return true;
+}
+
+std::vector<char> PackFile::readEntry(uint64_t offset, int depth) const {
+    if (depth > MAX_DELTA_DEPTH || offset >= pack.size()) {
+        throw std::runtime_error("Corrupt pack entry in " + packPath);
+    }
+    
+    const char* p = pack.data() + offset;
+    const char* end = pack.data() + pack.size();
+    
+    unsigned char type = static_cast<unsigned char>(*p++);
+    uint64_t resultSize = getVarint(p, end);
+    uint64_t payloadSize = getVarint(p, end);
+    uint64_t baseOffset = 0;
+    if ((type & 0x0f) == ENTRY_DELTA) {
+        baseOffset = getVarint(p, end);
+    }
+    uint64_t storedSize = getVarint(p, end);
+    
+    if (storedSize > static_cast<uint64_t>(end - p)) {
+        throw std::runtime_error("Corrupt pack entry in " + packPath);
+    }
+    
+    std::vector<char> payload;
+    if (type & ENTRY_STORED) {
+        payload.assign(p, p + storedSize);
+    } else {
+        payload.resize(payloadSize);
+        uLongf length = static_cast<uLongf>(payloadSize);
+        int rc = uncompress(reinterpret_cast<Bytef*>(payload.data()), &length,
+                            reinterpret_cast<const Bytef*>(p), static_cast<uLong>(storedSize));
+        if (rc != Z_OK || length != payloadSize) {
+            throw std::runtime_error("Cannot inflate pack entry in " + packPath);
+        }
+    }
+    
+    if ((type & 0x0f) == ENTRY_FULL) {
+        return payload;
+    }
+    
+    std::vector<char> base = readEntry(baseOffset, depth + 1);
+    std::vector<char> result = PackWriter::applyDelta(base, payload.data(), payload.size());
+    if (result.size() != resultSize) {
+        throw std::runtime_error("Corrupt delta in " + packPath);
+    }
+    return result;
+}
+
+PackWriter::PackWriter(const std::string& packDirectory)
+    : directory(packDirectory) {
+}
+
+void PackWriter::add(const ObjectId& id, const std::string& sourcePath, size_t size,
+                     const std::string& nameHint) {
+    sources.push_back({id, sourcePath, size, hashName(nameHint.empty() ? sourcePath : nameHint)});
+}
+
+std::string PackWriter::finish() {
+    std::sort(sources.begin(), sources.end(), [](const Source& a, const Source& b) {
+        return a.id < b.id;
+    });
+    sources.erase(std::unique(sources.begin(), sources.end(), [](const Source& a, const Source& b) {
+        return a.id == b.id;
+    }), sources.end());
+    
+    if (sources.empty()) {
+        return "";
+    }
+    
+    // Like git, order by name and then by decreasing size, so each object
+    // tends to delta against a larger, earlier version of the same file.
+    std::stable_sort(sources.begin(), sources.end(), [](const Source& a, const Source& b) {
+        if (a.nameHash != b.nameHash) {
+            return a.nameHash < b.nameHash;
+        }
+        return a.size > b.size;
+    });
+    
+    fs::create_directories(directory);
+    std::string tmpPath = directory + "/tmp_pack_" +
+        std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    
+    std::ofstream out(tmpPath, std::ios::binary);
+    if (!out.is_open()) {
+        throw std::runtime_error("Cannot create pack file: " + tmpPath);
+    }
+    
+    Sha256Hasher hasher;
+    uint64_t offset = 0;
+    std::vector<char> buffer;
+    
+    auto emit = [&](const std::vector<char>& bytes) {
+        out.write(bytes.data(), bytes.size());
+        hasher.update(bytes.data(), bytes.size());
+        offset += bytes.size();
+    };
+    
+    buffer.insert(buffer.end(), PACK_MAGIC, PACK_MAGIC + 4);
+    putU32(buffer, PackFile::VERSION);
+    putU32(buffer, static_cast<uint32_t>(sources.size()));
+    emit(buffer);
+    
+    struct Recent {
+        ContentView content;
+        uint64_t offset;
+        int depth;
+    };
+    std::deque<Recent> window;
+    std::vector<std::pair<ObjectId, uint64_t>> entries;
+    entries.reserve(sources.size());
+    
+    for (const auto& source : sources) {
+        ContentView content = ContentView::mapFile(source.path);
+        uint64_t entryOffset = offset;
+        
+        std::vector<char> delta;
+        const Recent* base = nullptr;
+        if (content.size() <= MAX_DELTA_SIZE) {
+            for (auto it = window.rbegin(); it != window.rend(); ++it) {
+                if (it->depth >= MAX_WRITE_DEPTH || it->content.size() > MAX_DELTA_SIZE) {
+                    continue;
+                }
+                size_t limit = delta.empty() ? content.size() / 2 : delta.size();
+                std::vector<char> candidate = computeDelta(it->content, content, limit);
+                if (!candidate.empty()) {
+                    delta.swap(candidate);
+                    base = &*it;
+                }
+            }
+        }
+        
+        const char* payload = base ? delta.data() : content.data();
+        size_t payloadSize = base ? delta.size() : content.size();
+        
+        std::vector<char> compressed(compressBound(static_cast<uLong>(payloadSize)));
+        uLongf compressedSize = static_cast<uLongf>(compressed.size());
+        bool deflated = compress2(reinterpret_cast<Bytef*>(compressed.data()), &compressedSize,
+                                  reinterpret_cast<const Bytef*>(payload),
+                                  static_cast<uLong>(payloadSize), Z_DEFAULT_COMPRESSION) == Z_OK &&
+                        compressedSize < payloadSize;
+        
+        buffer.clear();
+        buffer.push_back(static_cast<char>((base ? ENTRY_DELTA : ENTRY_FULL) |
+                                           (deflated ? 0 : ENTRY_STORED)));
+        putVarint(buffer, content.size());
+        putVarint(buffer, payloadSize);
+        if (base) {
+            putVarint(buffer, base->offset);
+        }
+        if (deflated) {
+            putVarint(buffer, compressedSize);
+            buffer.insert(buffer.end(), compressed.data(), compressed.data() + compressedSize);
+        } else {
+            putVarint(buffer, payloadSize);
+            buffer.insert(buffer.end(), payload, payload + payloadSize);
+        }
+        emit(buffer);
+        
+        int depth = base ? base->depth + 1 : 0;
+        entries.push_back({source.id, entryOffset});
+        window.push_back({content, entryOffset, depth});
+        if (window.size() > static_cast<size_t>(DELTA_WINDOW)) {
+            window.pop_front();
+        }
+    }
+    
+    ObjectId checksum = hasher.finish();
+    out.write(reinterpret_cast<const char*>(checksum.data()), checksum.size());
+    out.close();
+    if (!out) {
+        fs::remove(tmpPath);
+        throw std::runtime_error("Cannot write pack file: " + tmpPath);
+    }
+    
+    std::string name = directory + "/pack-" + checksum.toHex();
+    fs::rename(tmpPath, name + ".pack");
+    
+    std::sort(entries.begin(), entries.end());
+    
+    buffer.clear();
+    buffer.insert(buffer.end(), INDEX_MAGIC, INDEX_MAGIC + 4);
+    putU32(buffer, PackFile::VERSION);
+    putU32(buffer, static_cast<uint32_t>(entries.size()));
+    
+    uint32_t cumulative = 0;
+    size_t next = 0;
+    for (int b = 0; b < 256; b++) {
+        while (next < entries.size() && entries[next].first[0] == b) {
+            next++;
+            cumulative++;
+        }
+        putU32(buffer, cumulative);
+    }
+    for (const auto& entry : entries) {
+        buffer.insert(buffer.end(), entry.first.begin(), entry.first.end());
+        putU64(buffer, entry.second);
+    }
+    
+    // The index is renamed into place last, so a visible .idx always
+    // refers to a complete pack.
+    std::string tmpIndex = tmpPath + ".idx";
+    std::ofstream indexOut(tmpIndex, std::ios::binary);
+    indexOut.write(buffer.data(), buffer.size());
+    indexOut.close();
+    if (!indexOut) {
+        fs::remove(tmpIndex);
+        throw std::runtime_error("Cannot write pack index: " + tmpIndex);
+    }
+    fs::rename(tmpIndex, name + ".idx");
+    
+    return name;
+}
+
+std::vector<char> PackWriter::computeDelta(const ContentView& base, const ContentView& target,
+                                           size_t limit) {
+    std::vector<char> delta;
+    if (base.size() < DELTA_BLOCK || target.size() < DELTA_BLOCK || limit == 0) {
+        return delta;
+    }
+    
+    std::unordered_map<uint64_t, size_t> blocks;
+    blocks.reserve(base.size() / DELTA_BLOCK);
+    for (size_t off = 0; off + DELTA_BLOCK <= base.size(); off += DELTA_BLOCK) {
+        blocks.emplace(blockHash(base.data() + off), off);
+    }
+    
+    putVarint(delta, base.size());
+    putVarint(delta, target.size());
+    
+    const char* t = target.data();
+    size_t n = target.size();
+    size_t insertStart = 0;
+    
+    auto flushInsert = [&](size_t upTo) {
+        if (upTo > insertStart) {
+            delta.push_back(static_cast<char>(OP_INSERT));
+            putVarint(delta, upTo - insertStart);
+            delta.insert(delta.end(), t + insertStart, t + upTo);
+        }
+    };
+    
+    const uint64_t power = rollPower();
+    size_t i = 0;
+    uint64_t hash = blockHash(t);
+    
+    while (i + DELTA_BLOCK <= n) {
+        auto it = blocks.find(hash);
+        if (it != blocks.end() && std::memcmp(base.data() + it->second, t + i, DELTA_BLOCK) == 0) {
+            size_t baseOff = it->second;
+            size_t length = DELTA_BLOCK;
+            while (baseOff + length < base.size() && i + length < n &&
+                   base[baseOff + length] == t[i + length]) {
+                length++;
+            }
+            while (baseOff > 0 && i > insertStart && base[baseOff - 1] == t[i - 1]) {
+                baseOff--;
+                i--;
+                length++;
+            }
+            
+            flushInsert(i);
+            delta.push_back(static_cast<char>(OP_COPY));
+            putVarint(delta, baseOff);
+            putVarint(delta, length);
+            
+            i += length;
+            insertStart = i;
+            if (i + DELTA_BLOCK <= n) {
+                hash = blockHash(t + i);
+            }
+        } else {
+            if (i + DELTA_BLOCK >= n) {
+                break;
+            }
+            hash = hash * ROLL_PRIME + static_cast<unsigned char>(t[i + DELTA_BLOCK]) -
+                   power * static_cast<unsigned char>(t[i]);
+            i++;
+        }
+        
+        if (delta.size() + (i - insertStart) >= limit) {
+            return std::vector<char>();
+        }
+    }
+    
+    flushInsert(n);
+    if (delta.size() >= limit) {
+        return std::vector<char>();
+    }
+    return delta;
+}
+
+std::vector<char> PackWriter::applyDelta(const std::vector<char>& base, const char* delta,
+                                         size_t length) {
+    const char* p = delta;
+    const char* end = delta + length;
+    
+    uint64_t baseSize = getVarint(p, end);
+    uint64_t resultSize = getVarint(p, end);
+    if (baseSize != base.size()) {
+        throw std::runtime_error("Delta base size mismatch");
+    }
+    
+    std::vector<char> result;
+    result.reserve(resultSize);
+    
+    while (p < end) {
+        unsigned char op = static_cast<unsigned char>(*p++);
+        if (op == OP_INSERT) {
+            uint64_t count = getVarint(p, end);
+            if (count > static_cast<uint64_t>(end - p)) {
+                throw std::runtime_error("Corrupt delta insert");
+            }
+            result.insert(result.end(), p, p + count);
+            p += count;
+        } else if (op == OP_COPY) {
+            uint64_t offset = getVarint(p, end);
+            uint64_t count = getVarint(p, end);
+            if (offset > base.size() || count > base.size() - offset) {
+                throw std::runtime_error("Corrupt delta copy");
+            }
+            result.insert(result.end(), base.begin() + offset, base.begin() + offset + count);
+        } else {
+            throw std::runtime_error("Unknown delta opcode");
+        }
+    }
+    
+    if (result.size() != resultSize) {
+        throw std::runtime_error("Delta result size mismatch");
+    }
+    return result;
+}
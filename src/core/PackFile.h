@@ -0,0 +1,71 @@
+#ifndef PACKFILE_H
+#define PACKFILE_H
+
+#include "FileObject.h"
+#include <cstdint>
+
+class PackFile {
+private:
+    static const int MAX_DELTA_DEPTH = 50;
+    
+    std::string packPath;
+    ContentView pack;
+    ContentView index;
+    uint32_t count;
+    
+    const unsigned char* entryAt(uint32_t i) const;
+    std::vector<char> readEntry(uint64_t offset, int depth) const;
+    
+public:
+    static const uint32_t VERSION = 1;
+    static const size_t INDEX_HEADER_SIZE = 12 + 256 * 4;
+    static const size_t INDEX_ENTRY_SIZE = 32 + 8;
+    
+    PackFile(const std::string& packFile, const std::string& indexFile);
+    
+    bool find(const ObjectId& id, uint64_t& offset) const;
+    bool contains(const ObjectId& id) const;
+    bool read(const ObjectId& id, std::vector<char>& content) const;
+    
+    template<typename Func>
+    void forEach(Func&& func) const {
+        for (uint32_t i = 0; i < count; i++) {
+            func(ObjectId(entryAt(i)));
+        }
+    }
+    
+    uint32_t getObjectCount() const { return count; }
+    const std::string& getPath() const { return packPath; }
+};
+
+class PackWriter {
+private:
+    static const int DELTA_WINDOW = 10;
+    static const size_t MAX_DELTA_SIZE = 64 * 1024 * 1024;
+    
+    struct Source {
+        ObjectId id;
+        std::string path;
+        size_t size;
+        uint64_t nameHash;
+    };
+    
+    std::string directory;
+    std::vector<Source> sources;
+    
+public:
+    PackWriter(const std::string& packDirectory);
+    
+    void add(const ObjectId& id, const std::string& sourcePath, size_t size,
+             const std::string& nameHint = "");
+    size_t size() const { return sources.size(); }
+    
+    std::string finish();
+    
+    static std::vector<char> computeDelta(const ContentView& base, const ContentView& target,
+                                          size_t limit);
+    static std::vector<char> applyDelta(const std::vector<char>& base, const char* delta,
+                                        size_t length);
+};
+
+#endif
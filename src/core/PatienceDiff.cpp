@@ -0,0 +1,136 @@
+#include "DiffEngine.h"
+#include "DiffInternal.h"
+#include "Metrics.h"
+#include <algorithm>
+
+std::vector<Edit> PatienceDiff::editScript(
+    const std::vector<std::string_view>& oldLines,
+    const std::vector<std::string_view>& newLines,
+    const std::vector<uint32_t>& oldIds,
+    const std::vector<uint32_t>& newIds) {
+    
+    return editScript(oldLines, newLines, oldIds, newIds, idUniverse(oldIds, newIds));
+}
+
+std::vector<Edit> PatienceDiff::editScript(
+    const std::vector<std::string_view>& oldLines,
+    const std::vector<std::string_view>& newLines,
+    const std::vector<uint32_t>& oldIds,
+    const std::vector<uint32_t>& newIds,
+    uint32_t universe) {
+    
+    VV_TIME(DIFF_PATIENCE);
+    VV_COUNT(LINES_DIFFED, oldLines.size() + newLines.size());
+    const uint32_t* a = oldIds.data();
+    const uint32_t* b = newIds.data();
+    
+    std::vector<int> oldCount(universe, 0);
+    std::vector<int> newCount(universe, 0);
+    std::vector<int> newPos(universe, 0);
+    
+    MyersDiff fallback;
+    fallback.setMaxCost(maxCost);
+    
+    std::vector<Edit> edits;
+    std::vector<DiffRegion> pending;
+    pending.push_back({0, static_cast<int>(oldLines.size()), 0, static_cast<int>(newLines.size()), false});
+    
+    std::vector<std::pair<int, int>> matches;
+    std::vector<int> tails;
+    std::vector<int> previous;
+    
+    while (!pending.empty()) {
+        DiffRegion region = pending.back();
+        pending.pop_back();
+        if (region.equal) {
+            appendEdit(edits, EditType::EQUAL, region.aLo, region.bLo, region.aHi - region.aLo);
+            continue;
+        }
+        
+        int aLo = region.aLo, aHi = region.aHi;
+        int bLo = region.bLo, bHi = region.bHi;
+        
+        int prefix = 0;
+        while (aLo + prefix < aHi && bLo + prefix < bHi && a[aLo + prefix] == b[bLo + prefix]) {
+            prefix++;
+        }
+        appendEdit(edits, EditType::EQUAL, aLo, bLo, prefix);
+        aLo += prefix;
+        bLo += prefix;
+        
+        int suffix = 0;
+        while (aHi - suffix > aLo && bHi - suffix > bLo &&
+               a[aHi - suffix - 1] == b[bHi - suffix - 1]) {
+            suffix++;
+        }
+        aHi -= suffix;
+        bHi -= suffix;
+        if (suffix > 0) {
+            pending.push_back({aHi, aHi + suffix, bHi, bHi + suffix, true});
+        }
+        
+        if (aLo == aHi || bLo == bHi) {
+            appendEdit(edits, EditType::DELETE, aLo, bLo, aHi - aLo);
+            appendEdit(edits, EditType::INSERT, aHi, bLo, bHi - bLo);
+            continue;
+        }
+        
+        for (int i = aLo; i < aHi; i++) {
+            oldCount[a[i]]++;
+        }
+        for (int j = bLo; j < bHi; j++) {
+            newCount[b[j]]++;
+            newPos[b[j]] = j;
+        }
+        
+        matches.clear();
+        for (int i = aLo; i < aHi; i++) {
+            if (oldCount[a[i]] == 1 && newCount[a[i]] == 1) {
+                matches.push_back({i, newPos[a[i]]});
+            }
+        }
+        
+        for (int i = aLo; i < aHi; i++) {
+            oldCount[a[i]] = 0;
+        }
+        for (int j = bLo; j < bHi; j++) {
+            newCount[b[j]] = 0;
+        }
+        
+        if (matches.empty()) {
+            fallback.appendEdits(a, aLo, aHi, b, bLo, bHi, edits);
+            continue;
+        }
+        
+        // Patience sorting finds the longest run of unique matches that is
+        // increasing on the new side too; tails[k] ends the best run of
+        // length k + 1 seen so far.
+        tails.clear();
+        previous.assign(matches.size(), -1);
+        for (int k = 0; k < static_cast<int>(matches.size()); k++) {
+            auto pile = std::lower_bound(tails.begin(), tails.end(), matches[k].second,
+                [&matches](int t, int pos) { return matches[t].second < pos; });
+            if (pile != tails.begin()) {
+                previous[k] = *(pile - 1);
+            }
+            if (pile == tails.end()) {
+                tails.push_back(k);
+            } else {
+                *pile = k;
+            }
+        }
+        
+        int nextA = aHi, nextB = bHi;
+        for (int k = tails.back(); k >= 0; k = previous[k]) {
+            int x = matches[k].first;
+            int y = matches[k].second;
+            pending.push_back({x + 1, nextA, y + 1, nextB, false});
+            pending.push_back({x, x + 1, y, y + 1, true});
+            nextA = x;
+            nextB = y;
+        }
+        pending.push_back({aLo, nextA, bLo, nextB, false});
+    }
+    
+    return edits;
+}
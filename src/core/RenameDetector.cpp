@@ -0,0 +1,229 @@
+#include "RenameDetector.h"
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+
+const size_t CHUNK_BYTES = 64;
+
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+}
+
+RenameDetector::RenameDetector(double t)
+    : threshold(t), maxExactSize(1 << 20) {
+}
+
+RenameDetector::Fingerprint RenameDetector::fingerprint(FileObject* file) {
+    ContentView content = file->viewContent();
+    
+    Fingerprint fp;
+    fp.file = file;
+    fp.hash = file->getId();
+    fp.size = content.size();
+    fp.signature.fill(std::numeric_limits<uint64_t>::max());
+    
+    // Like git's rename scoring, content is tokenised into lines, with long
+    // lines and binary data cut into 64-byte pieces. Each token then feeds
+    // SIGNATURE_SIZE independent min-hashes.
+    std::hash<std::string_view> hasher;
+    size_t start = 0;
+    for (size_t i = 0; i < content.size(); i++) {
+        if (content[i] != '\n' && i + 1 - start < CHUNK_BYTES && i + 1 < content.size()) {
+            continue;
+        }
+        
+        uint64_t token = hasher(std::string_view(content.data() + start, i + 1 - start));
+        for (int k = 0; k < SIGNATURE_SIZE; k++) {
+            uint64_t value = mix64(token ^ (0x9e3779b97f4a7c15ULL * (k + 1)));
+            if (value < fp.signature[k]) {
+                fp.signature[k] = value;
+            }
+        }
+        start = i + 1;
+    }
+    
+    return fp;
+}
+
+double RenameDetector::estimateSimilarity(const Signature& a, const Signature& b) {
+    int matches = 0;
+    for (int k = 0; k < SIGNATURE_SIZE; k++) {
+        if (a[k] == b[k]) {
+            matches++;
+        }
+    }
+    return static_cast<double>(matches) / SIGNATURE_SIZE;
+}
+
+double RenameDetector::confirm(const Fingerprint& source, const ContentView& targetContent,
+                               double estimate) {
+    if (source.size > maxExactSize || targetContent.size() > maxExactSize) {
+        return estimate;
+    }
+    
+    ContentView sourceContent = source.file->viewContent();
+    return engine.calculateSimilarity(
+        std::string_view(sourceContent.data(), sourceContent.size()),
+        std::string_view(targetContent.data(), targetContent.size()),
+        threshold);
+}
+
+std::vector<Change> RenameDetector::detect(
+    const std::vector<FileObject*>& removed,
+    const std::vector<FileObject*>& added,
+    const std::vector<FileObject*>& unchanged) {
+    
+    std::vector<Change> changes;
+    std::vector<Fingerprint> sources;
+    std::vector<Fingerprint> targets;
+    
+    // Empty files carry no content to match on and are reported as plain
+    // additions and removals.
+    for (FileObject* file : removed) {
+        Fingerprint fp = fingerprint(file);
+        if (fp.size == 0) {
+            changes.push_back(Change(ChangeType::REMOVED, file->getPath(), fp.hash, ObjectId()));
+        } else {
+            sources.push_back(fp);
+        }
+    }
+    size_t removedCount = sources.size();
+    
+    for (FileObject* file : unchanged) {
+        Fingerprint fp = fingerprint(file);
+        if (fp.size > 0) {
+            sources.push_back(fp);
+        }
+    }
+    
+    for (FileObject* file : added) {
+        Fingerprint fp = fingerprint(file);
+        if (fp.size == 0) {
+            changes.push_back(Change(ChangeType::ADDED, file->getPath(), ObjectId(), fp.hash));
+        } else {
+            targets.push_back(fp);
+        }
+    }
+    
+    // Removed files are indexed first so an exact match prefers a rename
+    // over a copy of a file that still exists.
+    std::unordered_map<ObjectId, size_t> byHash;
+    std::unordered_map<uint64_t, std::vector<size_t>> buckets;
+    const int bands = SIGNATURE_SIZE / BAND_ROWS;
+    
+    auto bandKey = [](const Signature& signature, int band) {
+        uint64_t key = mix64(static_cast<uint64_t>(band) + 1);
+        for (int r = 0; r < BAND_ROWS; r++) {
+            key = mix64(key ^ signature[band * BAND_ROWS + r]);
+        }
+        return key;
+    };
+    
+    for (size_t s = 0; s < sources.size(); s++) {
+        byHash.emplace(sources[s].hash, s);
+        for (int band = 0; band < bands; band++) {
+            buckets[bandKey(sources[s].signature, band)].push_back(s);
+        }
+    }
+    
+    std::vector<Match> matches;
+    
+    for (size_t t = 0; t < targets.size(); t++) {
+        const Fingerprint& target = targets[t];
+        
+        auto exact = byHash.find(target.hash);
+        if (exact != byHash.end()) {
+            matches.push_back({t, exact->second, 1.0});
+            continue;
+        }
+        
+        std::vector<size_t> candidates;
+        for (int band = 0; band < bands; band++) {
+            auto bucket = buckets.find(bandKey(target.signature, band));
+            if (bucket != buckets.end()) {
+                candidates.insert(candidates.end(), bucket->second.begin(), bucket->second.end());
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        
+        std::vector<std::pair<double, size_t>> ranked;
+        for (size_t s : candidates) {
+            size_t smaller = std::min(sources[s].size, target.size);
+            size_t larger = std::max(sources[s].size, target.size);
+            if (static_cast<double>(smaller) / larger < threshold) {
+                continue;
+            }
+            ranked.push_back({estimateSimilarity(sources[s].signature, target.signature), s});
+        }
+        if (ranked.empty()) {
+            continue;
+        }
+        
+        size_t keep = std::min(ranked.size(), static_cast<size_t>(CANDIDATES_PER_FILE));
+        std::partial_sort(ranked.begin(), ranked.begin() + keep, ranked.end(),
+            [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) {
+                return a.first > b.first || (a.first == b.first && a.second < b.second);
+            });
+        
+        ContentView targetContent = target.file->viewContent();
+        for (size_t c = 0; c < keep; c++) {
+            double similarity = confirm(sources[ranked[c].second], targetContent, ranked[c].first);
+            if (similarity >= threshold) {
+                matches.push_back({t, ranked[c].second, similarity});
+            }
+        }
+    }
+    
+    std::stable_sort(matches.begin(), matches.end(), [removedCount](const Match& a, const Match& b) {
+        if (a.similarity != b.similarity) {
+            return a.similarity > b.similarity;
+        }
+        return (a.source < removedCount) && !(b.source < removedCount);
+    });
+    
+    std::vector<bool> sourceUsed(removedCount, false);
+    std::vector<bool> targetMatched(targets.size(), false);
+    
+    for (const auto& match : matches) {
+        if (targetMatched[match.target]) {
+            continue;
+        }
+        
+        const Fingerprint& source = sources[match.source];
+        const Fingerprint& target = targets[match.target];
+        
+        ChangeType type = ChangeType::COPIED;
+        if (match.source < removedCount && !sourceUsed[match.source]) {
+            type = ChangeType::RENAMED;
+            sourceUsed[match.source] = true;
+        }
+        
+        targetMatched[match.target] = true;
+        changes.push_back(Change(type, source.file->getPath(), target.file->getPath(),
+                                 source.hash, target.hash, match.similarity));
+    }
+    
+    for (size_t t = 0; t < targets.size(); t++) {
+        if (!targetMatched[t]) {
+            changes.push_back(Change(ChangeType::ADDED, targets[t].file->getPath(), ObjectId(), targets[t].hash));
+        }
+    }
+    
+    for (size_t s = 0; s < removedCount; s++) {
+        if (!sourceUsed[s]) {
+            changes.push_back(Change(ChangeType::REMOVED, sources[s].file->getPath(), sources[s].hash, ObjectId()));
+        }
+    }
+    
+    return changes;
+}
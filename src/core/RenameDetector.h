@@ -0,0 +1,51 @@
+#ifndef RENAMEDETECTOR_H
+#define RENAMEDETECTOR_H
+
+#include "DiffEngine.h"
+#include <array>
+
+class RenameDetector {
+private:
+    static const int SIGNATURE_SIZE = 64;
+    static const int BAND_ROWS = 2;
+    static const int CANDIDATES_PER_FILE = 5;
+    
+    typedef std::array<uint64_t, SIGNATURE_SIZE> Signature;
+    
+    struct Fingerprint {
+        FileObject* file;
+        ObjectId hash;
+        size_t size;
+        Signature signature;
+    };
+    
+    struct Match {
+        size_t target;
+        size_t source;
+        double similarity;
+    };
+    
+    DiffEngine engine;
+    double threshold;
+    size_t maxExactSize;
+    
+    Fingerprint fingerprint(FileObject* file);
+    double confirm(const Fingerprint& source, const ContentView& targetContent,
+                   double estimate);
+    
+    static double estimateSimilarity(const Signature& a, const Signature& b);
+    
+public:
+    RenameDetector(double threshold = 0.6);
+    
+    void setThreshold(double t) { threshold = t; }
+    void setMaxExactSize(size_t bytes) { maxExactSize = bytes; }
+    
+    std::vector<Change> detect(
+        const std::vector<FileObject*>& removed,
+        const std::vector<FileObject*>& added,
+        const std::vector<FileObject*>& unchanged = {}
+    );
+};
+
+#endif
@@ -0,0 +1,256 @@
+#include "StatCache.h"
+#include "FileObject.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char CACHE_MAGIC[4] = {'V', 'V', 'S', 'C'};
+
+void putU32(std::vector<char>& out, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void putU64(std::vector<char>& out, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+uint32_t getU32(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return static_cast<uint32_t>(u[0]) | (static_cast<uint32_t>(u[1]) << 8) |
+           (static_cast<uint32_t>(u[2]) << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+uint64_t getU64(const char* p) {
+    return static_cast<uint64_t>(getU32(p)) | (static_cast<uint64_t>(getU32(p + 4)) << 32);
+}
+
+}
+
+bool FileStat::read(const std::string& path, FileStat& out) {
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    
+    out.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    out.ctime = static_cast<int64_t>(st.st_ctim.tv_sec) * 1000000000LL + st.st_ctim.tv_nsec;
+    out.size = static_cast<uint64_t>(st.st_size);
+    out.inode = static_cast<uint64_t>(st.st_ino);
+    return true;
+}
+
+int64_t FileStat::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Layout: "VVSC", version, entry count, name bytes, hash algorithm, then
+// 84-byte entries sorted by path (id, mtime, ctime, size, inode, recorded,
+// name offset and length, type) followed by the concatenated paths.
+StatCache::StatCache(const std::string& path, HashAlgorithm hashAlgorithm)
+    : cachePath(path), algorithm(hashAlgorithm), tableCount(0) {
+    if (!fs::exists(cachePath)) {
+        return;
+    }
+    
+    ContentView mapped = ContentView::mapFile(cachePath);
+    if (mapped.size() < HEADER_SIZE || std::memcmp(mapped.data(), CACHE_MAGIC, 4) != 0 ||
+        getU32(mapped.data() + 4) != VERSION ||
+        getU32(mapped.data() + 16) != static_cast<uint32_t>(algorithm)) {
+        return;
+    }
+    
+    uint32_t count = getU32(mapped.data() + 8);
+    uint32_t nameBytes = getU32(mapped.data() + 12);
+    if (mapped.size() < HEADER_SIZE + static_cast<size_t>(count) * ENTRY_SIZE + nameBytes) {
+        return;
+    }
+    
+    table = mapped;
+    tableCount = count;
+}
+
+const char* StatCache::tableEntry(uint32_t i) const {
+    return table.data() + HEADER_SIZE + static_cast<size_t>(i) * ENTRY_SIZE;
+}
+
+std::string_view StatCache::entryPath(const char* entry) const {
+    const char* names = table.data() + HEADER_SIZE + static_cast<size_t>(tableCount) * ENTRY_SIZE;
+    return std::string_view(names + getU32(entry + 72), getU32(entry + 76));
+}
+
+StatCache::Entry StatCache::decodeEntry(const char* entry) const {
+    Entry result;
+    result.id = ObjectId(reinterpret_cast<const uint8_t*>(entry));
+    result.stat.mtime = static_cast<int64_t>(getU64(entry + 32));
+    result.stat.ctime = static_cast<int64_t>(getU64(entry + 40));
+    result.stat.size = getU64(entry + 48);
+    result.stat.inode = getU64(entry + 56);
+    result.recorded = static_cast<int64_t>(getU64(entry + 64));
+    result.type = static_cast<ObjectType>(getU32(entry + 80));
+    result.removed = false;
+    return result;
+}
+
+bool StatCache::findLocked(const std::string& path, Entry& entry) const {
+    auto it = pending.find(path);
+    if (it != pending.end()) {
+        entry = it->second;
+        return !entry.removed;
+    }
+    
+    uint32_t lo = 0;
+    uint32_t hi = tableCount;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = entryPath(tableEntry(mid)).compare(path);
+        if (cmp == 0) {
+            entry = decodeEntry(tableEntry(mid));
+            return true;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+bool StatCache::lookup(const std::string& path, const FileStat& stat, ObjectId& id,
+                       ObjectType& type) const {
+    std::shared_lock<std::shared_mutex> lock(mtx);
+    Entry entry;
+    if (!findLocked(path, entry) || entry.stat != stat) {
+        return false;
+    }
+    
+    if (std::max(stat.mtime, stat.ctime) + RACY_WINDOW > entry.recorded) {
+        return false;
+    }
+    
+    id = entry.id;
+    type = entry.type;
+    return true;
+}
+
+bool StatCache::lookup(const std::string& path, ObjectId& id) const {
+    FileStat stat;
+    ObjectType type;
+    return FileStat::read(path, stat) && lookup(path, stat, id, type);
+}
+
+void StatCache::update(const std::string& path, const FileStat& stat, const ObjectId& id,
+                       ObjectType type, int64_t recorded) {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    pending[path] = Entry{stat, id, type, recorded, false};
+}
+
+void StatCache::invalidate(const std::string& path) {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    pending[path] = Entry{FileStat(), ObjectId(), ObjectType::UNKNOWN, 0, true};
+}
+
+void StatCache::save() {
+    std::unique_lock<std::shared_mutex> lock(mtx);
+    if (pending.empty() && fs::exists(cachePath)) {
+        return;
+    }
+    
+    std::vector<std::pair<std::string, Entry>> entries;
+    entries.reserve(tableCount + pending.size());
+    for (uint32_t i = 0; i < tableCount; i++) {
+        std::string path(entryPath(tableEntry(i)));
+        if (pending.find(path) == pending.end()) {
+            entries.emplace_back(std::move(path), decodeEntry(tableEntry(i)));
+        }
+    }
+    for (const auto& pair : pending) {
+        if (!pair.second.removed) {
+            entries.push_back(pair);
+        }
+    }
+    std::sort(entries.begin(), entries.end(),
+        [](const std::pair<std::string, Entry>& a, const std::pair<std::string, Entry>& b) {
+            return a.first < b.first;
+        });
+    
+    size_t nameBytes = 0;
+    for (const auto& pair : entries) {
+        nameBytes += pair.first.size();
+    }
+    
+    std::vector<char> out(CACHE_MAGIC, CACHE_MAGIC + 4);
+    out.reserve(HEADER_SIZE + entries.size() * ENTRY_SIZE + nameBytes);
+    putU32(out, VERSION);
+    putU32(out, static_cast<uint32_t>(entries.size()));
+    putU32(out, static_cast<uint32_t>(nameBytes));
+    putU32(out, static_cast<uint32_t>(algorithm));
+    
+    uint32_t nameOffset = 0;
+    for (const auto& pair : entries) {
+        const Entry& entry = pair.second;
+        out.insert(out.end(), reinterpret_cast<const char*>(entry.id.begin()),
+                   reinterpret_cast<const char*>(entry.id.end()));
+        putU64(out, static_cast<uint64_t>(entry.stat.mtime));
+        putU64(out, static_cast<uint64_t>(entry.stat.ctime));
+        putU64(out, entry.stat.size);
+        putU64(out, entry.stat.inode);
+        putU64(out, static_cast<uint64_t>(entry.recorded));
+        putU32(out, nameOffset);
+        putU32(out, static_cast<uint32_t>(pair.first.size()));
+        putU32(out, static_cast<uint32_t>(entry.type));
+        nameOffset += static_cast<uint32_t>(pair.first.size());
+    }
+    for (const auto& pair : entries) {
+        out.insert(out.end(), pair.first.begin(), pair.first.end());
+    }
+    
+    std::string tmpPath = cachePath + ".tmp";
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw std::runtime_error("Cannot create stat cache: " + cachePath);
+    }
+    file.write(out.data(), out.size());
+    file.close();
+    if (!file) {
+        fs::remove(tmpPath);
+        throw std::runtime_error("Cannot write stat cache: " + cachePath);
+    }
+    
+    table = ContentView();
+    fs::rename(tmpPath, cachePath);
+    table = ContentView::mapFile(cachePath);
+    tableCount = static_cast<uint32_t>(entries.size());
+    pending.clear();
+}
+
+size_t StatCache::size() const {
+    std::shared_lock<std::shared_mutex> lock(mtx);
+    size_t count = 0;
+    for (uint32_t i = 0; i < tableCount; i++) {
+        if (pending.find(std::string(entryPath(tableEntry(i)))) == pending.end()) {
+            count++;
+        }
+    }
+    for (const auto& pair : pending) {
+        if (!pair.second.removed) {
+            count++;
+        }
+    }
+    return count;
+}
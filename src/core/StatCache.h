@@ -0,0 +1,92 @@
+#ifndef STATCACHE_H
+#define STATCACHE_H
+
+#include "ContentView.h"
+#include "Hasher.h"
+#include "ObjectId.h"
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+enum class ObjectType : uint8_t;
+
+struct FileStat {
+    int64_t mtime;
+    int64_t ctime;
+    uint64_t size;
+    uint64_t inode;
+    
+    FileStat() : mtime(0), ctime(0), size(0), inode(0) {}
+    
+    static bool read(const std::string& path, FileStat& out);
+    static int64_t now();
+    
+    bool operator==(const FileStat& other) const {
+        return mtime == other.mtime && ctime == other.ctime && size == other.size &&
+               inode == other.inode;
+    }
+    bool operator!=(const FileStat& other) const { return !(*this == other); }
+};
+
+// Remembers the object id last computed for each working-tree path along
+// with the file's stat data, so a file whose metadata is unchanged can be
+// reported without reading it. Like the git index, the cache is a sorted
+// table that is mapped on open, with updates held in memory until save().
+//
+// An entry is only trusted if the file's timestamps fall at least one
+// RACY_WINDOW before the moment it was hashed. Otherwise a write landing
+// in the same timestamp tick as the hash would go unnoticed; such racy
+// entries are simply hashed again until they age out of the window.
+//
+// Ids are only valid for the algorithm they were computed with, so the
+// cache records it and starts empty when opened with a different one.
+// Each entry also keeps the type the file was classified as, UNKNOWN when
+// the caller did not classify it, so a hit can skip reading it entirely.
+class StatCache {
+private:
+    struct Entry {
+        FileStat stat;
+        ObjectId id;
+        ObjectType type;
+        int64_t recorded;
+        bool removed;
+    };
+    
+    std::string cachePath;
+    HashAlgorithm algorithm;
+    ContentView table;
+    uint32_t tableCount;
+    std::unordered_map<std::string, Entry> pending;
+    mutable std::shared_mutex mtx;
+    
+    const char* tableEntry(uint32_t i) const;
+    std::string_view entryPath(const char* entry) const;
+    Entry decodeEntry(const char* entry) const;
+    bool findLocked(const std::string& path, Entry& entry) const;
+    
+public:
+    static const uint32_t VERSION = 3;
+    static const size_t HEADER_SIZE = 20;
+    static const size_t ENTRY_SIZE = 32 + 5 * 8 + 3 * 4;
+    static const int64_t RACY_WINDOW = 1000000000LL;
+    
+    explicit StatCache(const std::string& path, HashAlgorithm hashAlgorithm = HashAlgorithm::SHA256);
+    StatCache(const StatCache&) = delete;
+    StatCache& operator=(const StatCache&) = delete;
+    
+    bool lookup(const std::string& path, const FileStat& stat, ObjectId& id, ObjectType& type) const;
+    bool lookup(const std::string& path, ObjectId& id) const;
+    
+    // recorded is when hashing began; take it and the stat before reading.
+    void update(const std::string& path, const FileStat& stat, const ObjectId& id, ObjectType type,
+                int64_t recorded);
+    void invalidate(const std::string& path);
+    
+    void save();
+    size_t size() const;
+    const std::string& getPath() const { return cachePath; }
+    HashAlgorithm getAlgorithm() const { return algorithm; }
+};
+
+#endif
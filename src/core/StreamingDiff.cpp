@@ -0,0 +1,407 @@
+#include "StreamingDiff.h"
+#include "Arena.h"
+#include "Metrics.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const size_t COMPARE_BLOCK = 64 * 1024;
+// As in DiffAlgorithm::computeEdits.
+const size_t INTERNER_BYTES_PER_LINE = 64;
+
+// A run of the script over the whole input. Lines are 0-based line numbers
+// and begin and end are the offsets of a side's first line and of the line
+// after the run, as the runs are written straight from the input.
+struct Run {
+    EditType type;
+    int64_t oldLine;
+    int64_t newLine;
+    int64_t length;
+    size_t oldBegin;
+    size_t oldEnd;
+    size_t newBegin;
+    size_t newEnd;
+};
+
+// Where the line count lines before the one starting at end begins. Only
+// walks back over those lines, however far into the input end is.
+size_t linesBefore(const ContentView& content, size_t end, int64_t count) {
+    const char* data = content.data();
+    for (; count > 0 && end > 0; count--) {
+        size_t start = data[end - 1] == '\n' ? end - 1 : end;
+        while (start > 0 && data[start - 1] != '\n') {
+            start--;
+        }
+        end = start;
+    }
+    return end;
+}
+
+size_t nextLine(const ContentView& content, size_t pos) {
+    const void* found = std::memchr(content.data() + pos, '\n', content.size() - pos);
+    return found ? static_cast<const char*>(found) - content.data() + 1 : content.size();
+}
+
+// Counts the lines in [begin, end), stopping at limit.
+int64_t countLines(const ContentView& content, size_t begin, size_t end, int64_t limit) {
+    int64_t count = 0;
+    while (begin < end && count < limit) {
+        begin = nextLine(content, begin);
+        count++;
+    }
+    return count;
+}
+
+// forEachHunk over runs arriving one at a time. A run of equal lines is
+// held until the next change, or the end, shows whether it separates two
+// hunks or joins them.
+class HunkStream {
+private:
+    const ContentView& oldContent;
+    const ContentView& newContent;
+    const UnifiedDiffFormatter& formatter;
+    DiffSink& sink;
+    int64_t context;
+    std::vector<Run> hunk;
+    Run held;
+    bool holding;
+    bool started;
+    
+    void writeLines(char marker, const ContentView& content, size_t pos, int64_t count) {
+        for (int64_t k = 0; k < count && pos < content.size(); k++) {
+            size_t next = nextLine(content, pos);
+            size_t end = content[next - 1] == '\n' ? next - 1 : next;
+            sink.write(&marker, 1);
+            sink.write(content.data() + pos, end - pos);
+            sink.write("\n", 1);
+            pos = next;
+        }
+    }
+    
+    void trail() {
+        int64_t length = std::min(context, held.length);
+        if (length > 0) {
+            hunk.push_back({EditType::EQUAL, held.oldLine, held.newLine, length,
+                            held.oldBegin, 0, held.newBegin, 0});
+        }
+    }
+    
+    void flush() {
+        if (!started) {
+            formatter.writeHeader(sink);
+            started = true;
+        }
+        
+        int64_t oldCount = 0;
+        int64_t newCount = 0;
+        for (const Run& run : hunk) {
+            if (run.type != EditType::INSERT) {
+                oldCount += run.length;
+            }
+            if (run.type != EditType::DELETE) {
+                newCount += run.length;
+            }
+        }
+        UnifiedDiffFormatter::writeHunkHeader(sink, hunk.front().oldLine, oldCount,
+                                              hunk.front().newLine, newCount);
+        
+        for (const Run& run : hunk) {
+            switch (run.type) {
+                case EditType::EQUAL:
+                    writeLines(' ', oldContent, run.oldBegin, run.length);
+                    break;
+                case EditType::DELETE:
+                    writeLines('-', oldContent, run.oldBegin, run.length);
+                    break;
+                case EditType::INSERT:
+                    writeLines('+', newContent, run.newBegin, run.length);
+                    break;
+            }
+        }
+        hunk.clear();
+    }
+    
+public:
+    HunkStream(const ContentView& oldView, const ContentView& newView,
+               const UnifiedDiffFormatter& format, DiffSink& out)
+        : oldContent(oldView), newContent(newView), formatter(format), sink(out),
+          context(format.getContext()), holding(false), started(false) {}
+    
+    void add(const Run& run) {
+        if (run.length == 0) {
+            return;
+        }
+        if (run.type == EditType::EQUAL) {
+            if (holding) {
+                held.length += run.length;
+                held.oldEnd = run.oldEnd;
+                held.newEnd = run.newEnd;
+            } else {
+                held = run;
+                holding = true;
+            }
+            return;
+        }
+        
+        if (holding) {
+            if (!hunk.empty() && held.length <= 2 * context) {
+                hunk.push_back(held);
+            } else {
+                if (!hunk.empty()) {
+                    trail();
+                    flush();
+                }
+                int64_t lead = std::min(context, held.length);
+                if (lead > 0) {
+                    hunk.push_back({EditType::EQUAL, held.oldLine + held.length - lead,
+                                    held.newLine + held.length - lead, lead,
+                                    linesBefore(oldContent, held.oldEnd, lead), held.oldEnd,
+                                    linesBefore(newContent, held.newEnd, lead), held.newEnd});
+                }
+            }
+            holding = false;
+        }
+        hunk.push_back(run);
+    }
+    
+    void finish() {
+        if (hunk.empty()) {
+            return;
+        }
+        if (holding) {
+            trail();
+        }
+        flush();
+    }
+    
+    bool wroteHunks() const { return started; }
+};
+
+// One side's lines between the prefix and suffix still to be diffed.
+struct Cursor {
+    const ContentView& content;
+    size_t pos;
+    size_t end;
+    int64_t line;
+    
+    // Reads up to limit lines and returns where the next would start.
+    size_t load(size_t limit, std::vector<std::string_view>& lines) const {
+        lines.clear();
+        size_t at = pos;
+        while (at < end && lines.size() < limit) {
+            size_t next = std::min(nextLine(content, at), end);
+            size_t stop = content[next - 1] == '\n' ? next - 1 : next;
+            lines.emplace_back(content.data() + at, stop - at);
+            at = next;
+        }
+        return at;
+    }
+    
+    size_t offsetOf(const std::vector<std::string_view>& lines, size_t index, size_t loaded) const {
+        return index < lines.size() ? lines[index].data() - content.data() : loaded;
+    }
+};
+
+// The last line kept equal by the script that ends both sides' share of
+// it within the limits. One that occurs once on each side is preferred, as
+// it is unlikely to be matched differently once more lines are seen.
+bool findAnchor(const std::vector<Edit>& edits,
+                const std::vector<uint32_t>& oldIds, const std::vector<uint32_t>& newIds,
+                size_t distinct, size_t oldLimit, size_t newLimit,
+                size_t& oldCut, size_t& newCut) {
+    std::vector<uint8_t> oldCounts(distinct, 0);
+    std::vector<uint8_t> newCounts(distinct, 0);
+    for (uint32_t id : oldIds) {
+        oldCounts[id] = static_cast<uint8_t>(std::min(oldCounts[id] + 1, 2));
+    }
+    for (uint32_t id : newIds) {
+        newCounts[id] = static_cast<uint8_t>(std::min(newCounts[id] + 1, 2));
+    }
+    
+    bool found = false;
+    bool unique = false;
+    for (const Edit& edit : edits) {
+        if (edit.type != EditType::EQUAL) {
+            continue;
+        }
+        for (int k = 0; k < edit.length; k++) {
+            size_t oldEnd = edit.oldStart + k + 1;
+            size_t newEnd = edit.newStart + k + 1;
+            if (oldEnd > oldLimit || newEnd > newLimit) {
+                return found;
+            }
+            uint32_t id = oldIds[oldEnd - 1];
+            if (oldCounts[id] == 1 && newCounts[id] == 1) {
+                unique = true;
+            } else if (unique) {
+                continue;
+            }
+            oldCut = oldEnd;
+            newCut = newEnd;
+            found = true;
+        }
+    }
+    return found;
+}
+
+}
+
+StreamingDiff::StreamingDiff(DiffAlgorithm& algo, const UnifiedDiffFormatter& format,
+                             size_t window)
+    : algorithm(algo), formatter(format),
+      windowLines(window < MIN_WINDOW_LINES ? MIN_WINDOW_LINES : window) {
+}
+
+bool StreamingDiff::diff(const ContentView& oldContent, const ContentView& newContent,
+                         DiffSink& sink) {
+    VV_TIME(DIFF);
+    
+    const char* a = oldContent.data();
+    const char* b = newContent.data();
+    size_t oldSize = oldContent.size();
+    size_t newSize = newContent.size();
+    size_t common = std::min(oldSize, newSize);
+    
+    // The prefix ends at the start of the line holding the first byte that
+    // differs.
+    size_t first = 0;
+    while (first < common) {
+        size_t block = std::min(COMPARE_BLOCK, common - first);
+        if (std::memcmp(a + first, b + first, block) != 0) {
+            while (a[first] == b[first]) {
+                first++;
+            }
+            break;
+        }
+        first += block;
+    }
+    if (first == common && oldSize == newSize) {
+        return false;
+    }
+    size_t prefix = first;
+    while (prefix > 0 && a[prefix - 1] != '\n') {
+        prefix--;
+    }
+    int64_t prefixLines = std::count(a, a + prefix, '\n');
+    
+    // The suffix is matched the same way from the ends, then moved up to
+    // the next start of a line on both sides. Being the same bytes, it
+    // splits into the same lines.
+    size_t limit = common - prefix;
+    size_t tail = 0;
+    while (tail < limit) {
+        size_t block = std::min(COMPARE_BLOCK, limit - tail);
+        if (std::memcmp(a + oldSize - tail - block, b + newSize - tail - block, block) != 0) {
+            while (a[oldSize - tail - 1] == b[newSize - tail - 1]) {
+                tail++;
+            }
+            break;
+        }
+        tail += block;
+    }
+    size_t oldTail = oldSize - tail;
+    size_t newTail = newSize - tail;
+    if ((oldTail != prefix && a[oldTail - 1] != '\n') ||
+        (newTail != prefix && b[newTail - 1] != '\n')) {
+        size_t skip = nextLine(oldContent, oldTail) - oldTail;
+        oldTail += skip;
+        newTail += skip;
+    }
+    
+    HunkStream hunks(oldContent, newContent, formatter, sink);
+    hunks.add({EditType::EQUAL, 0, 0, prefixLines, 0, prefix, 0, prefix});
+    
+    Cursor oldSide{oldContent, prefix, oldTail, prefixLines};
+    Cursor newSide{newContent, prefix, newTail, prefixLines};
+    std::vector<std::string_view> oldLines;
+    std::vector<std::string_view> newLines;
+    size_t margin = windowLines / 4;
+    
+    while (oldSide.pos < oldSide.end || newSide.pos < newSide.end) {
+        size_t oldLoaded = oldSide.load(windowLines, oldLines);
+        size_t newLoaded = newSide.load(windowLines, newLines);
+        bool oldDone = oldLoaded == oldSide.end;
+        bool newDone = newLoaded == newSide.end;
+        
+        Arena scratch(std::max<size_t>(1024, (oldLines.size() + newLines.size()) * INTERNER_BYTES_PER_LINE));
+        LineInterner interner(scratch.resource());
+        interner.reserve(oldLines.size() + newLines.size());
+        std::vector<uint32_t> oldIds = interner.intern(oldLines);
+        std::vector<uint32_t> newIds = interner.intern(newLines);
+        std::vector<Edit> edits = algorithm.computeEdits(oldLines, newLines, oldIds, newIds);
+        
+        // Near the end of a window the script may pair lines that the next
+        // one would not, so unless both sides are done only what comes
+        // before an anchor is kept.
+        size_t oldCut = oldLines.size();
+        size_t newCut = newLines.size();
+        bool anchored = oldDone && newDone;
+        if (!anchored) {
+            anchored = findAnchor(edits, oldIds, newIds, interner.size(),
+                                  oldDone ? oldLines.size() : oldLines.size() - margin,
+                                  newDone ? newLines.size() : newLines.size() - margin,
+                                  oldCut, newCut);
+        }
+        
+        if (anchored) {
+            for (const Edit& edit : edits) {
+                size_t length = edit.length;
+                if (edit.type == EditType::INSERT) {
+                    if (static_cast<size_t>(edit.newStart) >= newCut) {
+                        break;
+                    }
+                    length = std::min(length, newCut - edit.newStart);
+                } else {
+                    if (static_cast<size_t>(edit.oldStart) >= oldCut) {
+                        break;
+                    }
+                    length = std::min(length, oldCut - edit.oldStart);
+                }
+                size_t oldLength = edit.type == EditType::INSERT ? 0 : length;
+                size_t newLength = edit.type == EditType::DELETE ? 0 : length;
+                hunks.add({edit.type, oldSide.line + edit.oldStart, newSide.line + edit.newStart,
+                           static_cast<int64_t>(length),
+                           oldSide.offsetOf(oldLines, edit.oldStart, oldLoaded),
+                           oldSide.offsetOf(oldLines, edit.oldStart + oldLength, oldLoaded),
+                           newSide.offsetOf(newLines, edit.newStart, newLoaded),
+                           newSide.offsetOf(newLines, edit.newStart + newLength, newLoaded)});
+            }
+        } else {
+            oldCut = oldDone ? 0 : windowLines / 2;
+            newCut = newDone ? 0 : windowLines / 2;
+            if (oldLines.empty()) {
+                newCut = newLines.size();
+            }
+            if (newLines.empty()) {
+                oldCut = oldLines.size();
+            }
+            size_t oldEnd = oldSide.offsetOf(oldLines, oldCut, oldLoaded);
+            size_t newEnd = newSide.offsetOf(newLines, newCut, newLoaded);
+            hunks.add({EditType::DELETE, oldSide.line, newSide.line, static_cast<int64_t>(oldCut),
+                       oldSide.pos, oldEnd, newSide.pos, newSide.pos});
+            hunks.add({EditType::INSERT, oldSide.line + static_cast<int64_t>(oldCut), newSide.line,
+                       static_cast<int64_t>(newCut), oldEnd, oldEnd, newSide.pos, newEnd});
+        }
+        
+        oldSide.pos = oldSide.offsetOf(oldLines, oldCut, oldLoaded);
+        newSide.pos = newSide.offsetOf(newLines, newCut, newLoaded);
+        oldSide.line += oldCut;
+        newSide.line += newCut;
+    }
+    
+    // Only the suffix's first lines can end up in a hunk.
+    int64_t suffixLines = countLines(oldContent, oldTail, oldSize, formatter.getContext());
+    hunks.add({EditType::EQUAL, oldSide.line, newSide.line, suffixLines,
+               oldTail, oldSize, newTail, newSize});
+    hunks.finish();
+    return hunks.wroteHunks();
+}
+
+bool StreamingDiff::diffFiles(const std::string& oldPath, const std::string& newPath,
+                              DiffSink& sink) {
+    ContentView oldContent = ContentView::mapFile(oldPath);
+    ContentView newContent = ContentView::mapFile(newPath);
+    return diff(oldContent, newContent, sink);
+}
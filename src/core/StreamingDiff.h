@@ -0,0 +1,45 @@
+#ifndef STREAMINGDIFF_H
+#define STREAMINGDIFF_H
+
+#include "ContentView.h"
+#include "DiffEngine.h"
+#include "DiffFormatter.h"
+#include <cstddef>
+#include <string>
+
+// Unified diff of inputs too large to hold as line vectors, such as files
+// mapped with ContentView::mapFile. The common prefix and suffix are
+// skipped by comparing bytes, and the lines between them are diffed a
+// window at a time: each window's script is kept up to the last line that
+// occurs once on both sides and lines up away from the window's end, and
+// the rest is diffed again with the next window. Hunks go to the sink as
+// soon as they are complete, and lines are written from the input rather
+// than kept, so memory is bounded by the window and the number of runs in
+// the largest hunk, not by the size of the inputs.
+//
+// Inputs that fit in one window get the algorithm's own script, apart from
+// where it would place an ambiguous change inside the prefix or suffix. A
+// window with nothing to anchor on comes out as half a window deleted and
+// inserted, so long stretches with no lines in common may be reported as
+// larger changes than they are.
+class StreamingDiff {
+private:
+    DiffAlgorithm& algorithm;
+    UnifiedDiffFormatter formatter;
+    size_t windowLines;
+    
+public:
+    static const size_t DEFAULT_WINDOW_LINES = 64 * 1024;
+    static const size_t MIN_WINDOW_LINES = 16;
+    
+    explicit StreamingDiff(DiffAlgorithm& algo,
+                           const UnifiedDiffFormatter& format = UnifiedDiffFormatter(),
+                           size_t window = DEFAULT_WINDOW_LINES);
+    
+    // True when the inputs differ in any line, in which case at least one
+    // hunk was written.
+    bool diff(const ContentView& oldContent, const ContentView& newContent, DiffSink& sink);
+    bool diffFiles(const std::string& oldPath, const std::string& newPath, DiffSink& sink);
+};
+
+#endif
@@ -0,0 +1,189 @@
+#include "ThreadPool.h"
+#include <atomic>
+#include <exception>
+
+namespace {
+
+// The pool and deque index of the worker running on this thread, if any.
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local size_t currentIndex = 0;
+
+}
+
+ThreadPool::ThreadPool(size_t threads) 
+    : pending(0), stopping(false) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    for (size_t i = 0; i < threads; i++) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        workers.emplace_back([this, i]() { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+bool ThreadPool::takeTask(size_t index, std::function<void()>& task) {
+    size_t count = queues.size();
+    if (index < count) {
+        WorkQueue& own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mtx);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            pending.fetch_sub(1);
+            return true;
+        }
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!tasks.empty()) {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            pending.fetch_sub(1);
+            return true;
+        }
+    }
+    
+    for (size_t k = 1; k <= count; k++) {
+        WorkQueue& victim = *queues[(index + k) % count];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            pending.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    currentPool = this;
+    currentIndex = index;
+    
+    while (true) {
+        std::function<void()> task;
+        if (takeTask(index, task)) {
+            task();
+            continue;
+        }
+        
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [this]() { return stopping || pending.load() > 0; });
+        if (stopping && pending.load() == 0) {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::tryRunTask() {
+    std::function<void()> task;
+    size_t index = currentPool == this ? currentIndex : queues.size();
+    if (!takeTask(index, task)) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    // Counted before it is queued so a thief can never take it first and
+    // drive the count below zero.
+    pending.fetch_add(1);
+    if (currentPool == this) {
+        WorkQueue& own = *queues[currentIndex];
+        std::lock_guard<std::mutex> lock(own.mtx);
+        own.tasks.push_back(std::move(task));
+    } else {
+        std::lock_guard<std::mutex> lock(mtx);
+        tasks.push_back(std::move(task));
+    }
+    
+    // Taking the lock orders this with a worker that has just seen no
+    // pending work and is about to wait, so the notification is not lost.
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+    }
+    cv.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || workers.size() <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            body(i);
+        }
+        return;
+    }
+    
+    // The caller works through the range alongside the helpers and only
+    // waits for indices that were actually claimed, so a helper that never
+    // gets a thread (e.g. when called from inside a worker) cannot block it.
+    struct State {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        size_t count;
+        const std::function<void(size_t)>* body;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::exception_ptr error;
+    };
+    
+    auto state = std::make_shared<State>();
+    state->count = count;
+    state->body = &body;
+    
+    auto run = [](const std::shared_ptr<State>& s) {
+        size_t i;
+        while ((i = s->next.fetch_add(1)) < s->count) {
+            try {
+                (*s->body)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(s->mtx);
+                if (!s->error) {
+                    s->error = std::current_exception();
+                }
+            }
+            if (s->done.fetch_add(1) + 1 == s->count) {
+                std::lock_guard<std::mutex> lock(s->mtx);
+                s->cv.notify_all();
+            }
+        }
+    };
+    
+    size_t helpers = std::min(workers.size(), count - 1);
+    for (size_t h = 0; h < helpers; h++) {
+        enqueue([state, run]() { run(state); });
+    }
+    
+    run(state);
+    
+    std::unique_lock<std::mutex> lock(state->mtx);
+    state->cv.wait(lock, [&state]() { return state->done.load() == state->count; });
+    
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+
+// Each worker keeps its own deque: tasks submitted from a worker go to the
+// back of its deque and are run newest first, tasks from other threads go
+// to a shared queue, and an idle worker steals the oldest task from the
+// others before going to sleep.
+class ThreadPool {
+private:
+    struct WorkQueue {
+        std::mutex mtx;
+        std::deque<std::function<void()>> tasks;
+    };
+    
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::deque<std::function<void()>> tasks;
+    std::atomic<size_t> pending;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopping;
+    
+    void workerLoop(size_t index);
+    void enqueue(std::function<void()> task);
+    bool takeTask(size_t index, std::function<void()>& task);
+    
+public:
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    static ThreadPool& shared();
+    
+    template<typename Func>
+    auto submit(Func&& func) -> std::future<decltype(func())> {
+        typedef decltype(func()) Result;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Func>(func));
+        std::future<Result> result = task->get_future();
+        enqueue([task]() { (*task)(); });
+        return result;
+    }
+    
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+    
+    // Runs one queued task on the calling thread, if there is one, so a
+    // thread waiting on pool work can help instead of blocking a worker.
+    bool tryRunTask();
+    
+    size_t getThreadCount() const { return workers.size(); }
+};
+
+#endif
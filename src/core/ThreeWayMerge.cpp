@@ -0,0 +1,184 @@
+#include "ThreeWayMerge.h"
+#include <algorithm>
+
+namespace {
+
+const char* const OURS_MARKER = "<<<<<<< OURS";
+const char* const SEPARATOR = "=======";
+const char* const THEIRS_MARKER = ">>>>>>> THEIRS";
+
+// A base range one side replaced, and what it was replaced with.
+struct SideChange {
+    int baseStart;
+    int baseEnd;
+    int sideStart;
+    int sideEnd;
+};
+
+// Folds each DELETE/INSERT pair of an edit script into one change.
+std::vector<SideChange> changesOf(const std::vector<Edit>& edits) {
+    std::vector<SideChange> changes;
+    for (const Edit& edit : edits) {
+        if (edit.type == EditType::EQUAL) {
+            continue;
+        }
+        
+        int baseLength = edit.type == EditType::DELETE ? edit.length : 0;
+        int sideLength = edit.type == EditType::INSERT ? edit.length : 0;
+        if (!changes.empty() && changes.back().baseEnd == edit.oldStart &&
+            changes.back().sideEnd == edit.newStart) {
+            changes.back().baseEnd += baseLength;
+            changes.back().sideEnd += sideLength;
+        } else {
+            changes.push_back({edit.oldStart, edit.oldStart + baseLength,
+                               edit.newStart, edit.newStart + sideLength});
+        }
+    }
+    return changes;
+}
+
+void appendLines(std::vector<std::string>& out, const std::vector<std::string_view>& lines,
+                 int start, int end) {
+    for (int i = start; i < end; i++) {
+        out.emplace_back(lines[i]);
+    }
+}
+
+std::vector<std::string> copyLines(const std::vector<std::string_view>& lines, int start, int end) {
+    std::vector<std::string> result;
+    result.reserve(end - start);
+    appendLines(result, lines, start, end);
+    return result;
+}
+
+}
+
+ThreeWayMerge::ThreeWayMerge()
+    : algorithm(new AdaptiveDiff()) {
+}
+
+ThreeWayMerge::~ThreeWayMerge() {
+    delete algorithm;
+}
+
+void ThreeWayMerge::setAlgorithm(DiffAlgorithm* algo) {
+    if (algorithm) {
+        delete algorithm;
+    }
+    algorithm = algo;
+}
+
+MergeResult ThreeWayMerge::merge(const std::vector<std::string_view>& base,
+                                 const std::vector<std::string_view>& ours,
+                                 const std::vector<std::string_view>& theirs) {
+    std::vector<SideChange> oursChanges = changesOf(algorithm->computeEdits(base, ours));
+    std::vector<SideChange> theirsChanges = changesOf(algorithm->computeEdits(base, theirs));
+    
+    MergeResult result;
+    result.content.reserve(std::max(ours.size(), theirs.size()));
+    
+    size_t io = 0, it = 0;
+    int basePos = 0;
+    // Offset from a base line to the same line on each side, for the base
+    // lines after the changes consumed so far.
+    int oursDelta = 0, theirsDelta = 0;
+    
+    while (io < oursChanges.size() || it < theirsChanges.size()) {
+        int lo;
+        if (it == theirsChanges.size() ||
+            (io < oursChanges.size() && oursChanges[io].baseStart <= theirsChanges[it].baseStart)) {
+            lo = oursChanges[io].baseStart;
+        } else {
+            lo = theirsChanges[it].baseStart;
+        }
+        
+        int oursLo = lo + oursDelta;
+        int theirsLo = lo + theirsDelta;
+        size_t oursFirst = io, theirsFirst = it;
+        
+        // Pull in changes from either side until none starts inside or
+        // right at the end of the group.
+        int hi = lo;
+        bool grew = true;
+        while (grew) {
+            grew = false;
+            if (io < oursChanges.size() && oursChanges[io].baseStart <= hi) {
+                const SideChange& change = oursChanges[io++];
+                hi = std::max(hi, change.baseEnd);
+                oursDelta += (change.sideEnd - change.sideStart) - (change.baseEnd - change.baseStart);
+                grew = true;
+            }
+            if (it < theirsChanges.size() && theirsChanges[it].baseStart <= hi) {
+                const SideChange& change = theirsChanges[it++];
+                hi = std::max(hi, change.baseEnd);
+                theirsDelta += (change.sideEnd - change.sideStart) - (change.baseEnd - change.baseStart);
+                grew = true;
+            }
+        }
+        
+        int oursHi = hi + oursDelta;
+        int theirsHi = hi + theirsDelta;
+        bool oursChanged = io > oursFirst;
+        bool theirsChanged = it > theirsFirst;
+        
+        appendLines(result.content, base, basePos, lo);
+        basePos = hi;
+        
+        if (!theirsChanged) {
+            appendLines(result.content, ours, oursLo, oursHi);
+            continue;
+        }
+        if (!oursChanged) {
+            appendLines(result.content, theirs, theirsLo, theirsHi);
+            continue;
+        }
+        if (std::equal(ours.begin() + oursLo, ours.begin() + oursHi,
+                       theirs.begin() + theirsLo, theirs.begin() + theirsHi)) {
+            appendLines(result.content, ours, oursLo, oursHi);
+            continue;
+        }
+        
+        ConflictRegion conflict;
+        conflict.ours = copyLines(ours, oursLo, oursHi);
+        conflict.theirs = copyLines(theirs, theirsLo, theirsHi);
+        
+        result.content.push_back(OURS_MARKER);
+        result.content.insert(result.content.end(), conflict.ours.begin(), conflict.ours.end());
+        result.content.push_back(SEPARATOR);
+        result.content.insert(result.content.end(), conflict.theirs.begin(), conflict.theirs.end());
+        result.content.push_back(THEIRS_MARKER);
+        result.conflicts.push_back(std::move(conflict));
+    }
+    
+    appendLines(result.content, base, basePos, static_cast<int>(base.size()));
+    result.status = result.conflicts.empty() ? MergeStatus::SUCCESS : MergeStatus::CONFLICT;
+    return result;
+}
+
+MergeResult ThreeWayMerge::merge(const std::vector<std::string>& base,
+                                 const std::vector<std::string>& ours,
+                                 const std::vector<std::string>& theirs) {
+    return merge(std::vector<std::string_view>(base.begin(), base.end()),
+                 std::vector<std::string_view>(ours.begin(), ours.end()),
+                 std::vector<std::string_view>(theirs.begin(), theirs.end()));
+}
+
+MergeResult ThreeWayMerge::merge(TextFile* base, TextFile* ours, TextFile* theirs) {
+    std::vector<std::string_view> baseLines;
+    if (base) {
+        baseLines = base->getLineViews();
+    }
+    
+    return merge(baseLines,
+                 ours ? ours->getLineViews() : std::vector<std::string_view>(),
+                 theirs ? theirs->getLineViews() : std::vector<std::string_view>());
+}
+
+std::vector<MergeResult> ThreeWayMerge::mergeAll(const std::vector<MergeInput>& inputs,
+                                                 ThreadPool& pool) {
+    std::vector<MergeResult> results(inputs.size());
+    pool.parallelFor(inputs.size(), [&](size_t i) {
+        results[i] = merge(inputs[i].base, inputs[i].ours, inputs[i].theirs);
+    });
+    return results;
+}
@@ -0,0 +1,72 @@
+#ifndef THREEWAYMERGE_H
+#define THREEWAYMERGE_H
+
+#include "DiffEngine.h"
+#include "ThreadPool.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Mirrors com.versionvault.merge, so results can be handed to the Java
+// side unchanged.
+enum class MergeStatus {
+    SUCCESS,
+    CONFLICT,
+    AUTOMATIC
+};
+
+struct ConflictRegion {
+    std::vector<std::string> ours;
+    std::vector<std::string> theirs;
+};
+
+struct MergeResult {
+    MergeStatus status;
+    std::vector<std::string> content;
+    std::vector<ConflictRegion> conflicts;
+    
+    bool hasConflicts() const { return !conflicts.empty(); }
+};
+
+struct MergeInput {
+    TextFile* base;
+    TextFile* ours;
+    TextFile* theirs;
+};
+
+// diff3: both sides are diffed against the base, changes whose base
+// ranges overlap or touch are grouped, and a group is taken from whichever
+// side changed it. A group both sides changed is a conflict unless they
+// made the same change. Conflicts are written between the same markers as
+// the Java ThreeWayMerge.
+class ThreeWayMerge {
+private:
+    DiffAlgorithm* algorithm;
+    
+public:
+    ThreeWayMerge();
+    ~ThreeWayMerge();
+    ThreeWayMerge(const ThreeWayMerge&) = delete;
+    ThreeWayMerge& operator=(const ThreeWayMerge&) = delete;
+    
+    // Takes ownership; the algorithm is shared by concurrent merges and
+    // must not keep state between calls.
+    void setAlgorithm(DiffAlgorithm* algo);
+    
+    MergeResult merge(const std::vector<std::string_view>& base,
+                      const std::vector<std::string_view>& ours,
+                      const std::vector<std::string_view>& theirs);
+    MergeResult merge(const std::vector<std::string>& base,
+                      const std::vector<std::string>& ours,
+                      const std::vector<std::string>& theirs);
+    
+    // A null base merges the two sides as additions to an empty file.
+    MergeResult merge(TextFile* base, TextFile* ours, TextFile* theirs);
+    
+    // Each input is merged as its own task; every file in inputs must be
+    // distinct.
+    std::vector<MergeResult> mergeAll(const std::vector<MergeInput>& inputs,
+                                      ThreadPool& pool = ThreadPool::shared());
+};
+
+#endif
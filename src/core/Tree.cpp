@@ -0,0 +1,63 @@
+#include "Tree.h"
+#include "FileObject.h"
+#include <algorithm>
+
+std::unique_ptr<Tree> Tree::fromMap(const std::map<std::string, ObjectId>& files) {
+    std::unique_ptr<Tree> root(new Tree());
+    
+    // Sorted input keeps every path under a directory contiguous, so the
+    // directory being filled is always the last entry of its parent.
+    for (const auto& pair : files) {
+        const std::string& path = pair.first;
+        Tree* current = root.get();
+        size_t start = 0;
+        
+        while (true) {
+            size_t slash = path.find('/', start);
+            if (slash == std::string::npos) {
+                break;
+            }
+            if (slash > start) {
+                std::string name = path.substr(start, slash - start);
+                if (current->entries.empty() || !current->entries.back().isDirectory() ||
+                    current->entries.back().name != name) {
+                    current->entries.push_back({name, ObjectId(), std::unique_ptr<Tree>(new Tree())});
+                }
+                current = current->entries.back().subtree.get();
+            }
+            start = slash + 1;
+        }
+        
+        if (start < path.size()) {
+            current->entries.push_back({path.substr(start), pair.second, nullptr});
+        }
+    }
+    
+    root->finish();
+    return root;
+}
+
+void Tree::finish() {
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        int cmp = a.name.compare(b.name);
+        return cmp < 0 || (cmp == 0 && !a.isDirectory() && b.isDirectory());
+    });
+    
+    std::unique_ptr<Hasher> hasher = Hasher::create(FileObject::getHashAlgorithm());
+    files = 0;
+    for (Entry& entry : entries) {
+        if (entry.isDirectory()) {
+            entry.subtree->finish();
+            entry.id = entry.subtree->id;
+            files += entry.subtree->files;
+        } else {
+            files++;
+        }
+        
+        char kind = entry.isDirectory() ? 'd' : 'f';
+        hasher->update(&kind, 1);
+        hasher->update(entry.name.data(), entry.name.size() + 1);
+        hasher->update(entry.id.data(), ObjectId::SIZE);
+    }
+    id = hasher->finish();
+}
@@ -0,0 +1,47 @@
+#ifndef TREE_H
+#define TREE_H
+
+#include "ObjectId.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A snapshot of a directory tree. Like a git tree, every directory carries
+// a hash of its entries, so two snapshots can be compared a directory at a
+// time and identical subtrees skipped without looking inside them.
+class Tree {
+public:
+    struct Entry {
+        std::string name;
+        ObjectId id;
+        std::unique_ptr<Tree> subtree;
+        
+        bool isDirectory() const { return subtree != nullptr; }
+    };
+    
+private:
+    std::vector<Entry> entries;
+    ObjectId id;
+    size_t files;
+    
+    void finish();
+    
+public:
+    Tree() : files(0) {}
+    Tree(const Tree&) = delete;
+    Tree& operator=(const Tree&) = delete;
+    
+    // Paths are split on '/'; empty components are ignored.
+    static std::unique_ptr<Tree> fromMap(const std::map<std::string, ObjectId>& files);
+    
+    const ObjectId& getId() const { return id; }
+    
+    // Sorted by name, with a file ordered before a directory of the same
+    // name.
+    const std::vector<Entry>& getEntries() const { return entries; }
+    
+    size_t getFileCount() const { return files; }
+};
+
+#endif
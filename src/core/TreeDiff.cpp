@@ -0,0 +1,211 @@
+#include "TreeDiff.h"
+#include "ObjectStore.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+
+// Shared by the tasks of one diff() call. Results are queued here and
+// handed to the callback by the calling thread.
+struct TreeDiff::Run {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<std::pair<Change, std::vector<Hunk>>> results;
+    size_t outstanding = 0;
+    bool cancelled = false;
+    std::exception_ptr error;
+    
+    void fail(std::exception_ptr e) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!error) {
+            error = e;
+        }
+        cancelled = true;
+    }
+    
+    void report(Change change, std::vector<Hunk> hunks = {}) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!cancelled) {
+            results.emplace_back(std::move(change), std::move(hunks));
+            cv.notify_one();
+        }
+    }
+    
+    bool isCancelled() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return cancelled;
+    }
+};
+
+namespace {
+
+bool entryBefore(const Tree::Entry& a, const Tree::Entry& b) {
+    int cmp = a.name.compare(b.name);
+    return cmp < 0 || (cmp == 0 && !a.isDirectory() && b.isDirectory());
+}
+
+}
+
+template<typename Func>
+void TreeDiff::spawn(const std::shared_ptr<Run>& run, Func func) {
+    {
+        std::lock_guard<std::mutex> lock(run->mtx);
+        run->outstanding++;
+    }
+    pool.submit([run, func]() {
+        try {
+            func();
+        } catch (...) {
+            run->fail(std::current_exception());
+        }
+        std::lock_guard<std::mutex> lock(run->mtx);
+        run->outstanding--;
+        run->cv.notify_one();
+    });
+}
+
+TreeDiff::TreeDiff(ThreadPool& threads)
+    : pool(threads), store(nullptr), contextLines(3) {
+}
+
+void TreeDiff::reportAll(const std::shared_ptr<Run>& run, const Tree& tree,
+                         const std::string& prefix, ChangeType type) {
+    for (const Tree::Entry& entry : tree.getEntries()) {
+        std::string path = prefix + entry.name;
+        if (entry.isDirectory()) {
+            reportAll(run, *entry.subtree, path + "/", type);
+        } else if (type == ChangeType::ADDED) {
+            run->report(Change(type, path, ObjectId(), entry.id));
+        } else {
+            run->report(Change(type, path, entry.id, ObjectId()));
+        }
+    }
+}
+
+void TreeDiff::compareContent(const std::shared_ptr<Run>& run, Change change) {
+    std::unique_ptr<FileObject> oldFile = store->retrieveObject(change.oldHash);
+    std::unique_ptr<FileObject> newFile = store->retrieveObject(change.newHash);
+    
+    TextFile* oldText = dynamic_cast<TextFile*>(oldFile.get());
+    TextFile* newText = dynamic_cast<TextFile*>(newFile.get());
+    if (!oldText || !newText) {
+        run->report(std::move(change));
+        return;
+    }
+    
+    DiffEngine engine;
+    engine.setContextLines(contextLines);
+    run->report(std::move(change), engine.computeHunks(oldText, newText));
+}
+
+void TreeDiff::compareTrees(const std::shared_ptr<Run>& run, const Tree* oldTree,
+                            const Tree* newTree, const std::string& prefix) {
+    if (run->isCancelled()) {
+        return;
+    }
+    
+    const std::vector<Tree::Entry>& oldEntries = oldTree->getEntries();
+    const std::vector<Tree::Entry>& newEntries = newTree->getEntries();
+    size_t i = 0, j = 0;
+    
+    while (i < oldEntries.size() || j < newEntries.size()) {
+        if (j == newEntries.size() ||
+            (i < oldEntries.size() && entryBefore(oldEntries[i], newEntries[j]))) {
+            const Tree::Entry& entry = oldEntries[i++];
+            if (entry.isDirectory()) {
+                reportAll(run, *entry.subtree, prefix + entry.name + "/", ChangeType::REMOVED);
+            } else {
+                run->report(Change(ChangeType::REMOVED, prefix + entry.name, entry.id, ObjectId()));
+            }
+            continue;
+        }
+        if (i == oldEntries.size() || entryBefore(newEntries[j], oldEntries[i])) {
+            const Tree::Entry& entry = newEntries[j++];
+            if (entry.isDirectory()) {
+                reportAll(run, *entry.subtree, prefix + entry.name + "/", ChangeType::ADDED);
+            } else {
+                run->report(Change(ChangeType::ADDED, prefix + entry.name, ObjectId(), entry.id));
+            }
+            continue;
+        }
+        
+        const Tree::Entry& oldEntry = oldEntries[i++];
+        const Tree::Entry& newEntry = newEntries[j++];
+        if (oldEntry.id == newEntry.id) {
+            continue;
+        }
+        
+        std::string path = prefix + oldEntry.name;
+        if (oldEntry.isDirectory()) {
+            const Tree* oldSub = oldEntry.subtree.get();
+            const Tree* newSub = newEntry.subtree.get();
+            spawn(run, [this, run, oldSub, newSub, path]() {
+                compareTrees(run, oldSub, newSub, path + "/");
+            });
+        } else if (store) {
+            Change change(ChangeType::MODIFIED, path, oldEntry.id, newEntry.id);
+            spawn(run, [this, run, change]() { compareContent(run, change); });
+        } else {
+            run->report(Change(ChangeType::MODIFIED, path, oldEntry.id, newEntry.id));
+        }
+    }
+}
+
+void TreeDiff::diff(const Tree& oldTree, const Tree& newTree, const Callback& callback) {
+    if (oldTree.getId() == newTree.getId()) {
+        return;
+    }
+    
+    auto run = std::make_shared<Run>();
+    const Tree* oldRoot = &oldTree;
+    const Tree* newRoot = &newTree;
+    spawn(run, [this, run, oldRoot, newRoot]() {
+        compareTrees(run, oldRoot, newRoot, "");
+    });
+    
+    // Keep draining until every task has finished, even after a failure,
+    // since the tasks refer to both trees.
+    while (true) {
+        std::deque<std::pair<Change, std::vector<Hunk>>> batch;
+        {
+            std::unique_lock<std::mutex> lock(run->mtx);
+            if (run->results.empty() && run->outstanding > 0) {
+                lock.unlock();
+                if (pool.tryRunTask()) {
+                    continue;
+                }
+                lock.lock();
+                run->cv.wait(lock, [&run]() {
+                    return !run->results.empty() || run->outstanding == 0;
+                });
+            }
+            if (run->results.empty() && run->outstanding == 0) {
+                break;
+            }
+            batch.swap(run->results);
+        }
+        
+        for (const auto& result : batch) {
+            if (run->isCancelled()) {
+                break;
+            }
+            try {
+                callback(result.first, result.second);
+            } catch (...) {
+                run->fail(std::current_exception());
+            }
+        }
+    }
+    
+    if (run->error) {
+        std::rethrow_exception(run->error);
+    }
+}
+
+void TreeDiff::diff(const std::map<std::string, ObjectId>& oldFiles,
+                    const std::map<std::string, ObjectId>& newFiles,
+                    const Callback& callback) {
+    std::unique_ptr<Tree> oldTree = Tree::fromMap(oldFiles);
+    std::unique_ptr<Tree> newTree = Tree::fromMap(newFiles);
+    diff(*oldTree, *newTree, callback);
+}
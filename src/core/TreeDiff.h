@@ -0,0 +1,52 @@
+#ifndef TREEDIFF_H
+#define TREEDIFF_H
+
+#include "DiffEngine.h"
+#include "Tree.h"
+#include "ThreadPool.h"
+#include <functional>
+#include <map>
+
+class ObjectStore;
+
+// Compares two snapshots across the thread pool. Each pair of differing
+// directories is compared as its own task and every modified text file is
+// diffed line by line as another, so large trees spread over all workers
+// while directories whose hashes match are skipped outright.
+class TreeDiff {
+public:
+    // Hunks are filled in for modified text files when an object store
+    // has been set, and are empty otherwise.
+    typedef std::function<void(const Change& change, const std::vector<Hunk>& hunks)> Callback;
+    
+private:
+    struct Run;
+    
+    ThreadPool& pool;
+    ObjectStore* store;
+    int contextLines;
+    
+    template<typename Func>
+    void spawn(const std::shared_ptr<Run>& run, Func func);
+    void compareTrees(const std::shared_ptr<Run>& run, const Tree* oldTree,
+                      const Tree* newTree, const std::string& prefix);
+    void reportAll(const std::shared_ptr<Run>& run, const Tree& tree,
+                   const std::string& prefix, ChangeType type);
+    void compareContent(const std::shared_ptr<Run>& run, Change change);
+    
+public:
+    explicit TreeDiff(ThreadPool& threads = ThreadPool::shared());
+    
+    void setObjectStore(ObjectStore* objects) { store = objects; }
+    void setContextLines(int lines) { contextLines = lines; }
+    
+    // Changes are passed to callback on the calling thread as soon as
+    // they are found, in no particular order. Exceptions from the
+    // content diffs are rethrown once all other work has finished.
+    void diff(const Tree& oldTree, const Tree& newTree, const Callback& callback);
+    void diff(const std::map<std::string, ObjectId>& oldFiles,
+              const std::map<std::string, ObjectId>& newFiles,
+              const Callback& callback);
+};
+
+#endif
@@ -0,0 +1,74 @@
+#include "YoungGeneration.h"
+#include <cstdio>
+#include <filesystem>
+#include <iterator>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+YoungGeneration::YoungGeneration(const std::string& directory)
+    : logPath(directory + "/gc.young"), active(fs::exists(logPath)) {
+}
+
+void YoungGeneration::record(const std::vector<std::pair<ObjectId, IndexEntry>>& entries) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!active || entries.empty()) {
+        return;
+    }
+    if (!log.is_open()) {
+        log.open(logPath, std::ios::binary | std::ios::app);
+    }
+    for (const auto& entry : entries) {
+        log.write(reinterpret_cast<const char*>(entry.first.begin()), ObjectId::SIZE);
+    }
+    log.flush();
+}
+
+bool YoungGeneration::begin(std::vector<ObjectId>& ids, uint64_t& mark) {
+    std::lock_guard<std::mutex> lock(mtx);
+    ids.clear();
+    mark = 0;
+    
+    if (!active) {
+        std::ofstream create(logPath, std::ios::binary | std::ios::app);
+        if (!create.is_open()) {
+            throw std::runtime_error("Cannot create collection log: " + logPath);
+        }
+        active = true;
+        return false;
+    }
+    
+    std::ifstream in(logPath, std::ios::binary);
+    uint8_t raw[ObjectId::SIZE];
+    while (in.read(reinterpret_cast<char*>(raw), ObjectId::SIZE)) {
+        ids.emplace_back(raw);
+        mark += ObjectId::SIZE;
+    }
+    return true;
+}
+
+void YoungGeneration::finish(const std::vector<ObjectId>& survivors, uint64_t mark) {
+    std::lock_guard<std::mutex> lock(mtx);
+    log.close();
+    
+    std::vector<char> tail;
+    {
+        std::ifstream in(logPath, std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(mark));
+        if (in) {
+            tail.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+    }
+    
+    std::string tmpPath = logPath + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    for (const ObjectId& id : survivors) {
+        out.write(reinterpret_cast<const char*>(id.begin()), ObjectId::SIZE);
+    }
+    out.write(tail.data(), static_cast<std::streamsize>(tail.size()));
+    out.close();
+    if (!out || std::rename(tmpPath.c_str(), logPath.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+        throw std::runtime_error("Cannot write collection log: " + logPath);
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef YOUNGGENERATION_H
+#define YOUNGGENERATION_H
+
+#include "ObjectIndex.h"
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Log of the loose objects added since the last garbage collection, so an
+// incremental collection only has to look at those rather than the whole
+// store. Objects a collection finds reachable are promoted by leaving
+// them out of the rewritten log; anything it could not decide on yet
+// stays young for the next run.
+//
+// Nothing is recorded until the first collection starts the log, so a
+// store that is never collected pays nothing for it.
+class YoungGeneration {
+private:
+    std::string logPath;
+    std::ofstream log;
+    bool active;
+    std::mutex mtx;
+    
+public:
+    explicit YoungGeneration(const std::string& directory);
+    YoungGeneration(const YoungGeneration&) = delete;
+    YoungGeneration& operator=(const YoungGeneration&) = delete;
+    
+    // Called by the writer for every group of objects it indexes.
+    void record(const std::vector<std::pair<ObjectId, IndexEntry>>& entries);
+    
+    // Starts the log if needed and reads the ids logged so far; mark is
+    // where the next finish() picks up objects added in the meantime.
+    // False when the log had not been started, in which case ids is
+    // empty and only a full collection can be trusted.
+    bool begin(std::vector<ObjectId>& ids, uint64_t& mark);
+    
+    // Replaces everything logged before mark with survivors.
+    void finish(const std::vector<ObjectId>& survivors, uint64_t mark);
+};
+
+#endif
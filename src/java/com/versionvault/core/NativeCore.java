@@ -0,0 +1,86 @@
+package com.versionvault.core;
+
+import java.io.IOException;
+import java.nio.ByteBuffer;
+
+public final class NativeCore {
+    private static final boolean LOADED = load();
+
+    private NativeCore() {
+    }
+
+    private static boolean load() {
+        if (Boolean.getBoolean("versionvault.disableNative")) {
+            return false;
+        }
+        try {
+            System.loadLibrary("vv_jni");
+            return true;
+        } catch (UnsatisfiedLinkError e) {
+            return false;
+        }
+    }
+
+    public static boolean isLoaded() {
+        return LOADED;
+    }
+
+    // Budgets for the store's cache tiers: objects in memory, objects kept
+    // compressed in memory, and a segment shared with other processes on
+    // the same store. A budget of 0 turns the latter two off. objectFormat,
+    // "sha256" or "blake3", only applies to a store that does not exist yet.
+    public static native long openStore(String objectsPath, long memoryCacheBytes, long compressedCacheBytes,
+                                        long sharedCacheBytes, String objectFormat) throws IOException;
+
+    public static native String storeFile(long store, String path) throws IOException;
+
+    public static native boolean restoreFile(long store, String hash, String targetPath) throws IOException;
+
+    public static native boolean hasObject(long store, String hash);
+
+    // Objects are written in the background; this makes every object
+    // stored so far durable.
+    public static native void flush(long store) throws IOException;
+
+    // Objects, loose objects, loose bytes, packed objects, packed bytes and
+    // the bytes of the pack files, from totals the store keeps as it goes.
+    public static native long[] storageStats(long store);
+
+    // Deletes every loose object not reachable from roots, the hashes still
+    // referenced, unless it is younger than graceHours. An incremental run
+    // only looks at objects added since the last one.
+    public static native long collectGarbage(long store, String[] roots, boolean full, int graceHours)
+            throws IOException;
+
+    // Buffers passed to the methods below must be direct.
+    public static native String storeBuffer(long store, ByteBuffer data, int offset, int length, String name)
+            throws IOException;
+
+    // Returns the object's size after copying it into target, or the size
+    // negated if target is too small.
+    public static native long readObject(long store, String hash, ByteBuffer target) throws IOException;
+
+    // Hex digest with "sha256", "blake3" or "sha1"; the last names objects
+    // the way stores written by older versions did.
+    public static native String hash(ByteBuffer data, int offset, int length, String algorithm);
+
+    public static native String unifiedDiff(ByteBuffer oldText, int oldLength, ByteBuffer newText, int newLength,
+                                            int contextLines);
+
+    // Writes the unified diff of two files to outputPath without loading
+    // either, so files of any size can be compared. False when they have
+    // no changes, in which case the output is empty.
+    public static native boolean diffFiles(String oldPath, String newPath, String outputPath, int contextLines)
+            throws IOException;
+
+    public static ByteBuffer readObject(long store, String hash) throws IOException {
+        ByteBuffer buffer = ByteBuffer.allocateDirect(64 * 1024);
+        long size = readObject(store, hash, buffer);
+        if (size < 0) {
+            buffer = ByteBuffer.allocateDirect((int) -size);
+            size = readObject(store, hash, buffer);
+        }
+        buffer.limit((int) Math.max(size, 0));
+        return buffer;
+    }
+}
@@ -1,18 +1,47 @@
 package com.versionvault.core;
 
 import java.io.*;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
 import java.nio.file.*;
 import java.security.MessageDigest;
 import java.security.NoSuchAlgorithmException;
+import java.util.HashSet;
+import java.util.Set;
 
 public class ObjectStore {
     private Repository repository;
+    private long nativeStore;
 
     public ObjectStore(Repository repo) {
         this.repository = repo;
     }
 
+    // The native store is opened on first use, since the repository may not
+    // have been initialised when this object is created.
+    private boolean useNative() throws IOException {
+        if (!NativeCore.isLoaded()) {
+            return false;
+        }
+        if (nativeStore == 0) {
+            nativeStore = NativeCore.openStore(Paths.get(repository.getVVPath(), "objects").toString(),
+                    cacheBudget("versionvault.cache.memoryMB", 256),
+                    cacheBudget("versionvault.cache.compressedMB", 0),
+                    cacheBudget("versionvault.cache.sharedMB", 0),
+                    System.getProperty("versionvault.objectFormat", "sha256"));
+        }
+        return true;
+    }
+
+    private static long cacheBudget(String property, long defaultMB) {
+        return Long.getLong(property, defaultMB) * 1024 * 1024;
+    }
+
     public String storeBlob(Path file) throws IOException {
+        if (useNative()) {
+            return NativeCore.storeFile(nativeStore, file.toString());
+        }
+
         byte[] content = Files.readAllBytes(file);
         String hash = calculateHash(content);
 
@@ -26,7 +55,52 @@ public class ObjectStore {
         return hash;
     }
 
+    public void flush() throws IOException {
+        if (nativeStore != 0) {
+            NativeCore.flush(nativeStore);
+        }
+    }
+
+    // See NativeCore.storageStats; null without the native library, which
+    // is the only path that keeps totals.
+    public long[] getStorageStats() throws IOException {
+        return useNative() ? NativeCore.storageStats(nativeStore) : null;
+    }
+
+    // Every file of every commit is a root; staged files have not been
+    // stored yet, and files stored since are covered by the grace period.
+    public long collectGarbage(boolean full, int graceHours) throws IOException {
+        if (!useNative()) {
+            throw new IOException("Garbage collection requires the native vv_jni library");
+        }
+
+        Set<String> roots = new HashSet<>();
+        for (Commit commit : repository.getCommitHistory().getAllCommits()) {
+            roots.addAll(commit.getFileHashes().values());
+        }
+        return NativeCore.collectGarbage(nativeStore, roots.toArray(new String[0]), full, graceHours);
+    }
+
     public void restoreBlob(String hash, Path targetFile) throws IOException {
+        if (useNative() && isLegacyHash(hash)) {
+            ByteBuffer content = readLegacyObject(hash);
+            Files.createDirectories(targetFile.toAbsolutePath().getParent());
+            try (FileChannel out = FileChannel.open(targetFile, StandardOpenOption.CREATE,
+                    StandardOpenOption.WRITE, StandardOpenOption.TRUNCATE_EXISTING)) {
+                while (content.hasRemaining()) {
+                    out.write(content);
+                }
+            }
+            return;
+        }
+        if (useNative()) {
+            Files.createDirectories(targetFile.toAbsolutePath().getParent());
+            if (!NativeCore.restoreFile(nativeStore, hash, targetFile.toString())) {
+                throw new IOException("Object not found: " + hash);
+            }
+            return;
+        }
+
         Path objectPath = getObjectPath(hash);
 
         if (!Files.exists(objectPath)) {
@@ -38,13 +112,49 @@ public class ObjectStore {
         Files.write(targetFile, content);
     }
 
+    public String diffBlobs(String oldHash, String newHash, int contextLines) throws IOException {
+        if (useNative()) {
+            ByteBuffer oldText = readNativeObject(oldHash);
+            ByteBuffer newText = readNativeObject(newHash);
+            return NativeCore.unifiedDiff(oldText, oldText.limit(), newText, newText.limit(), contextLines);
+        }
+        throw new IOException("Diff requires the native vv_jni library");
+    }
+
+    private ByteBuffer readNativeObject(String hash) throws IOException {
+        return isLegacyHash(hash) ? readLegacyObject(hash) : NativeCore.readObject(nativeStore, hash);
+    }
+
+    // Stores written by older versions named objects by their SHA-1. The
+    // native store cannot index those names, so such objects are read from
+    // their loose files and checked against the name instead.
+    private static boolean isLegacyHash(String hash) {
+        return hash.length() == 40;
+    }
+
+    private ByteBuffer readLegacyObject(String hash) throws IOException {
+        Path objectPath = getObjectPath(hash);
+        if (!Files.exists(objectPath)) {
+            throw new IOException("Object not found: " + hash);
+        }
+
+        byte[] content = Files.readAllBytes(objectPath);
+        ByteBuffer buffer = ByteBuffer.allocateDirect(content.length);
+        buffer.put(content).flip();
+        if (!hash.equalsIgnoreCase(NativeCore.hash(buffer, 0, content.length, "sha1"))) {
+            throw new IOException("Object does not match its name: " + hash);
+        }
+        return buffer;
+    }
+
     private Path getObjectPath(String hash) {
         return Paths.get(repository.getVVPath(), "objects", hash.substring(0, 2), hash.substring(2));
     }
 
+    // SHA-256, as in vv_core, so both paths name objects the same way.
     private String calculateHash(byte[] content) {
         try {
-            MessageDigest digest = MessageDigest.getInstance("SHA-1");
+            MessageDigest digest = MessageDigest.getInstance("SHA-256");
             byte[] hashBytes = digest.digest(content);
             StringBuilder sb = new StringBuilder();
             for (byte b : hashBytes) {
@@ -52,7 +162,7 @@ public class ObjectStore {
             }
             return sb.toString();
         } catch (NoSuchAlgorithmException e) {
-            throw new RuntimeException("SHA-1 algorithm not found", e);
+            throw new RuntimeException("SHA-256 algorithm not found", e);
         }
     }
 }
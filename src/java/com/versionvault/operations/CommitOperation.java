@@ -47,6 +47,13 @@ public class CommitOperation extends VaultOperation {
             commit.addFile(path, fileHash);
         }
 
+        // One sync for the whole commit instead of one per file.
+        try {
+            repository.getObjectStore().flush();
+        } catch (IOException e) {
+            throw new OperationException("Failed to store files: " + e.getMessage());
+        }
+
         for (String removedPath : staging.getRemovedFiles()) {
             commit.removeFile(removedPath);
         }
@@ -0,0 +1,334 @@
+#include <jni.h>
+#include "DiffEngine.h"
+#include "DiffFormatter.h"
+#include "FileObject.h"
+#include "ObjectStore.h"
+#include "StreamingDiff.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+// Native side of com.versionvault.core.NativeCore. Stores are passed to
+// Java as the address of the process-wide ObjectStore, and bulk data moves
+// through direct ByteBuffers so it is never copied onto the Java heap.
+
+namespace {
+
+std::string toString(JNIEnv* env, jstring value) {
+    if (!value) {
+        return std::string();
+    }
+    const char* chars = env->GetStringUTFChars(value, nullptr);
+    std::string result(chars);
+    env->ReleaseStringUTFChars(value, chars);
+    return result;
+}
+
+jstring toJava(JNIEnv* env, const std::string& value) {
+    return env->NewStringUTF(value.c_str());
+}
+
+void throwIOException(JNIEnv* env, const char* message) {
+    jclass cls = env->FindClass("java/io/IOException");
+    if (cls) {
+        env->ThrowNew(cls, message);
+    }
+}
+
+ObjectStore* storeOf(jlong handle) {
+    return reinterpret_cast<ObjectStore*>(handle);
+}
+
+// The bytes [offset, offset + length) of a direct buffer, or null after
+// throwing if the buffer is not direct or the range does not fit.
+const char* directBytes(JNIEnv* env, jobject buffer, jint offset, jint length) {
+    char* base = buffer ? static_cast<char*>(env->GetDirectBufferAddress(buffer)) : nullptr;
+    jlong capacity = buffer ? env->GetDirectBufferCapacity(buffer) : -1;
+    if (!base || offset < 0 || length < 0 || offset + static_cast<jlong>(length) > capacity) {
+        jclass cls = env->FindClass("java/lang/IllegalArgumentException");
+        if (cls) {
+            env->ThrowNew(cls, "Expected a direct ByteBuffer covering the requested range");
+        }
+        return nullptr;
+    }
+    return base + offset;
+}
+
+std::vector<std::string_view> splitLines(const char* data, size_t size) {
+    std::vector<std::string_view> lines;
+    size_t start = 0;
+    while (start < size) {
+        const void* newline = std::memchr(data + start, '\n', size - start);
+        size_t end = newline ? static_cast<const char*>(newline) - data : size;
+        lines.emplace_back(data + start, end - start);
+        start = end + 1;
+    }
+    return lines;
+}
+
+bool parseId(JNIEnv* env, jstring hash, ObjectId& id) {
+    return ObjectId::parse(toString(env, hash), id);
+}
+
+}
+
+extern "C" {
+
+// The cache budgets only take effect for the first store the process opens,
+// and the object format only for a store that does not exist yet.
+JNIEXPORT jlong JNICALL
+Java_com_versionvault_core_NativeCore_openStore(JNIEnv* env, jclass, jstring path,
+                                                jlong memoryCacheBytes, jlong compressedCacheBytes,
+                                                jlong sharedCacheBytes, jstring objectFormat) {
+    try {
+        HashAlgorithm format;
+        std::string formatName = toString(env, objectFormat);
+        if (!Hasher::parseName(formatName, format)) {
+            throw std::runtime_error("Unknown object format: " + formatName);
+        }
+        
+        CacheConfig cache;
+        cache.memoryBytes = static_cast<size_t>(std::max<jlong>(memoryCacheBytes, 0));
+        cache.compressedBytes = static_cast<size_t>(std::max<jlong>(compressedCacheBytes, 0));
+        cache.sharedBytes = static_cast<size_t>(std::max<jlong>(sharedCacheBytes, 0));
+        return reinterpret_cast<jlong>(ObjectStore::getInstance(toString(env, path), cache, format));
+    } catch (const std::exception& e) {
+        throwIOException(env, e.what());
+        return 0;
+    }
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_versionvault_core_NativeCore_storeFile(JNIEnv* env, jclass, jlong store, jstring path) {
+    try {
+        std::unique_ptr<FileObject> file = FileFactory::createFileObject(toString(env, path));
+        return toJava(env, storeOf(store)->storeObject(*file).toHex());
+    } catch (const std::exception& e) {
+        throwIOException(env, e.what());
+        return nullptr;
+    }
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_versionvault_core_NativeCore_restoreFile(JNIEnv* env, jclass, jlong store,
+                                                  jstring hash, jstring targetPath) {
+    try {
+        ObjectId id;
+        if (!parseId(env, hash, id)) {
+            return JNI_FALSE;
+        }
+        std::unique_ptr<FileObject> object = storeOf(store)->retrieveObject(id);
+        if (!object) {
+            return JNI_FALSE;
+        }
+        
+        std::string target = toString(env, targetPath);
+        ContentView content = object->viewContent();
+        std::ofstream out(target, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            throw std::runtime_error("Cannot create file: " + target);
+        }
+        out.write(content.data(), content.size());
+        out.close();
+        if (!out) {
+            throw std::runtime_error("Cannot write file: " + target);
+        }
+        return JNI_TRUE;
+    } catch (const std::exception& e) {
+        throwIOException(env, e.what());
+        return JNI_FALSE;
+    }
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_versionvault_core_NativeCore_hasObject(JNIEnv* env, jclass, jlong store, jstring hash) {
+    ObjectId id;
+    return parseId(env, hash, id) && storeOf(store)->hasObject(id) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_versionvault_core_NativeCore_flush(JNIEnv* env, jclass, jlong store) {
+    try {
+        storeOf(store)->flush();
+    } catch (const std::exception& e) {
+        throwIOException(env, e.what());
+    }
+}
+
+// Objects, loose objects, loose bytes, packed objects, packed bytes and
+// pack file bytes, in that order.
+JNIEXPORT jlongArray JNICALL
+Java_com_versionvault_core_NativeCore_storageStats(JNIEnv* env, jclass, jlong store) {
+    StorageStats stats = storeOf(store)->getStorageStats();
+    jlong values[] = {
+        static_cast<jlong>(stats.objects), static_cast<jlong>(stats.looseObjects),
+        static_cast<jlong>(stats.looseBytes), static_cast<jlong>(stats.packedObjects),
+        static_cast<jlong>(stats.packedBytes), static_cast<jlong>(stats.packFileBytes)
+    };
+    jlongArray result = env->NewLongArray(6);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 6, values);
+    }
+    return result;
+}
+
+// Roots that are not valid ids are skipped. Returns the number of objects
+// deleted.
+JNIEXPORT jlong JNICALL
+Java_com_versionvault_core_NativeCore_collectGarbage(JNIEnv* env, jclass, jlong store,
+                                                     jobjectArray roots, jboolean full,
+                                                     jint graceHours) {
+    try {
+        std::vector<ObjectId> ids;
+        jsize count = roots ? env->GetArrayLength(roots) : 0;
+        ids.reserve(count);
+        for (jsize i = 0; i < count; i++) {
+            jstring hash = static_cast<jstring>(env->GetObjectArrayElement(roots, i));
+            ObjectId id;
+            if (parseId(env, hash, id)) {
+                ids.push_back(id);
+            }
+            env->DeleteLocalRef(hash);
+        }
+        
+        GcOptions options;
+        options.full = full == JNI_TRUE;
+        options.gracePeriod = std::chrono::hours(std::max<jint>(graceHours, 0));
+        return static_cast<jlong>(storeOf(store)->cleanup(ids, options).removed);
+    } catch (const std::exception& e) {
+        throwIOException(env, e.what());
+        return 0;
+    }
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_versionvault_core_NativeCore_storeBuffer(JNIEnv* env, jclass, jlong store,
+                                                  jobject buffer, jint offset, jint length,
+                                                  jstring name) {
+    const char* data = directBytes(env, buffer, offset, length);
+    if (!data) {
+        return nullptr;
+    }
+    
+    try {
+        // The name is only recorded with the object; nothing is written to
+        // it, and the store copies the bytes if it keeps them.
+        std::string path = toString(env, name);
+        ContentView content(data, static_cast<size_t>(length));
+        std::unique_ptr<FileObject> file;
+        if (FileFactory::classify(path, content) == ObjectType::BINARY) {
+            file.reset(new BinaryFile(path, content));
+        } else {
+            file.reset(new TextFile(path, content));
+        }
+        return toJava(env, storeOf(store)->storeObject(*file).toHex());
+    } catch (const std::exception& e) {
+        throwIOException(env, e.what());
+        return nullptr;
+    }
+}
+
+// Copies the object into target and returns its size. When target is too
+// small nothing is copied and the size is returned negated; a missing
+// object returns zero with target untouched, as does an empty one.
+JNIEXPORT jlong JNICALL
+Java_com_versionvault_core_NativeCore_readObject(JNIEnv* env, jclass, jlong store,
+                                                 jstring hash, jobject target) {
+    try {
+        ObjectId id;
+        if (!parseId(env, hash, id)) {
+            return 0;
+        }
+        std::unique_ptr<FileObject> object = storeOf(store)->retrieveObject(id);
+        if (!object) {
+            return 0;
+        }
+        
+        ContentView content = object->viewContent();
+        jlong size = static_cast<jlong>(content.size());
+        char* base = target ? static_cast<char*>(env->GetDirectBufferAddress(target)) : nullptr;
+        if (!base || env->GetDirectBufferCapacity(target) < size) {
+            return -size;
+        }
+        std::memcpy(base, content.data(), content.size());
+        return size;
+    } catch (const std::exception& e) {
+        throwIOException(env, e.what());
+        return 0;
+    }
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_versionvault_core_NativeCore_hash(JNIEnv* env, jclass, jobject buffer,
+                                           jint offset, jint length, jstring algorithmName) {
+    HashAlgorithm algorithm;
+    if (!Hasher::parseName(toString(env, algorithmName), algorithm)) {
+        jclass cls = env->FindClass("java/lang/IllegalArgumentException");
+        if (cls) {
+            env->ThrowNew(cls, "Unknown hash algorithm");
+        }
+        return nullptr;
+    }
+    const char* data = directBytes(env, buffer, offset, length);
+    if (!data) {
+        return nullptr;
+    }
+    
+    std::unique_ptr<Hasher> hasher = Hasher::create(algorithm);
+    hasher->update(data, static_cast<size_t>(length));
+    return toJava(env, Hasher::toHex(hasher->finish(), algorithm));
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_versionvault_core_NativeCore_unifiedDiff(JNIEnv* env, jclass,
+                                                  jobject oldText, jint oldLength,
+                                                  jobject newText, jint newLength,
+                                                  jint contextLines) {
+    const char* oldData = directBytes(env, oldText, 0, oldLength);
+    if (!oldData) {
+        return nullptr;
+    }
+    const char* newData = directBytes(env, newText, 0, newLength);
+    if (!newData) {
+        return nullptr;
+    }
+    
+    std::vector<std::string_view> oldLines = splitLines(oldData, static_cast<size_t>(oldLength));
+    std::vector<std::string_view> newLines = splitLines(newData, static_cast<size_t>(newLength));
+    
+    AdaptiveDiff algorithm;
+    std::string text;
+    StringSink sink(text);
+    UnifiedDiffFormatter(contextLines).format(oldLines, newLines,
+                                              algorithm.computeEdits(oldLines, newLines), sink);
+    return toJava(env, text);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_versionvault_core_NativeCore_diffFiles(JNIEnv* env, jclass, jstring oldPath,
+                                                jstring newPath, jstring outputPath,
+                                                jint contextLines) {
+    try {
+        std::string output = toString(env, outputPath);
+        std::ofstream out(output, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            throw std::runtime_error("Cannot create file: " + output);
+        }
+        
+        AdaptiveDiff algorithm;
+        StreamSink sink(out);
+        bool differ = StreamingDiff(algorithm, UnifiedDiffFormatter(contextLines))
+            .diffFiles(toString(env, oldPath), toString(env, newPath), sink);
+        out.close();
+        if (!out) {
+            throw std::runtime_error("Cannot write file: " + output);
+        }
+        return differ ? JNI_TRUE : JNI_FALSE;
+    } catch (const std::exception& e) {
+        throwIOException(env, e.what());
+        return JNI_FALSE;
+    }
+}
+
+}